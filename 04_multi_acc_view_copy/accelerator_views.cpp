@@ -36,7 +36,8 @@ hc::completion_future busywork(hc::array<double,1>& device_data, std::size_t rep
     float tm;\
     {\
       SystemTimer timer(tm);\
-      fun_call;\
+      if(av::metrics::enabled()) av::metrics::timed(#fun_call, [&]{ return fun_call; });\
+      else fun_call;\
     }\
     std::cerr << #fun_call << ": " << tm << " seconds\n";\
   }
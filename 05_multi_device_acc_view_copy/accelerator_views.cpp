@@ -17,7 +17,8 @@ constexpr size_t operator"" _GiB(unsigned long long GiB){ return GiB * 1024 * 10
     {									\
       SystemTimer timer(tm);						\
       std::wcerr << #fun_call << ": ";					\
-      fun_call;								\
+      if(av::metrics::enabled()) av::metrics::timed(#fun_call, [&]{ return fun_call; }, size * sizeof(double));	\
+      else fun_call;	\
     }									\
     auto GiB = 1.0 * size * sizeof(double) / (1024 * 1024 * 1024);	\
     std::wcerr << tm << " seconds, " << GiB/tm << "GiB/s\n"; \
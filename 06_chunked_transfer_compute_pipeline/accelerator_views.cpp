@@ -0,0 +1,75 @@
+#include <hc.hpp>
+#include <hc_am.hpp>
+#include <pinned_vector.hpp>
+#include <iostream>
+#include <algorithm>
+#include <numeric>
+#include <cstdlib>
+#include "scoped_timers.hpp"
+#include "chunked_pipeline.hpp"
+
+using namespace hc;
+
+constexpr size_t operator"" _MiB(unsigned long long MiB){ return MiB * 1024 * 1024 / sizeof(double); }
+constexpr size_t operator"" _GiB(unsigned long long GiB){ return GiB * 1024 * 1024 * 1024 / sizeof(double); }
+
+// recursive template for doing n floating point operations
+template<int n> double flops(double arg) [[hc]] { return arg + arg * flops<n-2>(arg); }
+template<> double flops<1>(double arg) [[hc]] { return arg + arg; }
+template<> double flops<0>(double arg) [[hc]] { return arg; }
+
+
+hc::completion_future busywork(hc::array<double,1>& device_data, std::size_t reps, double threshold, double final_value)
+{
+  return parallel_for_each(device_data.get_accelerator_view(), device_data.get_extent(),
+			   [=,&device_data](hc::index<1> idx)[[hc]]
+			   {
+			     for(std::size_t rep = 0; rep != reps; ++rep){
+			       device_data[idx] = flops<1000>(device_data[idx]);
+			     }
+			     if(device_data[idx] >= threshold){
+			       device_data[idx] = final_value;
+			     }
+			   });
+}
+
+void show_stats(const char* label, const av::pipeline_stats& stats){
+  std::cerr << label << ": " << stats.chunks << " chunks, " << stats.seconds << " seconds, "
+	    << stats.gib_per_second() << "GiB/s (H2D + D2H)\n"
+	    << "  busy: H2D " << stats.h2d_seconds << "s, kernels " << stats.kernel_seconds
+	    << "s, D2H " << stats.d2h_seconds << "s, concurrency " << stats.concurrency() << '\n';
+}
+
+// usage: accelerator_views [chunk size in MiB (16)] [number of views (3)] [total size in MiB (1024)]
+int main(int argc, char* argv[]){
+  float tm;
+  {
+    SystemTimer timer(tm);
+    std::size_t chunk = (argc > 1 ? std::atoi(argv[1]) : 16) * 1_MiB;
+    std::size_t views = argc > 2 ? std::atoi(argv[2]) : 3;
+    std::size_t size = (argc > 3 ? std::atoi(argv[3]) : 1024) * 1_MiB;
+    hc::accelerator acc;
+
+    pinned_vector<double> host_data(size); // host pinned memory, alloc-ed with am_alloc, zero-initialized
+    auto work = [](hc::array<double,1>& chunk){ return busywork(chunk, 1, 0.0, 1.0); };
+
+    // serialized, as in example 03: one view, one chunk, copy in, compute, copy out
+    av::chunked_pipeline<double> serial(acc, size, 1);
+    auto serial_stats = serial.run(host_data.data(), size, work);
+    show_stats("serialized", serial_stats);
+    auto average = std::accumulate(host_data.begin(), host_data.end(), 0.0) / size;
+    std::cerr << "average: " << average << '\n';
+
+    std::fill(host_data.begin(), host_data.end(), 0.0);
+    av::chunked_pipeline<double> pipeline(acc, chunk, views);
+    auto stats = pipeline.run(host_data.data(), size, work);
+    show_stats("pipelined", stats);
+    average = std::accumulate(host_data.begin(), host_data.end(), 0.0) / size;
+    std::cerr << "average: " << average << '\n';
+
+    std::cerr << "chunk size " << chunk * sizeof(double) / (1024 * 1024) << " MiB, " << views << " views: "
+	      << "speedup " << serial_stats.seconds / stats.seconds << ", "
+	      << 100 * (1 - stats.seconds / serial_stats.seconds) << "% of the serialized time hidden\n";
+  }
+  std::cerr << "total time: " << tm << " seconds\n";
+}
@@ -0,0 +1,93 @@
+#include <hc.hpp>
+#include <hc_am.hpp>
+#include <pinned_vector.hpp>
+#include <iostream>
+#include <algorithm>
+#include <numeric>
+#include <cstdlib>
+#include "scoped_timers.hpp"
+#include "d2d_copy_engine.hpp"
+
+using namespace hc;
+
+constexpr size_t operator"" _MiB(unsigned long long MiB){ return MiB * 1024 * 1024 / sizeof(double); }
+constexpr size_t operator"" _GiB(unsigned long long GiB){ return GiB * 1024 * 1024 * 1024 / sizeof(double); }
+
+#define SHOW_TIME(fun_call)						\
+  {									\
+    float tm;								\
+    {									\
+      SystemTimer timer(tm);						\
+      std::wcerr << #fun_call << ": ";					\
+      if(av::metrics::enabled()) av::metrics::timed(#fun_call, [&]{ return fun_call; }, size * sizeof(double));	\
+      else fun_call;	\
+    }									\
+    auto GiB = 1.0 * size * sizeof(double) / (1024 * 1024 * 1024);	\
+    std::wcerr << tm << " seconds, " << GiB/tm << "GiB/s\n"; \
+  }
+
+std::vector<int> get_devices(const std::vector<hc::accelerator>& accelerators){
+  std::vector<int> devices;
+  for(std::size_t i=0; i!= accelerators.size(); ++i){
+    if(accelerators[i].get_device_path() != L"cpu"){
+      devices.push_back(i);
+    }
+  }
+  return devices;
+}
+
+// usage: accelerator_views [size in MiB (1024)]
+int main(int argc, char* argv[]){
+  float tm;
+  {
+    SystemTimer timer(tm);
+    std::size_t size = (argc > 1 ? std::atoi(argv[1]) : 1024) * 1_MiB;
+    auto accelerators = accelerator::get_all();
+    auto devices = get_devices(accelerators);
+    std::wcerr << "number of GPU devices: " << devices.size() << "\n\n";
+    if(devices.size() == 0){
+      std::wcerr << "No GPU devices found, exiting.\n";
+      return 1;
+    }
+
+    auto devno1 = devices.front();
+    auto devno2 = devices.back(); // if there's only one GPU, front and back are the same device.
+
+    auto acc1 = accelerators[devno1];
+    auto acc2 = accelerators[devno2];
+
+    auto acc_view1 = acc1.create_view();
+    auto acc_view2 = acc2.create_view();
+
+    pinned_vector<double> host_data1(size, 3.1415927); // host pinned memory, alloc-ed with am_alloc, all values initialized to Pi
+    pinned_vector<double> host_data2(size);
+    auto device_ptr1 = static_cast<double*>(hc::am_alloc(size * sizeof(double), acc1, 0));
+    auto device_ptr2 = static_cast<double*>(hc::am_alloc(size * sizeof(double), acc2, 0));
+
+    acc_view1.copy_async(host_data1.data(), device_ptr1, size * sizeof(double)).wait();
+
+    av::d2d_copy_engine engine;
+    for(auto strategy: {av::d2d_strategy::direct, av::d2d_strategy::staged, av::d2d_strategy::split,
+                        av::d2d_strategy::automatic}){
+      std::wcerr << "device " << devno1 << " -> device " << devno2 << ", " << av::to_string(strategy) << ":\n";
+      std::fill(host_data2.begin(), host_data2.end(), 0.0);
+      acc_view2.copy_async(host_data2.data(), device_ptr2, size * sizeof(double)).wait();
+      SHOW_TIME(engine.copy(device_ptr1, acc1, device_ptr2, acc2, size * sizeof(double), strategy));
+      acc_view2.copy_async(device_ptr2, host_data2.data(), size * sizeof(double)).wait();
+      auto average2 = std::accumulate(host_data2.begin(), host_data2.end(), 0.0) / size;
+      std::wcerr << "average2: " << average2 << '\n'; // expected value: 3.1415927
+    }
+
+    for(auto& entry: engine.calibration(acc1, acc2)){
+      auto& cal = entry.second;
+      std::wcerr << "calibration for transfers up to 2^" << entry.first << " bytes: direct "
+                 << cal.direct_gib_per_second << "GiB/s, staged " << cal.staged_gib_per_second
+                 << "GiB/s, split " << cal.split_gib_per_second << "GiB/s (" << 100 * cal.direct_fraction
+                 << "% direct), using " << av::to_string(cal.best) << '\n';
+    }
+
+    am_free(device_ptr1);
+    am_free(device_ptr2);
+  }
+  std::wcerr << "total time: " << tm << " seconds\n";
+}
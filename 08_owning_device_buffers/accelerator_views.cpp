@@ -0,0 +1,105 @@
+#include <hc.hpp>
+#include <hc_am.hpp>
+#include <pinned_vector.hpp>
+#include <iostream>
+#include <algorithm>
+#include <numeric>
+#include "scoped_timers.hpp"
+#include "device_buffer.hpp"
+
+using namespace hc;
+
+constexpr size_t operator"" _MiB(unsigned long long MiB){ return MiB * 1024 * 1024 / sizeof(double); }
+constexpr size_t operator"" _GiB(unsigned long long GiB){ return GiB * 1024 * 1024 * 1024 / sizeof(double); }
+
+// recursive template for doing n floating point operations
+template<int n> double flops(double arg) [[hc]] { return arg + arg * flops<n-2>(arg); }
+template<> double flops<1>(double arg) [[hc]] { return arg + arg; }
+template<> double flops<0>(double arg) [[hc]] { return arg; }
+
+
+hc::completion_future busywork(hc::array<double,1>& device_data, std::size_t reps, double threshold, double final_value)
+{
+  return parallel_for_each(device_data.get_accelerator_view(), device_data.get_extent(),
+			   [=,&device_data](hc::index<1> idx)[[hc]]
+			   {
+			     for(std::size_t rep = 0; rep != reps; ++rep){
+			       device_data[idx] = flops<1000>(device_data[idx]);
+			     }
+			     if(device_data[idx] >= threshold){
+			       device_data[idx] = final_value;
+			     }
+			   });
+}
+
+#define SHOW_TIME(fun_call) \
+  {\
+    float tm;\
+    {\
+      SystemTimer timer(tm);\
+      if(av::metrics::enabled()) av::metrics::timed(#fun_call, [&]{ return fun_call; });\
+      else fun_call;\
+    }\
+    std::cerr << #fun_call << ": " << tm << " seconds\n";\
+  }
+
+bool in_tracker(hc::accelerator& acc, void* ptr){
+  hc::AmPointerInfo info(NULL, NULL, NULL, 0, acc, 0, 0);
+  return hc::am_memtracker_getinfo(&info, ptr) == AM_SUCCESS;
+}
+
+// a pipeline stage that takes ownership of its input buffer, and hands it on when done
+av::device_buffer<double> stage(av::device_buffer<double> buffer, hc::accelerator_view& acc_view){
+  auto device_data = buffer.get_array(acc_view);
+  busywork(device_data, 1, 0.0, 1.0).wait();
+  return buffer;
+}
+
+int main(){
+  float tm;
+  void* first_ptr = nullptr;
+  hc::accelerator acc;
+  {
+    SystemTimer timer(tm);
+    constexpr size_t size = 1_GiB;
+    auto acc_view1 = acc.create_view();
+    auto acc_view2 = acc.create_view();
+    
+    pinned_vector<double> host_data1(size); // host pinned memory, alloc-ed with am_alloc, zero-initialized
+    pinned_vector<double> host_data2(size); 
+    av::device_buffer<double> buffer1(acc, size); // freed when it goes out of scope; no am_free needed
+    auto buffer2 = av::make_shared_device_buffer<double>(acc, size);
+    auto device_data1 = buffer1.get_array(acc_view1);
+    auto device_data2 = buffer2->get_array(acc_view2);
+    first_ptr = buffer1.accelerator_pointer();
+    
+    SHOW_TIME(acc_view1.copy_async(host_data1.data(), buffer1.accelerator_pointer(), size * sizeof(double)));
+    SHOW_TIME(busywork(device_data1, 1, 0.0, 1.0));
+    SHOW_TIME(acc_view1.copy_async(buffer1.accelerator_pointer(), host_data1.data(), size * sizeof(double)));
+
+    SHOW_TIME(acc_view2.copy_async(host_data2.data(), buffer2->accelerator_pointer(), size * sizeof(double)));
+    SHOW_TIME(busywork(device_data2, 1, 0.0, 1.0));
+    SHOW_TIME(acc_view2.copy_async(buffer2->accelerator_pointer(), host_data2.data(), size * sizeof(double)));
+    
+    SHOW_TIME(acc_view1.wait());
+    auto average1 = std::accumulate(host_data1.begin(), host_data1.end(), 0.0) / size;
+    std::cerr << "average1: " << average1 << '\n';
+
+    SHOW_TIME(acc_view2.wait());
+    auto average2 = std::accumulate(host_data2.begin(), host_data2.end(), 0.0) / size;
+    std::cerr << "average2: " << average2 << '\n';
+
+    // move the buffer through two stages and back: no allocations, no copies of the data
+    std::fill(host_data1.begin(), host_data1.end(), 0.0);
+    acc_view1.copy_async(host_data1.data(), buffer1.accelerator_pointer(), size * sizeof(double));
+    auto result = stage(stage(std::move(buffer1), acc_view1), acc_view1);
+    std::cerr << "buffer moved through two stages, same memory: "
+	      << (result.accelerator_pointer() == first_ptr) << ", moved-from buffer empty: " << buffer1.empty() << '\n';
+    acc_view1.copy_async(result.accelerator_pointer(), host_data1.data(), size * sizeof(double)).wait();
+    average1 = std::accumulate(host_data1.begin(), host_data1.end(), 0.0) / size;
+    std::cerr << "average1: " << average1 << '\n';
+    std::cerr << "device memory in tracker before leaving scope: " << in_tracker(acc, first_ptr) << '\n';
+  }
+  std::cerr << "device memory in tracker after leaving scope: " << in_tracker(acc, first_ptr) << '\n';
+  std::cerr << "total time: " << tm << " seconds\n";
+}
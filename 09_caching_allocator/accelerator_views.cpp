@@ -0,0 +1,135 @@
+#include <hc.hpp>
+#include <hc_am.hpp>
+#include <pinned_vector.hpp>
+#include <iostream>
+#include <algorithm>
+#include <numeric>
+#include <random>
+#include <deque>
+#include <cstdlib>
+#include "scoped_timers.hpp"
+#include "caching_allocator.hpp"
+#include "device_buffer.hpp"
+
+using namespace hc;
+
+// Captures the raw device pointer by value rather than the array by reference, so the array may
+// go out of scope before the kernel has run.
+hc::completion_future scale(hc::array<double,1>& device_data, double factor)
+{
+  double* data = device_data.accelerator_pointer();
+  return parallel_for_each(device_data.get_accelerator_view(), device_data.get_extent(),
+			   [=](hc::index<1> idx)[[hc]]
+			   {
+			     data[idx[0]] *= factor;
+			   });
+}
+
+// sizes of a stream of small batches, 4 KiB and up
+std::vector<std::size_t> batch_sizes(std::size_t batches, std::size_t max_kib){
+  std::mt19937 gen(42);
+  std::uniform_int_distribution<std::size_t> kib(4, std::max<std::size_t>(4, max_kib));
+  std::vector<std::size_t> sizes;
+  for(std::size_t i = 0; i != batches; ++i){
+    sizes.push_back(kib(gen) * 1024 / sizeof(double));
+  }
+  return sizes;
+}
+
+struct in_flight {
+  hc::completion_future done;
+  av::pooled_pinned_vector<double> host_data;
+  double expected;
+};
+
+bool check(const double* data, std::size_t size, double expected){
+  return std::all_of(data, data + size, [=](double x){ return x == expected; });
+}
+
+// usage: accelerator_views [number of batches (2000)] [max batch size in KiB (256)]
+int main(int argc, char* argv[]){
+  float tm;
+  {
+    SystemTimer timer(tm);
+    std::size_t batches = argc > 1 ? std::atoi(argv[1]) : 2000;
+    std::size_t max_kib = argc > 2 ? std::atoi(argv[2]) : 256;
+    auto sizes = batch_sizes(batches, max_kib);
+    hc::accelerator acc;
+    std::vector<hc::accelerator_view> views{acc.create_view(), acc.create_view()};
+    bool ok = true;
+
+    // every batch: allocate, copy in, compute, copy out, wait, check, free
+    float tm_raw;
+    {
+      SystemTimer timer(tm_raw);
+      for(std::size_t b = 0; b != batches; ++b){
+	auto& view = views[b % views.size()];
+	auto size = sizes[b];
+	pinned_vector<double> host_data(size, b % 7 + 1.0);
+	av::device_buffer<double> buffer(acc, size);
+	auto device_data = buffer.get_array(view);
+	view.copy_async(host_data.data(), buffer.accelerator_pointer(), size * sizeof(double));
+	scale(device_data, 2.0);
+	view.copy_async(buffer.accelerator_pointer(), host_data.data(), size * sizeof(double)).wait();
+	ok = ok && check(host_data.data(), size, 2 * (b % 7 + 1.0));
+      }
+    }
+    std::cerr << "am_alloc/am_free: " << tm_raw << " seconds, " << tm_raw / batches * 1e6 << " us per batch\n";
+
+    // same, with device and pinned memory from the pools
+    auto& device_pool = av::caching_allocator::device_pool(acc);
+    auto& pinned_pool = av::caching_allocator::pinned_pool();
+    float tm_pooled;
+    {
+      SystemTimer timer(tm_pooled);
+      for(std::size_t b = 0; b != batches; ++b){
+	auto& view = views[b % views.size()];
+	auto size = sizes[b];
+	av::pooled_pinned_vector<double> host_data(size, b % 7 + 1.0);
+	av::device_buffer<double> buffer(device_pool, size);
+	auto device_data = buffer.get_array(view);
+	view.copy_async(host_data.data(), buffer.accelerator_pointer(), size * sizeof(double));
+	scale(device_data, 2.0);
+	view.copy_async(buffer.accelerator_pointer(), host_data.data(), size * sizeof(double)).wait();
+	ok = ok && check(host_data.data(), size, 2 * (b % 7 + 1.0));
+      }
+    }
+    std::cerr << "pooled: " << tm_pooled << " seconds, " << tm_pooled / batches * 1e6 << " us per batch\n";
+
+    // Stream-ordered: device buffers go back to the pool while their view is still using them, so
+    // the host doesn't wait for a batch before submitting the next one. Results are checked a few
+    // batches later.
+    float tm_ordered;
+    {
+      SystemTimer timer(tm_ordered);
+      std::deque<in_flight> pending;
+      for(std::size_t b = 0; b != batches; ++b){
+	auto& view = views[b % views.size()];
+	auto size = sizes[b];
+	pending.push_back(in_flight{hc::completion_future(),
+				    av::pooled_pinned_vector<double>(size, b % 7 + 1.0), 2 * (b % 7 + 1.0)});
+	auto& host_data = pending.back().host_data;
+	av::device_buffer<double> buffer(device_pool, size, view);
+	auto device_data = buffer.get_array(view);
+	view.copy_async(host_data.data(), buffer.accelerator_pointer(), size * sizeof(double));
+	scale(device_data, 2.0);
+	pending.back().done = view.copy_async(buffer.accelerator_pointer(), host_data.data(), size * sizeof(double));
+	while(pending.size() > 8 || (b + 1 == batches && !pending.empty())){
+	  pending.front().done.wait();
+	  ok = ok && check(pending.front().host_data.data(), pending.front().host_data.size(), pending.front().expected);
+	  pending.pop_front();
+	}
+      }
+    }
+    std::cerr << "pooled, stream-ordered: " << tm_ordered << " seconds, " << tm_ordered / batches * 1e6 << " us per batch\n";
+    std::cerr << "results " << (ok ? "correct" : "WRONG") << '\n';
+
+    for(auto pool: {&device_pool, &pinned_pool}){
+      auto stats = pool->stats();
+      std::cerr << (pool == &device_pool ? "device pool: " : "pinned pool: ") << stats.requests << " requests, hit rate "
+		<< 100 * stats.hit_rate() << "%, high-water mark " << stats.high_water_bytes / 1024 << " KiB, cached "
+		<< stats.bytes_cached / 1024 << " KiB, fragmentation " << 100 * stats.fragmentation() << "%\n";
+    }
+  }
+  std::cerr << "total time: " << tm << " seconds\n";
+}
@@ -0,0 +1,129 @@
+#include <hc.hpp>
+#include <hc_am.hpp>
+#include <pinned_vector.hpp>
+#include <iostream>
+#include <algorithm>
+#include <numeric>
+#include <cstdlib>
+#include "scoped_timers.hpp"
+#include "device_buffer.hpp"
+#include "task_graph.hpp"
+
+using namespace hc;
+
+constexpr size_t operator"" _MiB(unsigned long long MiB){ return MiB * 1024 * 1024 / sizeof(double); }
+constexpr size_t operator"" _GiB(unsigned long long GiB){ return GiB * 1024 * 1024 * 1024 / sizeof(double); }
+
+// data[i] = data[i] * factor + offset
+hc::completion_future axpb(hc::accelerator_view& acc_view, double* data, std::size_t size, double factor, double offset)
+{
+  return parallel_for_each(acc_view, extent<1>(size),
+			   [=](hc::index<1> idx)[[hc]]
+			   {
+			     data[idx[0]] = data[idx[0]] * factor + offset;
+			   });
+}
+
+std::vector<hc::accelerator> get_devices(){
+  std::vector<hc::accelerator> devices;
+  for(auto& acc: accelerator::get_all()){
+    if(acc.get_device_path() != L"cpu"){
+      devices.push_back(acc);
+    }
+  }
+  return devices;
+}
+
+// One chain per device: host -> device d, + 1 on device d, device d -> device d+1, * 2 on device
+// d+1, device d+1 -> host. The chains are independent of each other.
+struct chain {
+  chain(hc::accelerator& acc1, hc::accelerator& acc2, std::size_t size, double value)
+    : host_in(size, value), host_out(size), device1(acc1, size), device2(acc2, size), expected((value + 1) * 2)
+  {}
+  pinned_vector<double> host_in;
+  pinned_vector<double> host_out;
+  av::device_buffer<double> device1;
+  av::device_buffer<double> device2;
+  double expected;
+};
+
+bool check(std::vector<chain>& chains, std::size_t size){
+  bool ok = true;
+  for(auto& c: chains){
+    auto average = std::accumulate(c.host_out.begin(), c.host_out.end(), 0.0) / size;
+    std::cerr << "average: " << average << " (expected " << c.expected << ")\n";
+    ok = ok && average == c.expected;
+    std::fill(c.host_out.begin(), c.host_out.end(), 0.0);
+  }
+  return ok;
+}
+
+// usage: accelerator_views [size in MiB per chain (256)]
+int main(int argc, char* argv[]){
+  float tm;
+  {
+    SystemTimer timer(tm);
+    std::size_t size = (argc > 1 ? std::atoi(argv[1]) : 256) * 1_MiB;
+    std::size_t bytes = size * sizeof(double);
+    auto devices = get_devices();
+    std::cerr << "number of GPU devices: " << devices.size() << "\n\n";
+    if(devices.size() == 0){
+      std::cerr << "No GPU devices found, exiting.\n";
+      return 1;
+    }
+
+    std::vector<chain> chains;
+    chains.reserve(devices.size());
+    for(std::size_t d = 0; d != devices.size(); ++d){
+      chains.emplace_back(devices[d], devices[(d + 1) % devices.size()], size, d + 1.0);
+      chains.back().device2.map_to_peer(devices[d]);
+    }
+
+    // as in example 05: every operation waited for on the host
+    float tm_host;
+    {
+      SystemTimer timer(tm_host);
+      for(std::size_t d = 0; d != devices.size(); ++d){
+	auto& c = chains[d];
+	auto acc_view1 = devices[d].get_default_view();
+	auto acc_view2 = devices[(d + 1) % devices.size()].get_default_view();
+	acc_view1.copy_async(c.host_in.data(), c.device1.accelerator_pointer(), bytes).wait();
+	axpb(acc_view1, c.device1.accelerator_pointer(), size, 1.0, 1.0).wait();
+	acc_view1.copy_async(c.device1.accelerator_pointer(), c.device2.accelerator_pointer(), bytes).wait();
+	axpb(acc_view2, c.device2.accelerator_pointer(), size, 2.0, 0.0).wait();
+	acc_view2.copy_async(c.device2.accelerator_pointer(), c.host_out.data(), bytes).wait();
+      }
+    }
+    std::cerr << "host waits after every operation: " << tm_host << " seconds\n";
+    bool ok = check(chains, size);
+
+    // the same operations as a task graph: only the final copies are waited for
+    av::task_graph graph(devices);
+    for(std::size_t d = 0; d != devices.size(); ++d){
+      auto& c = chains[d];
+      std::size_t d2 = (d + 1) % devices.size();
+      double* ptr1 = c.device1.accelerator_pointer();
+      double* ptr2 = c.device2.accelerator_pointer();
+      av::region region1{ptr1, bytes}, region2{ptr2, bytes};
+      graph.copy(c.host_in.data(), ptr1, bytes, "host -> device");
+      graph.kernel(d, {region1}, {region1},
+		   [=](hc::accelerator_view& acc_view){ return axpb(acc_view, ptr1, size, 1.0, 1.0); }, "+ 1");
+      graph.copy(ptr1, ptr2, bytes, "device -> device");
+      graph.kernel(d2, {region2}, {region2},
+		   [=](hc::accelerator_view& acc_view){ return axpb(acc_view, ptr2, size, 2.0, 0.0); }, "* 2");
+      graph.copy(ptr2, c.host_out.data(), bytes, "device -> host");
+    }
+    float tm_graph;
+    {
+      SystemTimer timer(tm_graph);
+      graph.submit();
+      graph.wait();
+    }
+    std::cerr << "task graph: " << tm_graph << " seconds, " << graph.size() << " tasks on "
+	       << graph.num_views() << " views, " << graph.markers_inserted() << " cross-view markers\n";
+    graph.dump(std::cerr);
+    ok = check(chains, size) && ok;
+    std::cerr << "results " << (ok ? "correct" : "WRONG") << '\n';
+  }
+  std::cerr << "total time: " << tm << " seconds\n";
+}
@@ -0,0 +1,77 @@
+#include <hc.hpp>
+#include <hc_am.hpp>
+#include <pinned_vector.hpp>
+#include <iostream>
+#include <algorithm>
+#include <numeric>
+#include <cstdlib>
+#include "scoped_timers.hpp"
+#include "multi_device_for_each.hpp"
+
+using namespace hc;
+
+constexpr size_t operator"" _MiB(unsigned long long MiB){ return MiB * 1024 * 1024 / sizeof(double); }
+constexpr size_t operator"" _GiB(unsigned long long GiB){ return GiB * 1024 * 1024 * 1024 / sizeof(double); }
+
+// recursive template for doing n floating point operations
+template<int n> double flops(double arg) [[hc]] { return arg + arg * flops<n-2>(arg); }
+template<> double flops<1>(double arg) [[hc]] { return arg + arg; }
+template<> double flops<0>(double arg) [[hc]] { return arg; }
+
+std::vector<hc::accelerator> get_devices(){
+  std::vector<hc::accelerator> devices;
+  for(const auto& acc: accelerator::get_all()){
+    if(acc.get_device_path() != L"cpu"){
+      devices.push_back(acc);
+    }
+  }
+  return devices;
+}
+
+void show_stats(const char* label, const av::multi_device_stats& stats, std::size_t size){
+  auto GiB = 1.0 * size * sizeof(double) / (1024 * 1024 * 1024);
+  std::cerr << label << ": " << stats.seconds << " seconds, " << GiB / stats.seconds << "GiB/s\n";
+  for(std::size_t dev = 0; dev != stats.tiles.size(); ++dev){
+    std::cerr << "  device " << dev << ": " << stats.tiles[dev] << " tiles, " << stats.stolen[dev] << " stolen\n";
+  }
+}
+
+// usage: accelerator_views [tile size in MiB (16)] [total size in MiB (1024)]
+int main(int argc, char* argv[]){
+  float tm;
+  {
+    SystemTimer timer(tm);
+    av::multi_device_options opts;
+    opts.tile_elements = (argc > 1 ? std::atoi(argv[1]) : 16) * 1_MiB;
+    std::size_t size = (argc > 2 ? std::atoi(argv[2]) : 1024) * 1_MiB;
+    auto devices = get_devices();
+    std::cerr << "number of GPU devices: " << devices.size() << "\n\n";
+    if(devices.empty()){
+      std::cerr << "No GPU devices found, exiting.\n";
+      return 0;
+    }
+
+    pinned_vector<double> host_data(size); // host pinned memory, alloc-ed with am_alloc, zero-initialized
+    // busywork from example 06, per element
+    auto busywork = [](double& x, std::size_t)[[hc]]{
+      x = flops<1000>(x);
+      if(x >= 0.0) x = 1.0;
+    };
+
+    // the whole extent on one device, as before
+    auto single = av::multi_device_for_each({devices.front()}, host_data.data(), host_data.data(), size,
+                                            busywork, opts);
+    show_stats("one device", single, size);
+    auto average = std::accumulate(host_data.begin(), host_data.end(), 0.0) / size;
+    std::cerr << "average: " << average << '\n'; // expected value: 1
+
+    std::fill(host_data.begin(), host_data.end(), 0.0);
+    auto all = av::multi_device_for_each(devices, host_data.data(), host_data.data(), size, busywork, opts);
+    show_stats("all devices", all, size);
+    average = std::accumulate(host_data.begin(), host_data.end(), 0.0) / size;
+    std::cerr << "average: " << average << '\n';
+
+    std::cerr << devices.size() << " devices: speedup " << single.seconds / all.seconds << '\n';
+  }
+  std::cerr << "total time: " << tm << " seconds\n";
+}
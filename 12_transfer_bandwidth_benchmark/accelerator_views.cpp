@@ -0,0 +1,146 @@
+#include <hc.hpp>
+#include <hc_am.hpp>
+#include <pinned_vector.hpp>
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include "scoped_timers.hpp"
+#include "benchmark.hpp"
+#include "contiguous_copy.hpp"
+
+using namespace hc;
+
+constexpr std::size_t KiB = 1024;
+constexpr std::size_t MiB = 1024 * KiB;
+
+std::vector<hc::accelerator> get_devices(){
+  std::vector<hc::accelerator> devices;
+  for(const auto& acc: accelerator::get_all()){
+    if(acc.get_device_path() != L"cpu"){
+      devices.push_back(acc);
+    }
+  }
+  return devices;
+}
+
+// enough repetitions for a stable median and a meaningful p99 on small sizes, without spending
+// minutes on the large ones
+std::size_t repetitions(std::size_t bytes){
+  return std::max<std::size_t>(10, std::min<std::size_t>(200, 256 * MiB / bytes));
+}
+
+struct benchmark {
+  std::vector<av::benchmark_record> records;
+
+  template<typename Function>
+  void run(std::string operation, std::string host_memory, std::string api, std::size_t views, std::size_t bytes,
+           Function fn){
+    av::benchmark_record r{operation, host_memory, api, views, bytes, av::time_repeated(2, repetitions(bytes), fn)};
+    std::cerr << std::setw(4) << r.operation << std::setw(9) << r.host_memory << std::setw(40) << r.api
+              << std::setw(3) << r.views << std::setw(12) << r.bytes
+              << std::setw(12) << r.time.median_seconds * 1e6 << std::setw(12) << r.time.p99_seconds * 1e6
+              << std::setw(10) << r.gib_per_second() << '\n';
+    records.push_back(r);
+  }
+};
+
+// usage: accelerator_views [max size in MiB (1024)] [max number of views (4)] [output prefix (bandwidth)]
+// writes <prefix>.csv and <prefix>.json
+int main(int argc, char* argv[]){
+  float tm;
+  {
+    SystemTimer timer(tm);
+    std::size_t max_bytes = (argc > 1 ? std::atoi(argv[1]) : 1024) * MiB;
+    std::size_t max_views = argc > 2 ? std::atoi(argv[2]) : 4;
+    std::string prefix = argc > 3 ? argv[3] : "bandwidth";
+    std::size_t max_size = max_bytes / sizeof(double);
+
+    auto devices = get_devices();
+    if(devices.empty()){
+      std::cerr << "No GPU devices found, exiting.\n";
+      return 0;
+    }
+    auto acc1 = devices.front();
+    auto acc2 = devices.back(); // if there's only one GPU, front and back are the same device.
+    std::vector<hc::accelerator_view> views;
+    for(std::size_t v = 0; v != max_views; ++v) views.push_back(acc1.create_view());
+    auto& view = views.front();
+
+    pinned_vector<double> pinned(max_size, 3.1415927); // host pinned memory, alloc-ed with am_alloc
+    std::vector<double> pageable(max_size, 3.1415927);
+    auto device_ptr1 = static_cast<double*>(hc::am_alloc(max_bytes, acc1, 0));
+    double* device_ptr2 = nullptr;
+    if(devices.size() > 1){
+      device_ptr2 = static_cast<double*>(hc::am_alloc(max_bytes, acc2, 0));
+      if(hc::am_map_to_peers(device_ptr2, 1, &acc1) != AM_SUCCESS){
+        std::cerr << "Mapping device 2 memory to device 1 failed, skipping D2D.\n";
+        hc::am_free(device_ptr2);
+        device_ptr2 = nullptr;
+      }
+    }
+
+    std::cerr << "  op  memory" << std::setw(40) << "api" << std::setw(3) << "v" << std::setw(12) << "bytes"
+              << std::setw(12) << "median_us" << std::setw(12) << "p99_us" << std::setw(10) << "GiB/s\n";
+    benchmark b;
+    for(std::size_t bytes = 4 * KiB; bytes <= max_bytes; bytes *= 2){
+      std::size_t size = bytes / sizeof(double);
+      auto device_data = hc::array<double, 1>(extent<1>(size), view, device_ptr1);
+
+      b.run("H2D", "pinned", "view.copy_async(ptr, ptr, bytes)", 1, bytes,
+            [&]{ view.copy_async(pinned.data(), device_ptr1, bytes).wait(); });
+      b.run("D2H", "pinned", "view.copy_async(ptr, ptr, bytes)", 1, bytes,
+            [&]{ view.copy_async(device_ptr1, pinned.data(), bytes).wait(); });
+      b.run("H2D", "pinned", "copy_async(data(), array)", 1, bytes,
+            [&]{ hc::copy_async(pinned.data(), device_data).wait(); });
+      b.run("H2D", "pinned", "copy_async(begin(), array)", 1, bytes,
+            [&]{ hc::copy_async(pinned.begin(), device_data).wait(); });
+      b.run("H2D", "pinned", "av::copy_async(begin(), array)", 1, bytes,
+            [&]{ av::copy_async(pinned.begin(), device_data).wait(); });
+      b.run("D2H", "pinned", "copy_async(array, data())", 1, bytes,
+            [&]{ hc::copy_async(device_data, pinned.data()).wait(); });
+      b.run("D2H", "pinned", "copy_async(array, begin())", 1, bytes,
+            [&]{ hc::copy_async(device_data, pinned.begin()).wait(); });
+      b.run("D2H", "pinned", "av::copy_async(array, begin())", 1, bytes,
+            [&]{ av::copy_async(device_data, pinned.begin()).wait(); });
+      b.run("H2D", "pageable", "copy_async(data(), array)", 1, bytes,
+            [&]{ hc::copy_async(pageable.data(), device_data).wait(); });
+      b.run("H2D", "pageable", "copy_async(begin(), array)", 1, bytes,
+            [&]{ hc::copy_async(pageable.begin(), device_data).wait(); });
+      b.run("D2H", "pageable", "copy_async(array, data())", 1, bytes,
+            [&]{ hc::copy_async(device_data, pageable.data()).wait(); });
+      b.run("D2H", "pageable", "copy_async(array, begin())", 1, bytes,
+            [&]{ hc::copy_async(device_data, pageable.begin()).wait(); });
+      if(device_ptr2){
+        b.run("D2D", "", "view.copy_async(ptr, ptr, bytes)", 1, bytes,
+              [&]{ view.copy_async(device_ptr1, device_ptr2, bytes).wait(); });
+      }
+
+      // the same bytes, split over several views that copy concurrently
+      for(std::size_t v = 2; v <= max_views && bytes / v >= 4 * KiB; ++v){
+        b.run("H2D", "pinned", "view.copy_async(ptr, ptr, bytes)", v, bytes, [&]{
+            std::vector<completion_future> futures;
+            std::size_t part = size / v;
+            for(std::size_t i = 0; i != v; ++i){
+              std::size_t count = i + 1 == v ? size - i * part : part;
+              futures.push_back(views[i].copy_async(pinned.data() + i * part, device_ptr1 + i * part,
+                                                    count * sizeof(double)));
+            }
+            for(auto& f: futures) f.wait();
+          });
+      }
+    }
+
+    std::ofstream csv(prefix + ".csv");
+    av::write_csv(csv, b.records);
+    std::ofstream json(prefix + ".json");
+    av::write_json(json, b.records);
+    std::cerr << b.records.size() << " results written to " << prefix << ".csv and " << prefix << ".json\n";
+
+    hc::am_free(device_ptr1);
+    if(device_ptr2) hc::am_free(device_ptr2);
+  }
+  std::cerr << "total time: " << tm << " seconds\n";
+}
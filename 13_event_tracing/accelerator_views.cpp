@@ -0,0 +1,89 @@
+#include <hc.hpp>
+#include <hc_am.hpp>
+#include <pinned_vector.hpp>
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <numeric>
+#include <cstdlib>
+#include <string>
+#include "scoped_timers.hpp"
+#include "trace.hpp"
+
+using namespace hc;
+
+constexpr size_t operator"" _MiB(unsigned long long MiB){ return MiB * 1024 * 1024 / sizeof(double); }
+constexpr size_t operator"" _GiB(unsigned long long GiB){ return GiB * 1024 * 1024 * 1024 / sizeof(double); }
+
+// recursive template for doing n floating point operations
+template<int n> double flops(double arg) [[hc]] { return arg + arg * flops<n-2>(arg); }
+template<> double flops<1>(double arg) [[hc]] { return arg + arg; }
+template<> double flops<0>(double arg) [[hc]] { return arg; }
+
+
+hc::completion_future busywork(hc::accelerator_view& view, double* device_data, std::size_t size, std::size_t reps,
+                               double threshold, double final_value, const char* label)
+{
+  return av::trace::parallel_for_each(view, extent<1>(size),
+                                      [=](hc::index<1> idx)[[hc]]
+                                      {
+                                        for(std::size_t rep = 0; rep != reps; ++rep){
+                                          device_data[idx[0]] = flops<1000>(device_data[idx[0]]);
+                                        }
+                                        if(device_data[idx[0]] >= threshold){
+                                          device_data[idx[0]] = final_value;
+                                        }
+                                      }, label);
+}
+
+// usage: accelerator_views [size in MiB (1024)] [output file (trace.json)]
+// open the output in chrome://tracing or ui.perfetto.dev
+int main(int argc, char* argv[]){
+  float tm;
+  {
+    SystemTimer timer(tm);
+    std::size_t size = (argc > 1 ? std::atoi(argv[1]) : 1024) * 1_MiB;
+    std::string output = argc > 2 ? argv[2] : "trace.json";
+    if(!av::trace::enabled){
+      std::cerr << "Built with TRACE=0, the trace will be empty.\n";
+    }
+    hc::accelerator acc;
+    auto acc_view1 = acc.create_view();
+    auto acc_view2 = acc.create_view();
+
+    pinned_vector<double> host_data1(size); // host pinned memory, alloc-ed with am_alloc, zero-initialized
+    pinned_vector<double> host_data2(size);
+    auto device_ptr1 = static_cast<double*>(hc::am_alloc(size * sizeof(double), acc, 0));
+    auto device_ptr2 = static_cast<double*>(hc::am_alloc(size * sizeof(double), acc, 0));
+
+    // first the two views one after the other, as with acc_view1.wait() uncommented in example 04,
+    // then both at once; the timeline shows whether the second round really overlaps
+    for(bool overlap: {false, true}){
+      av::trace::copy_async(acc_view1, host_data1.data(), device_ptr1, size * sizeof(double), "H2D 1");
+      busywork(acc_view1, device_ptr1, size, 1, 0.0, 1.0, "busywork 1");
+      av::trace::copy_async(acc_view1, device_ptr1, host_data1.data(), size * sizeof(double), "D2H 1");
+      if(!overlap) acc_view1.wait();
+
+      av::trace::copy_async(acc_view2, host_data2.data(), device_ptr2, size * sizeof(double), "H2D 2");
+      busywork(acc_view2, device_ptr2, size, 1, 0.0, 1.0, "busywork 2");
+      av::trace::copy_async(acc_view2, device_ptr2, host_data2.data(), size * sizeof(double), "D2H 2");
+
+      acc_view1.wait();
+      acc_view2.wait();
+      auto average1 = std::accumulate(host_data1.begin(), host_data1.end(), 0.0) / size;
+      auto average2 = std::accumulate(host_data2.begin(), host_data2.end(), 0.0) / size;
+      std::cerr << (overlap ? "overlapped" : "sequential") << ": average1: " << average1
+                << ", average2: " << average2 << '\n';
+      std::fill(host_data1.begin(), host_data1.end(), 0.0);
+      std::fill(host_data2.begin(), host_data2.end(), 0.0);
+    }
+
+    std::ofstream out(output);
+    av::trace::write_chrome_trace(out);
+    std::cerr << "trace written to " << output << ", " << av::trace::dropped_events() << " events dropped\n";
+
+    am_free(device_ptr1);
+    am_free(device_ptr2);
+  }
+  std::cerr << "total time: " << tm << " seconds\n";
+}
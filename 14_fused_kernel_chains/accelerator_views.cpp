@@ -0,0 +1,70 @@
+#include <hc.hpp>
+#include <hc_am.hpp>
+#include <pinned_vector.hpp>
+#include <iostream>
+#include <algorithm>
+#include <numeric>
+#include <cstdlib>
+#include "scoped_timers.hpp"
+#include "benchmark.hpp"
+#include "fused_kernel.hpp"
+
+using namespace hc;
+
+constexpr size_t operator"" _MiB(unsigned long long MiB){ return MiB * 1024 * 1024 / sizeof(double); }
+constexpr size_t operator"" _GiB(unsigned long long GiB){ return GiB * 1024 * 1024 * 1024 / sizeof(double); }
+
+// recursive template for doing n floating point operations
+template<int n> double flops(double arg) [[hc]] { return arg + arg * flops<n-2>(arg); }
+template<> double flops<1>(double arg) [[hc]] { return arg + arg; }
+template<> double flops<0>(double arg) [[hc]] { return arg; }
+
+// usage: accelerator_views [size in MiB (1024)] [timed repetitions (5)]
+int main(int argc, char* argv[]){
+  float tm;
+  {
+    SystemTimer timer(tm);
+    std::size_t size = (argc > 1 ? std::atoi(argv[1]) : 1024) * 1_MiB;
+    std::size_t reps = argc > 2 ? std::atoi(argv[2]) : 5;
+    hc::accelerator acc;
+    auto acc_view = acc.create_view();
+
+    pinned_vector<double> host_data(size, 0.75); // host pinned memory, alloc-ed with am_alloc
+    auto device_ptr = static_cast<double*>(hc::am_alloc(size * sizeof(double), acc, 0));
+
+    // a few cheap steps, so the unfused version is bound by memory traffic
+    auto halve = [](double x)[[hc]]{ return x * 0.5 + 0.25; };
+    auto chain = av::fuse([](double x)[[hc]]{ return flops<8>(x); },
+                          av::clamp_above(4.0, 0.5),
+                          halve,
+                          av::repeat<3>(halve),
+                          [](double x)[[hc]]{ return x * x; },
+                          [](double x)[[hc]]{ return 1 - x; });
+    constexpr auto stages = decltype(chain)::stages;
+
+    acc_view.copy(host_data.data(), device_ptr, size * sizeof(double));
+    av::for_each_unfused(acc_view, device_ptr, size, chain);
+    acc_view.copy(device_ptr, host_data.data(), size * sizeof(double));
+    auto unfused_average = std::accumulate(host_data.begin(), host_data.end(), 0.0) / size;
+
+    std::fill(host_data.begin(), host_data.end(), 0.75);
+    acc_view.copy(host_data.data(), device_ptr, size * sizeof(double));
+    av::for_each_fused(acc_view, device_ptr, size, chain);
+    acc_view.copy(device_ptr, host_data.data(), size * sizeof(double));
+    auto fused_average = std::accumulate(host_data.begin(), host_data.end(), 0.0) / size;
+    std::cerr << "average unfused: " << unfused_average << ", fused: " << fused_average
+              << (unfused_average == fused_average ? " (same)\n" : " (DIFFERENT)\n");
+
+    auto GiB = 1.0 * size * sizeof(double) / (1024 * 1024 * 1024);
+    auto unfused = av::time_repeated(1, reps, [&]{ av::for_each_unfused(acc_view, device_ptr, size, chain).wait(); });
+    auto fused = av::time_repeated(1, reps, [&]{ av::for_each_fused(acc_view, device_ptr, size, chain).wait(); });
+    std::cerr << "unfused: " << stages << " kernels, " << unfused.median_seconds << " seconds, "
+              << 2 * stages * GiB / unfused.median_seconds << "GiB/s of device memory traffic\n";
+    std::cerr << "fused:   1 kernel, " << fused.median_seconds << " seconds, "
+              << 2 * GiB / fused.median_seconds << "GiB/s of device memory traffic\n";
+    std::cerr << "speedup " << unfused.median_seconds / fused.median_seconds << '\n';
+
+    am_free(device_ptr);
+  }
+  std::cerr << "total time: " << tm << " seconds\n";
+}
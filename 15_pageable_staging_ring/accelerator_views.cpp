@@ -0,0 +1,64 @@
+#include <hc.hpp>
+#include <hc_am.hpp>
+#include <pinned_vector.hpp>
+#include <iostream>
+#include <algorithm>
+#include <vector>
+#include <cstdlib>
+#include "scoped_timers.hpp"
+#include "benchmark.hpp"
+#include "staging_ring.hpp"
+
+using namespace hc;
+
+constexpr size_t operator"" _MiB(unsigned long long MiB){ return MiB * 1024 * 1024 / sizeof(double); }
+constexpr size_t operator"" _GiB(unsigned long long GiB){ return GiB * 1024 * 1024 * 1024 / sizeof(double); }
+
+void show(const char* label, const av::timing_stats& stats, std::size_t bytes){
+  std::cerr << label << ": " << stats.median_seconds << " seconds, "
+            << bytes / stats.median_seconds / (1024.0 * 1024 * 1024) << "GiB/s\n";
+}
+
+// usage: accelerator_views [size in MiB (1024)] [chunk size in KiB (1024)] [number of staging buffers (4)]
+int main(int argc, char* argv[]){
+  float tm;
+  {
+    SystemTimer timer(tm);
+    std::size_t size = (argc > 1 ? std::atoi(argv[1]) : 1024) * 1_MiB;
+    av::staging_ring::options opts;
+    opts.chunk_bytes = (argc > 2 ? std::atoi(argv[2]) : 1024) * 1024;
+    opts.buffers = argc > 3 ? std::atoi(argv[3]) : 4;
+    std::size_t bytes = size * sizeof(double);
+    hc::accelerator acc;
+    auto acc_view = acc.create_view();
+
+    std::vector<double> pageable(size, 3.1415927);
+    pinned_vector<double> pinned(size, 3.1415927); // for comparison: the whole buffer pinned
+    auto device_ptr = static_cast<double*>(hc::am_alloc(bytes, acc, 0));
+    auto device_data = hc::array<double, 1>(extent<1>(size), acc_view, device_ptr);
+    av::staging_ring ring(acc, opts);
+    std::cerr << "pinned staging memory: " << ring.pinned_bytes() / 1024 << " KiB\n";
+
+    ring.upload(pageable.data(), device_ptr, bytes);
+    std::fill(pageable.begin(), pageable.end(), 0.0);
+    ring.download(device_ptr, pageable.data(), bytes);
+    bool correct = std::all_of(pageable.begin(), pageable.end(), [](double x){ return x == 3.1415927; });
+    std::cerr << "round trip through the ring: " << (correct ? "PASSED" : "FAILED") << "\n\n";
+
+    show("H2D pinned, view.copy_async", av::time_repeated(1, 5, [&]{
+          acc_view.copy_async(pinned.data(), device_ptr, bytes).wait(); }), bytes);
+    show("H2D pageable, copy_async(data(), array)", av::time_repeated(1, 5, [&]{
+          hc::copy_async(pageable.data(), device_data).wait(); }), bytes);
+    show("H2D pageable, staging ring", av::time_repeated(1, 5, [&]{
+          ring.upload(pageable.data(), device_ptr, bytes); }), bytes);
+    show("D2H pinned, view.copy_async", av::time_repeated(1, 5, [&]{
+          acc_view.copy_async(device_ptr, pinned.data(), bytes).wait(); }), bytes);
+    show("D2H pageable, copy_async(array, data())", av::time_repeated(1, 5, [&]{
+          hc::copy_async(device_data, pageable.data()).wait(); }), bytes);
+    show("D2H pageable, staging ring", av::time_repeated(1, 5, [&]{
+          ring.download(device_ptr, pageable.data(), bytes); }), bytes);
+
+    am_free(device_ptr);
+  }
+  std::cerr << "total time: " << tm << " seconds\n";
+}
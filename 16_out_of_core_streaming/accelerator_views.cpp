@@ -0,0 +1,80 @@
+#include <hc.hpp>
+#include <hc_am.hpp>
+#include <iostream>
+#include <algorithm>
+#include <numeric>
+#include <vector>
+#include <cstdlib>
+#include "scoped_timers.hpp"
+#include "device_buffer.hpp"
+#include "streaming_executor.hpp"
+
+using namespace hc;
+
+void show_stats(const char* label, const av::pipeline_stats& stats){
+  std::cerr << label << ": " << stats.chunks << " windows, " << stats.seconds << " seconds\n"
+            << "  busy: H2D " << stats.h2d_seconds << "s, kernels " << stats.kernel_seconds
+            << "s, D2H " << stats.d2h_seconds << "s, concurrency " << stats.concurrency() << '\n';
+}
+
+// usage: accelerator_views [dataset size, in multiples of the device memory (1.5)] [headroom in % (10)]
+//                          [number of windows (3)]
+// on the host backend, HC_HOST_DEVICE_MEMORY=256 keeps the dataset small
+int main(int argc, char* argv[]){
+  float tm;
+  {
+    SystemTimer timer(tm);
+    double factor = argc > 1 ? std::atof(argv[1]) : 1.5;
+    av::streaming_executor<double>::options opts;
+    opts.headroom = (argc > 2 ? std::atoi(argv[2]) : 10) / 100.0;
+    opts.num_windows = argc > 3 ? std::atoi(argv[3]) : 3;
+    hc::accelerator acc;
+
+    std::size_t device_bytes = acc.get_dedicated_memory() * 1024;
+    std::size_t size = static_cast<std::size_t>(device_bytes * factor) / sizeof(double);
+    std::cerr << "device memory " << device_bytes / (1024 * 1024) << " MiB, dataset "
+              << size * sizeof(double) / (1024 * 1024) << " MiB\n";
+
+    auto whole = hc::am_alloc(size * sizeof(double), acc, 0);
+    std::cerr << "am_alloc of the whole dataset on the device: " << (whole ? "succeeded" : "failed") << '\n';
+    if(whole) hc::am_free(whole);
+
+    std::vector<double> host_data(size); // ordinary pageable memory
+    std::iota(host_data.begin(), host_data.end(), 0.0);
+
+    av::streaming_executor<double> executor(acc, opts);
+    std::cerr << "window size " << executor.window_elements() * sizeof(double) / (1024 * 1024) << " MiB x "
+              << executor.num_windows() << '\n';
+
+    // elementwise pass: x -> 2x + 1
+    auto stats = executor.for_each(host_data.data(), size, [](double& x, std::size_t)[[hc]]{ x = 2 * x + 1; });
+    show_stats("elementwise", stats);
+    bool correct = true;
+    for(std::size_t i = 0; i != size; ++i) correct = correct && host_data[i] == 2.0 * i + 1;
+    std::cerr << "elementwise results: " << (correct ? "PASSED" : "FAILED") << '\n';
+
+    // read-only pass: per-window partial sums on the device, only those come back
+    constexpr std::size_t lanes = 1024;
+    std::size_t num_windows = (size + executor.window_elements() - 1) / executor.window_elements();
+    av::device_buffer<double> partials(acc, num_windows * lanes);
+    double* partial_ptr = partials.accelerator_pointer();
+    std::size_t window_elements = executor.window_elements();
+    stats = executor.for_each_window(host_data.data(), nullptr, size,
+                                     [=](hc::accelerator_view& view, double* window, std::size_t elements,
+                                         std::size_t offset){
+        double* out = partial_ptr + offset / window_elements * lanes;
+        return hc::parallel_for_each(view, extent<1>(lanes), [=](hc::index<1> idx)[[hc]]{
+            double sum = 0;
+            for(std::size_t i = idx[0]; i < elements; i += lanes) sum += window[i];
+            out[idx[0]] = sum;
+          });
+      });
+    show_stats("reduction", stats);
+    std::vector<double> host_partials(num_windows * lanes);
+    hc::array<double, 1> partial_array(extent<1>(num_windows * lanes), acc.get_default_view(), partial_ptr);
+    hc::copy(partial_array, host_partials.data());
+    auto average = std::accumulate(host_partials.begin(), host_partials.end(), 0.0) / size;
+    std::cerr << "average: " << average << " (expected " << 1.0 * size << ")\n";
+  }
+  std::cerr << "total time: " << tm << " seconds\n";
+}
@@ -0,0 +1,86 @@
+#include <hc.hpp>
+#include <hc_am.hpp>
+#include <pinned_vector.hpp>
+#include <iostream>
+#include <algorithm>
+#include <numeric>
+#include <cstdlib>
+#include "scoped_timers.hpp"
+#include "benchmark.hpp"
+#include "device_buffer.hpp"
+#include "reduction.hpp"
+
+using namespace hc;
+
+constexpr size_t operator"" _MiB(unsigned long long MiB){ return MiB * 1024 * 1024 / sizeof(double); }
+constexpr size_t operator"" _GiB(unsigned long long GiB){ return GiB * 1024 * 1024 * 1024 / sizeof(double); }
+
+std::vector<hc::accelerator> get_devices(){
+  std::vector<hc::accelerator> devices;
+  for(const auto& acc: accelerator::get_all()){
+    if(acc.get_device_path() != L"cpu"){
+      devices.push_back(acc);
+    }
+  }
+  return devices;
+}
+
+// custom operation: the value furthest from zero
+struct max_abs {
+  double operator()(double a, double b) const [[hc]] { return (a < 0 ? -a : a) < (b < 0 ? -b : b) ? b : a; }
+};
+
+// usage: accelerator_views [size in MiB (1024)]
+int main(int argc, char* argv[]){
+  float tm;
+  {
+    SystemTimer timer(tm);
+    std::size_t size = (argc > 1 ? std::atoi(argv[1]) : 1024) * 1_MiB;
+    auto devices = get_devices();
+    auto acc = devices.front();
+    auto acc_view = acc.create_view();
+
+    pinned_vector<double> host_data(size); // host pinned memory, alloc-ed with am_alloc
+    for(std::size_t i = 0; i != size; ++i) host_data[i] = i % 1000 - 499.5;
+    av::device_buffer<double> device_data(acc, size);
+    acc_view.copy(host_data.data(), device_data.accelerator_pointer(), size * sizeof(double));
+    std::cerr << "expected: mean close to 0, min -499.5, max 499.5, max abs -499.5\n\n";
+
+    double result = 0;
+    auto show = [&](const char* label, const av::timing_stats& stats){
+      std::cerr << label << ": " << result << ", " << stats.median_seconds << " seconds\n";
+    };
+    show("D2H + std::accumulate mean", av::time_repeated(1, 3, [&]{
+          acc_view.copy(device_data.accelerator_pointer(), host_data.data(), size * sizeof(double));
+          result = std::accumulate(host_data.begin(), host_data.end(), 0.0) / size;
+        }));
+    show("D2H + av::host_reduce mean", av::time_repeated(1, 3, [&]{
+          acc_view.copy(device_data.accelerator_pointer(), host_data.data(), size * sizeof(double));
+          result = av::host_reduce(host_data.data(), size, 0.0, av::plus<double>()) / size;
+        }));
+    show("av::reduce_mean", av::time_repeated(1, 3, [&]{
+          result = av::reduce_mean(acc_view, device_data.accelerator_pointer(), size); }));
+    show("av::reduce_min", av::time_repeated(1, 3, [&]{
+          result = av::reduce_min(acc_view, device_data.accelerator_pointer(), size); }));
+    show("av::reduce_max", av::time_repeated(1, 3, [&]{
+          result = av::reduce_max(acc_view, device_data.accelerator_pointer(), size); }));
+    show("av::reduce with a custom op (max abs)", av::time_repeated(1, 3, [&]{
+          result = av::reduce(acc_view, device_data.accelerator_pointer(), size, 0.0, max_abs()); }));
+
+    // the same data spread over all GPUs, one slice each
+    std::vector<av::device_buffer<double>> parts;
+    std::vector<av::device_slice<double>> slices;
+    for(std::size_t d = 0; d != devices.size(); ++d){
+      std::size_t begin = size * d / devices.size();
+      std::size_t count = size * (d + 1) / devices.size() - begin;
+      parts.emplace_back(devices[d], count);
+      auto view = devices[d].create_view();
+      view.copy(host_data.data() + begin, parts.back().accelerator_pointer(), count * sizeof(double));
+      slices.push_back(av::device_slice<double>{view, parts.back().accelerator_pointer(), count});
+    }
+    show("av::reduce over all devices, mean", av::time_repeated(1, 3, [&]{
+          result = av::reduce(slices, 0.0, av::plus<double>()) / size; }));
+    std::cerr << "(" << devices.size() << " devices)\n";
+  }
+  std::cerr << "total time: " << tm << " seconds\n";
+}
@@ -0,0 +1,47 @@
+#include <hc.hpp>
+#include <hc_am.hpp>
+#include <iostream>
+#include <cstdio>
+#include <string>
+#include "scoped_timers.hpp"
+#include "topology.hpp"
+
+using namespace hc;
+
+// usage: accelerator_views [--reprobe]
+// the cache file is $AV_TOPOLOGY_CACHE, or ~/.cache/accelerator_views_topology.txt
+int main(int argc, char* argv[]){
+  float tm;
+  {
+    SystemTimer timer(tm);
+    av::topology::options opts;
+    if(argc > 1 && std::string(argv[1]) == "--reprobe") std::remove(opts.cache_path.c_str());
+
+    float discovery;
+    av::topology topo;
+    {
+      SystemTimer timer(discovery);
+      topo = av::topology::get(opts);
+    }
+    std::cerr << "topology " << (topo.from_cache() ? "loaded from " : "probed and saved to ") << opts.cache_path
+              << " in " << discovery << " seconds\n\n";
+    if(topo.num_devices() == 0){
+      std::cerr << "No GPU devices found, exiting.\n";
+      return 0;
+    }
+    topo.print(std::cerr);
+
+    // the kind of questions a scheduler or copy engine asks
+    std::cerr << '\n';
+    for(std::size_t dev = 0; dev != topo.num_devices(); ++dev){
+      auto peer = topo.best_peer(dev);
+      std::cerr << "device " << dev << ": stage host buffers on NUMA node " << topo.closest_numa_node(dev);
+      if(peer != dev){
+        std::cerr << ", fastest peer is device " << peer << " (" << topo.peer(dev, peer).gib_per_second << " GiB/s"
+                  << (topo.shares_link(dev, peer) ? ", shared link" : "") << ")";
+      }
+      std::cerr << '\n';
+    }
+  }
+  std::cerr << "total time: " << tm << " seconds\n";
+}
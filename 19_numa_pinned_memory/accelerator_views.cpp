@@ -0,0 +1,75 @@
+#include <hc.hpp>
+#include <hc_am.hpp>
+#include <pinned_vector.hpp>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include "scoped_timers.hpp"
+#include "benchmark.hpp"
+#include "device_buffer.hpp"
+#include "numa.hpp"
+#include "numa_pinned.hpp"
+#include "topology.hpp"
+
+using namespace hc;
+
+constexpr std::size_t operator "" _MiB(unsigned long long n){ return n * 1024 * 1024; }
+
+std::vector<hc::accelerator> get_devices(){
+  std::vector<hc::accelerator> devices;
+  for(const auto& acc: accelerator::get_all()){
+    if(acc.get_device_path() != L"cpu"){
+      devices.push_back(acc);
+    }
+  }
+  return devices;
+}
+
+// H2D bandwidth in GiB/s, from host (pinned memory of size bytes) to dst, on view
+double h2d_bandwidth(accelerator_view& view, const char* host, char* dst, std::size_t bytes, std::size_t reps){
+  auto stats = av::time_repeated(2, reps, [&]{ view.copy_async(host, dst, bytes).wait(); });
+  return bytes / stats.median_seconds / (1024.0 * 1024 * 1024);
+}
+
+// usage: accelerator_views [MiB per buffer] [repetitions]
+int main(int argc, char* argv[]){
+  float tm;
+  {
+    SystemTimer timer(tm);
+    std::size_t bytes = (argc > 1 ? std::atoi(argv[1]) : 256) * 1_MiB;
+    std::size_t reps = argc > 2 ? std::atoi(argv[2]) : 10;
+
+    auto devices = get_devices();
+    if(devices.empty()){
+      std::cerr << "No GPU devices found, exiting.\n";
+      return 0;
+    }
+    auto topo = av::topology::get();
+    auto nodes = av::numa::online_nodes();
+
+    for(std::size_t d = 0; d != devices.size(); ++d){
+      auto& acc = devices[d];
+      int near = topo.closest_numa_node(acc);
+      std::cerr << "\ndevice " << d << ", closest NUMA node " << near << '\n';
+      auto view = acc.create_view();
+      av::device_buffer<char> dst(acc, bytes);
+
+      {
+        // wherever first touch and the driver put it
+        hc::pinned_vector<char> plain(bytes, 1, hc::am_allocator<char>(acc));
+        std::cerr << "  pinned_vector:              "
+                  << h2d_bandwidth(view, plain.data(), dst.accelerator_pointer(), bytes, reps) << " GiB/s\n";
+      }
+      for(int node: nodes){
+        // submit from the node's cores as well, as a real feeder thread would
+        av::numa::scoped_binding binding(node);
+        av::numa_pinned_vector<char> local(bytes, 1, av::numa_pinned_allocator<char>(node, acc));
+        std::cerr << "  numa_pinned_vector, node " << node << (node == near ? " (closest): " : ":           ")
+                  << h2d_bandwidth(view, local.data(), dst.accelerator_pointer(), bytes, reps) << " GiB/s\n";
+      }
+    }
+    if(nodes.size() == 1) std::cerr << "\nsingle NUMA node: all placements are the same here\n";
+  }
+  std::cerr << "total time: " << tm << " seconds\n";
+}
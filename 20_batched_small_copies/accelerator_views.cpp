@@ -0,0 +1,88 @@
+#include <hc.hpp>
+#include <hc_am.hpp>
+#include <pinned_vector.hpp>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+#include "scoped_timers.hpp"
+#include "batched_copy.hpp"
+#include "benchmark.hpp"
+#include "device_buffer.hpp"
+
+using namespace hc;
+
+constexpr std::size_t operator "" _KiB(unsigned long long n){ return n * 1024; }
+
+std::vector<hc::accelerator> get_devices(){
+  std::vector<hc::accelerator> devices;
+  for(const auto& acc: accelerator::get_all()){
+    if(acc.get_device_path() != L"cpu"){
+      devices.push_back(acc);
+    }
+  }
+  return devices;
+}
+
+void report(const std::string& name, const av::timing_stats& stats, std::size_t copies, std::size_t bytes){
+  std::cerr << "  " << name << ": " << stats.median_seconds * 1e6 << " us per batch (p99 " << stats.p99_seconds * 1e6
+            << "), " << stats.median_seconds * 1e9 / copies << " ns per copy, "
+            << bytes / stats.median_seconds / (1024.0 * 1024 * 1024) << " GiB/s\n";
+}
+
+// usage: accelerator_views [copies per batch (4096)] [KiB per copy (4)] [repetitions (20)]
+int main(int argc, char* argv[]){
+  float tm;
+  {
+    SystemTimer timer(tm);
+    std::size_t copies = argc > 1 ? std::atoi(argv[1]) : 4096;
+    std::size_t copy_bytes = (argc > 2 ? std::atoi(argv[2]) : 4) * 1_KiB;
+    std::size_t reps = argc > 3 ? std::atoi(argv[3]) : 20;
+    std::size_t bytes = copies * copy_bytes;
+
+    auto devices = get_devices();
+    if(devices.empty()){
+      std::cerr << "No GPU devices found, exiting.\n";
+      return 0;
+    }
+    auto acc = devices.front();
+    auto view = acc.create_view();
+
+    // the batch updates every other slot of a device table twice its size, so nothing coalesces
+    hc::pinned_vector<char> host(bytes, 0, hc::am_allocator<char>(acc));
+    for(std::size_t i = 0; i != bytes; ++i) host[i] = static_cast<char>(i * 7 + i / copy_bytes);
+    av::device_buffer<char> table(acc, 2 * bytes);
+    std::vector<av::copy_region> scattered, adjacent;
+    for(std::size_t c = 0; c != copies; ++c){
+      scattered.push_back({host.data() + c * copy_bytes, table.accelerator_pointer() + 2 * c * copy_bytes, copy_bytes});
+      adjacent.push_back({host.data() + c * copy_bytes, table.accelerator_pointer() + c * copy_bytes, copy_bytes});
+    }
+
+    std::cerr << copies << " copies of " << copy_bytes << " bytes per batch\n";
+    report("individual copy_async", av::time_repeated(2, reps, [&]{
+        hc::completion_future last;
+        for(auto& r: scattered) last = view.copy_async(r.src, r.dst, r.bytes);
+        last.wait();
+      }), copies, bytes);
+    report("copy_batch_async, scattered", av::time_repeated(2, reps, [&]{
+        av::copy_batch_async(view, scattered).wait();
+      }), copies, bytes);
+    report("copy_batch_async, adjacent ", av::time_repeated(2, reps, [&]{
+        av::copy_batch_async(view, adjacent).wait();
+      }), copies, bytes);
+
+    // check the scattered layout, on a cleared table, since the timed runs already filled it
+    std::vector<char> back(2 * bytes, 0);
+    hc::array<char, 1> whole(hc::extent<1>(2 * bytes), view, table.accelerator_pointer());
+    hc::copy(back.data(), whole);
+    av::copy_batch_async(view, scattered).wait();
+    hc::copy(whole, back.data());
+    std::size_t wrong = 0;
+    for(std::size_t c = 0; c != copies; ++c){
+      if(std::memcmp(back.data() + 2 * c * copy_bytes, host.data() + c * copy_bytes, copy_bytes) != 0) ++wrong;
+    }
+    std::cerr << (wrong ? "FAILED: " + std::to_string(wrong) + " regions differ\n" : std::string("scattered copies verified\n"));
+  }
+  std::cerr << "total time: " << tm << " seconds\n";
+}
@@ -0,0 +1,129 @@
+#include <hc.hpp>
+#include <hc_am.hpp>
+#include <iostream>
+#include <vector>
+#include <cstdlib>
+#include "scoped_timers.hpp"
+#include "async_task.hpp"
+#include "device_buffer.hpp"
+
+using namespace hc;
+
+constexpr std::size_t operator "" _KiB(unsigned long long n){ return n * 1024; }
+
+std::vector<hc::accelerator> get_devices(){
+  std::vector<hc::accelerator> devices;
+  for(const auto& acc: accelerator::get_all()){
+    if(acc.get_device_path() != L"cpu"){
+      devices.push_back(acc);
+    }
+  }
+  return devices;
+}
+
+// what a request-serving frontend keeps per in-flight request
+struct request {
+  accelerator_view view;
+  float* input;   // pinned
+  float* output;  // pinned
+  av::device_buffer<float> data;
+  std::size_t size;
+
+  request(accelerator& acc, std::size_t size)
+    : view(acc.create_view()),
+      input(static_cast<float*>(am_alloc(size * sizeof(float), acc, amHostPinned))),
+      output(static_cast<float*>(am_alloc(size * sizeof(float), acc, amHostPinned))),
+      data(acc, size), size(size)
+  {
+    for(std::size_t i = 0; i != size; ++i) input[i] = 1.0f * (i % 100);
+  }
+
+  ~request(){
+    am_free(input);
+    am_free(output);
+  }
+
+  completion_future upload(){ return view.copy_async(input, data.accelerator_pointer(), size * sizeof(float)); }
+  completion_future download(){ return view.copy_async(data.accelerator_pointer(), output, size * sizeof(float)); }
+  completion_future kernel(float scale){
+    float* d = data.accelerator_pointer();
+    return parallel_for_each(view, extent<1>(size), [=](hc::index<1> idx)[[hc]]{
+        d[idx[0]] = d[idx[0]] * scale + 1.0f;
+      });
+  }
+};
+
+// upload, two kernels, download, and a check on the host, without ever blocking a thread
+av::task<bool> serve(request& r){
+  co_await r.upload();
+  co_await r.kernel(2.0f);
+  co_await r.kernel(0.5f);
+  co_await r.download();
+  for(std::size_t i = 0; i != r.size; ++i){
+    if(r.output[i] != 1.0f * (i % 100) + 1.5f) co_return false;
+  }
+  co_return true;
+}
+
+// the same with a thread parked in wait() on every step
+bool serve_blocking(request& r){
+  r.upload().wait();
+  r.kernel(2.0f).wait();
+  r.kernel(0.5f).wait();
+  r.download().wait();
+  for(std::size_t i = 0; i != r.size; ++i){
+    if(r.output[i] != 1.0f * (i % 100) + 1.5f) return false;
+  }
+  return true;
+}
+
+// usage: accelerator_views [concurrent requests (32)] [KiB per request (256)]
+int main(int argc, char* argv[]){
+  float tm;
+  {
+    SystemTimer timer(tm);
+    std::size_t num_requests = argc > 1 ? std::atoi(argv[1]) : 32;
+    std::size_t size = (argc > 2 ? std::atoi(argv[2]) : 256) * 1_KiB / sizeof(float);
+
+    auto devices = get_devices();
+    if(devices.empty()){
+      std::cerr << "No GPU devices found, exiting.\n";
+      return 0;
+    }
+    std::vector<std::unique_ptr<request>> requests;
+    for(std::size_t i = 0; i != num_requests; ++i){
+      requests.emplace_back(new request(devices[i % devices.size()], size));
+    }
+
+    std::size_t failed = 0;
+    float blocking;
+    {
+      SystemTimer timer(blocking);
+      for(auto& r: requests) failed += !serve_blocking(*r);
+    }
+    std::cerr << num_requests << " requests, one after the other, blocking: " << blocking << " seconds\n";
+
+    float coroutines;
+    {
+      SystemTimer timer(coroutines);
+      std::vector<av::task<bool>> tasks;
+      for(auto& r: requests) tasks.push_back(serve(*r));
+      for(auto& t: tasks) failed += !t.get();
+    }
+    std::cerr << num_requests << " requests, concurrently, as coroutines on one reactor thread: " << coroutines
+              << " seconds\n";
+
+    // continuation style: the kernel is launched by the reactor once the upload is done
+    auto& r = *requests.front();
+    // (which is also when the download has to be submitted, or it would overtake the kernel)
+    auto chained = av::then(r.upload(), [&]{
+        r.kernel(3.0f);
+        return r.download();
+      });
+    chained.get();
+    failed += !av::then(r.download(), [&]{ return r.output[1] == 4.0f; }).get();
+
+    std::cerr << (failed ? "FAILED\n" : "results verified\n");
+  }
+  std::cerr << "total time: " << tm << " seconds\n";
+}
@@ -0,0 +1,113 @@
+#include <hc.hpp>
+#include <hc_am.hpp>
+#include <pinned_vector.hpp>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <cstdlib>
+#include "scoped_timers.hpp"
+#include "device_buffer.hpp"
+#include "view_pool.hpp"
+
+using namespace hc;
+
+constexpr std::size_t operator "" _KiB(unsigned long long n){ return n * 1024; }
+
+template<int n> double flops(double arg) [[hc]] { return arg + arg * flops<n-2>(arg); }
+template<> double flops<1>(double arg) [[hc]] { return arg + arg; }
+template<> double flops<0>(double arg) [[hc]] { return arg; }
+
+std::vector<hc::accelerator> get_devices(){
+  std::vector<hc::accelerator> devices;
+  for(const auto& acc: accelerator::get_all()){
+    if(acc.get_device_path() != L"cpu"){
+      devices.push_back(acc);
+    }
+  }
+  return devices;
+}
+
+// Runs chunks through the pool: upload, a kernel of compute_rounds rounds, download. At most
+// in_flight chunks are outstanding, as with any producer that has to recycle its buffers.
+double run(av::view_pool& pool, pinned_vector<double>& host, std::vector<av::device_buffer<double>>& slots,
+           std::size_t chunk, std::size_t chunks, int compute_rounds, bool verbose){
+  std::deque<completion_future> in_flight;
+  std::size_t epochs = pool.stats().epochs;
+  float seconds;
+  {
+    SystemTimer timer(seconds);
+    for(std::size_t c = 0; c != chunks; ++c){
+      if(in_flight.size() == slots.size()){
+        in_flight.front().wait();
+        in_flight.pop_front();
+      }
+      double* h = host.data() + (c % slots.size()) * chunk;
+      double* d = slots[c % slots.size()].accelerator_pointer();
+      in_flight.push_back(pool.submit([=](accelerator_view& view){
+            view.copy_async(h, d, chunk * sizeof(double));
+            parallel_for_each(view, extent<1>(chunk), [=](hc::index<1> idx)[[hc]]{
+                double x = d[idx[0]];
+                for(int r = 0; r != compute_rounds; ++r) x = flops<16>(x) * 1e-6;
+                d[idx[0]] = x;
+              });
+            return view.copy_async(d, h, chunk * sizeof(double));
+          }));
+      auto stats = pool.stats();
+      if(verbose && stats.epochs != epochs){
+        epochs = stats.epochs;
+        std::cerr << "    epoch " << epochs << ": " << stats.ops_per_second << " chunks/s, occupancy "
+                  << stats.occupancy << ", overlap " << stats.overlap << " -> " << stats.views << " views\n";
+      }
+    }
+    for(auto& f: in_flight) f.wait();
+  }
+  return chunks / seconds;
+}
+
+// usage: accelerator_views [KiB per chunk (256)] [chunks per phase (2048)] [max views (8)]
+int main(int argc, char* argv[]){
+  float tm;
+  {
+    SystemTimer timer(tm);
+    std::size_t chunk = (argc > 1 ? std::atoi(argv[1]) : 256) * 1_KiB / sizeof(double);
+    std::size_t chunks = argc > 2 ? std::atoi(argv[2]) : 2048;
+    std::size_t max_views = argc > 3 ? std::atoi(argv[3]) : 8;
+
+    auto devices = get_devices();
+    if(devices.empty()){
+      std::cerr << "No GPU devices found, exiting.\n";
+      return 0;
+    }
+    auto acc = devices.front();
+    std::size_t num_slots = 2 * max_views;
+    pinned_vector<double> host(num_slots * chunk, 0.5, am_allocator<double>(acc));
+    std::vector<av::device_buffer<double>> slots;
+    for(std::size_t i = 0; i != num_slots; ++i) slots.emplace_back(acc, chunk);
+
+    struct phase { const char* name; int compute_rounds; };
+    std::vector<phase> phases = {{"copy-bound", 0}, {"compute-bound", 8}, {"copy-bound again", 0}};
+
+    av::view_pool::options opts;
+    opts.max_views = max_views;
+    opts.initial_views = 1;
+    opts.epoch_ops = 128;
+    opts.settle_epochs = 4;
+    av::view_pool adaptive(acc, opts);
+    for(auto& p: phases){
+      std::cerr << p.name << ":\n";
+      double rate = run(adaptive, host, slots, chunk, chunks, p.compute_rounds, true);
+      std::cerr << "  adaptive pool: " << rate << " chunks/s, ended with " << adaptive.size() << " views (best "
+                << adaptive.stats().best_views << ")\n";
+      for(std::size_t views: {std::size_t(1), max_views}){
+        auto fixed_opts = opts;
+        fixed_opts.adaptive = false;
+        fixed_opts.initial_views = views;
+        av::view_pool fixed(acc, fixed_opts);
+        std::cerr << "  fixed, " << views << " view" << (views == 1 ? ": " : "s: ")
+                  << run(fixed, host, slots, chunk, chunks, p.compute_rounds, false) << " chunks/s\n";
+      }
+    }
+  }
+  std::cerr << "total time: " << tm << " seconds\n";
+}
@@ -0,0 +1,105 @@
+#include <hc.hpp>
+#include <hc_am.hpp>
+#include <pinned_vector.hpp>
+#include <iostream>
+#include <memory>
+#include <numeric>
+#include <vector>
+#include <cstdlib>
+#include "scoped_timers.hpp"
+#include "device_buffer.hpp"
+#include "peer_mapper.hpp"
+
+using namespace hc;
+
+constexpr std::size_t operator "" _KiB(unsigned long long n){ return n * 1024; }
+
+std::vector<hc::accelerator> get_devices(){
+  std::vector<hc::accelerator> devices;
+  for(const auto& acc: accelerator::get_all()){
+    if(acc.get_device_path() != L"cpu"){
+      devices.push_back(acc);
+    }
+  }
+  return devices;
+}
+
+void print_stats(const char* when){
+  auto stats = av::peer_mapper::get().stats();
+  std::cerr << "  " << when << ": " << stats.lookups << " lookups, " << stats.hits << " hits, " << stats.map_calls
+            << " am_map_to_peers calls, " << stats.failures << " failures\n";
+}
+
+// usage: accelerator_views [buffers (256)] [KiB per buffer (64)]
+// needs two devices; with the host backend, run with HC_HOST_DEVICES=2
+int main(int argc, char* argv[]){
+  float tm;
+  {
+    SystemTimer timer(tm);
+    std::size_t num_buffers = argc > 1 ? std::atoi(argv[1]) : 256;
+    std::size_t size = (argc > 2 ? std::atoi(argv[2]) : 64) * 1_KiB / sizeof(double);
+
+    auto devices = get_devices();
+    if(devices.size() < 2){
+      std::cerr << "Needs two GPU devices, exiting.\n";
+      return 0;
+    }
+    auto& mapper = av::peer_mapper::get();
+    auto acc0 = devices[0];
+    auto acc1 = devices[1];
+    auto view0 = acc0.create_view();
+
+    // many buffers on device 1 that a kernel on device 0 reads: no am_map_to_peers anywhere
+    std::vector<std::unique_ptr<av::device_buffer<double>>> buffers;
+    pinned_vector<double> host(size, 2.0, am_allocator<double>(acc1));
+    std::vector<const void*> pointers;
+    for(std::size_t b = 0; b != num_buffers; ++b){
+      buffers.emplace_back(new av::device_buffer<double>(acc1, size));
+      acc1.get_default_view().copy(host.data(), buffers.back()->accelerator_pointer(), size * sizeof(double));
+      pointers.push_back(buffers.back()->accelerator_pointer());
+    }
+    av::device_buffer<double> sums(acc0, num_buffers);
+
+    for(int pass = 0; pass != 2; ++pass){
+      float seconds;
+      {
+        SystemTimer timer(seconds);
+        // first pass maps every buffer, with one call each; the second finds them all mapped
+        if(!mapper.ensure(pointers, acc0)){
+          std::cerr << "mapping failed\n";
+          return 1;
+        }
+        for(std::size_t b = 0; b != num_buffers; ++b){
+          const double* in = buffers[b]->accelerator_pointer();
+          double* out = sums.accelerator_pointer() + b;
+          std::size_t n = size;
+          parallel_for_each(view0, extent<1>(1), [=](hc::index<1>)[[hc]]{
+              double s = 0;
+              for(std::size_t i = 0; i != n; ++i) s += in[i];
+              *out = s;
+            });
+        }
+        view0.wait();
+      }
+      std::cerr << "pass " << pass << ": " << num_buffers << " cross-device kernels in " << seconds << " seconds\n";
+      print_stats(pass == 0 ? "after the first pass" : "after the second pass");
+    }
+
+    // a device-to-device copy: prepare_copy maps whatever the view's device can't reach yet
+    av::device_buffer<double> target(acc0, size);
+    mapper.prepare_copy(view0, buffers.front()->accelerator_pointer(), target.accelerator_pointer());
+    view0.copy(buffers.front()->accelerator_pointer(), target.accelerator_pointer(), size * sizeof(double));
+    print_stats("after a copy from a mapped buffer");
+
+    // a hot buffer every device uses, mapped at startup with a single call
+    av::device_buffer<double> hot(acc0, size);
+    mapper.premap(hot.accelerator_pointer(), devices);
+    print_stats("after premapping a buffer to all devices");
+
+    pinned_vector<double> results(num_buffers, 0.0, am_allocator<double>(acc0));
+    view0.copy(sums.accelerator_pointer(), results.data(), num_buffers * sizeof(double));
+    double total = std::accumulate(results.begin(), results.end(), 0.0);
+    std::cerr << "sum of all buffers: " << total << " (expected " << 2.0 * size * num_buffers << ")\n";
+  }
+  std::cerr << "total time: " << tm << " seconds\n";
+}
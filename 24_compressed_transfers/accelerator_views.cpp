@@ -0,0 +1,87 @@
+#include <hc.hpp>
+#include <hc_am.hpp>
+#include <pinned_vector.hpp>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+#include "scoped_timers.hpp"
+#include "compressed_transfer.hpp"
+#include "device_buffer.hpp"
+
+using namespace hc;
+
+constexpr std::size_t operator "" _MiB(unsigned long long n){ return n * 1024 * 1024; }
+
+std::vector<hc::accelerator> get_devices(){
+  std::vector<hc::accelerator> devices;
+  for(const auto& acc: accelerator::get_all()){
+    if(acc.get_device_path() != L"cpu"){
+      devices.push_back(acc);
+    }
+  }
+  return devices;
+}
+
+// usage: accelerator_views [size in MiB (256)]
+int main(int argc, char* argv[]){
+  float tm;
+  {
+    SystemTimer timer(tm);
+    std::size_t size = (argc > 1 ? std::atoi(argv[1]) : 256) * 1_MiB / sizeof(double);
+
+    auto devices = get_devices();
+    if(devices.empty()){
+      std::cerr << "No GPU devices found, exiting.\n";
+      return 0;
+    }
+    auto acc = devices.front();
+    auto view = acc.create_view();
+    av::device_buffer<double> device_data(acc, size);
+    av::compressed_transfer wire(acc);
+
+    // pinned copies are the baseline
+    pinned_vector<double> pinned(size, 0.0, am_allocator<double>(acc));
+    float raw_up, raw_down;
+    {
+      SystemTimer timer(raw_up);
+      view.copy(pinned.data(), device_data.accelerator_pointer(), size * sizeof(double));
+    }
+    {
+      SystemTimer timer(raw_down);
+      view.copy(device_data.accelerator_pointer(), pinned.data(), size * sizeof(double));
+    }
+    std::cerr << "pinned copy_async: H2D " << size * sizeof(double) / raw_up / (1 << 30) << " GiB/s, D2H "
+              << size * sizeof(double) / raw_down / (1 << 30) << " GiB/s\n";
+
+    struct dataset { std::string name; std::vector<double> data; };
+    std::vector<dataset> datasets(4);
+    datasets[0] = {"zeros (example 04)", std::vector<double>(size, 0.0)};
+    datasets[1] = {"constant Pi (example 05)", std::vector<double>(size, 3.1415927)};
+    datasets[2] = {"sparse, 1% non-zero", std::vector<double>(size, 0.0)};
+    datasets[3] = {"random", std::vector<double>(size)};
+    std::mt19937_64 rng(42);
+    for(std::size_t i = 0; i < size; i += 100) datasets[2].data[i] = 1.0 * rng() / rng.max();
+    for(auto& x: datasets[3].data) x = 1.0 * rng() / rng.max();
+
+    bool all_ok = true;
+    std::vector<double> back(size);
+    for(auto& d: datasets){
+      std::memset(back.data(), 0xff, size * sizeof(double));
+      auto up = wire.upload(d.data.data(), device_data.accelerator_pointer(), size * sizeof(double));
+      auto down = wire.download(device_data.accelerator_pointer(), back.data(), size * sizeof(double));
+      bool ok = std::memcmp(back.data(), d.data.data(), size * sizeof(double)) == 0;
+      all_ok &= ok;
+      std::cerr << d.name << ":\n"
+                << "  upload   " << up.gib_per_second() << " GiB/s effective, ratio " << up.ratio() << ", "
+                << up.compressed_chunks << "/" << up.chunks << " chunks compressed\n"
+                << "  download " << down.gib_per_second() << " GiB/s effective, ratio " << down.ratio() << ", "
+                << down.compressed_chunks << "/" << down.chunks << " chunks compressed"
+                << (ok ? "" : " -- MISMATCH") << "\n";
+    }
+    std::cerr << (all_ok ? "all round trips exact\n" : "FAILED\n");
+  }
+  std::cerr << "total time: " << tm << " seconds\n";
+}
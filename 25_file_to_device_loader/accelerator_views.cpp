@@ -0,0 +1,132 @@
+#include <hc.hpp>
+#include <hc_am.hpp>
+#include <pinned_vector.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "scoped_timers.hpp"
+#include "device_buffer.hpp"
+#include "file_transfer.hpp"
+
+using namespace hc;
+
+constexpr std::size_t operator "" _MiB(unsigned long long n){ return n * 1024 * 1024; }
+
+std::vector<hc::accelerator> get_devices(){
+  std::vector<hc::accelerator> devices;
+  for(const auto& acc: accelerator::get_all()){
+    if(acc.get_device_path() != L"cpu"){
+      devices.push_back(acc);
+    }
+  }
+  return devices;
+}
+
+// element i is i, so every element shows where it came from
+void write_test_file(const std::string& path, std::size_t size){
+  std::ofstream out(path, std::ios::binary);
+  std::vector<double> piece(1_MiB / sizeof(double));
+  for(std::size_t i = 0; i < size; i += piece.size()){
+    std::size_t n = std::min(piece.size(), size - i);
+    for(std::size_t j = 0; j != n; ++j) piece[j] = double(i + j);
+    out.write(reinterpret_cast<const char*>(piece.data()), n * sizeof(double));
+  }
+}
+
+// index of the first element that isn't first + its position, or size
+std::size_t first_mismatch(const double* data, std::size_t size, std::size_t first){
+  for(std::size_t i = 0; i != size; ++i){
+    if(data[i] != double(first + i)) return i;
+  }
+  return size;
+}
+
+const char* to_string(av::file_transfer::method m){
+  switch(m){
+  case av::file_transfer::method::direct: return "direct";
+  case av::file_transfer::method::buffered: return "buffered";
+  case av::file_transfer::method::mapped: return "mapped";
+  }
+  return "?";
+}
+
+// usage: accelerator_views [file (accelerator_views.dat)] [size in MiB (256)]
+// The file is created, and removed at the end.
+int main(int argc, char* argv[]){
+  float tm;
+  {
+    SystemTimer timer(tm);
+    std::string path = argc > 1 ? argv[1] : "accelerator_views.dat";
+    std::size_t size = (argc > 2 ? std::atoi(argv[2]) : 256) * 1_MiB / sizeof(double);
+    std::size_t bytes = size * sizeof(double);
+
+    auto devices = get_devices();
+    if(devices.empty()){
+      std::cerr << "No GPU devices found, exiting.\n";
+      return 0;
+    }
+    auto acc = devices.front();
+    auto view = acc.create_view();
+    av::device_buffer<double> device_data(acc, size);
+    pinned_vector<double> check(size, 0.0, am_allocator<double>(acc));
+    write_test_file(path, size);
+    bool all_ok = true;
+    auto clear_device = [&]{
+      std::fill(check.begin(), check.end(), -1.0);
+      view.copy(check.data(), device_data.accelerator_pointer(), bytes);
+    };
+
+    // the two-pass path: the whole file into pinned memory, then one copy
+    float baseline;
+    {
+      SystemTimer timer(baseline);
+      pinned_vector<double> staged(size, 0.0, am_allocator<double>(acc));
+      std::ifstream in(path, std::ios::binary);
+      in.read(reinterpret_cast<char*>(staged.data()), bytes);
+      view.copy(staged.data(), device_data.accelerator_pointer(), bytes);
+    }
+    std::cerr << "read into a pinned_vector, then copy: " << bytes / baseline / (1 << 30) << " GiB/s, "
+              << bytes / 1_MiB << " MiB pinned\n";
+
+    for(auto m: {av::file_transfer::method::direct, av::file_transfer::method::buffered,
+                 av::file_transfer::method::mapped}){
+      av::file_transfer::options opts;
+      opts.io = m;
+      av::file_transfer files(acc, opts);
+
+      // all of it, then a piece from an offset that isn't block aligned
+      clear_device();
+      auto load = files.load(path, device_data.accelerator_pointer());
+      view.copy(device_data.accelerator_pointer(), check.data(), bytes);
+      bool ok = first_mismatch(check.data(), size, 0) == size;
+      std::size_t first = size / 3 + 1, count = size / 3;
+      files.load(path, device_data.accelerator_pointer(), count * sizeof(double), first * sizeof(double));
+      view.copy(device_data.accelerator_pointer(), check.data(), count * sizeof(double));
+      ok &= first_mismatch(check.data(), count, first) == count;
+
+      // and back out to a second file, which is read in again
+      std::string copy_path = path + ".out";
+      auto store = files.store(device_data.accelerator_pointer(), count * sizeof(double), copy_path);
+      clear_device();
+      files.load(copy_path, device_data.accelerator_pointer());
+      view.copy(device_data.accelerator_pointer(), check.data(), count * sizeof(double));
+      ok &= first_mismatch(check.data(), count, first) == count;
+      std::remove(copy_path.c_str());
+
+      all_ok &= ok;
+      std::cerr << to_string(m) << (m == av::file_transfer::method::direct && !load.direct ? " (not supported here, buffered)" : "")
+                << ", " << files.pinned_bytes() / 1_MiB << " MiB pinned:\n"
+                << "  load  " << load.gib_per_second() << " GiB/s, " << load.chunks << " chunks, file "
+                << load.io_seconds << " s, waiting for copies " << load.copy_seconds << " s (summed over workers)\n"
+                << "  store " << store.gib_per_second() << " GiB/s, file " << store.io_seconds << " s, waiting for copies "
+                << store.copy_seconds << " s" << (ok ? "" : " -- MISMATCH") << "\n";
+    }
+    std::remove(path.c_str());
+    std::cerr << (all_ok ? "all loads and stores correct\n" : "FAILED\n");
+  }
+  std::cerr << "total time: " << tm << " seconds\n";
+}
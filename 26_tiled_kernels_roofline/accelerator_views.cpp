@@ -0,0 +1,221 @@
+#include <hc.hpp>
+#include <hc_am.hpp>
+#include <pinned_vector.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "scoped_timers.hpp"
+#include "benchmark.hpp"
+#include "device_buffer.hpp"
+#include "tiled_kernels.hpp"
+
+using namespace hc;
+
+std::vector<hc::accelerator> get_devices(){
+  std::vector<hc::accelerator> devices;
+  for(const auto& acc: accelerator::get_all()){
+    if(acc.get_device_path() != L"cpu"){
+      devices.push_back(acc);
+    }
+  }
+  return devices;
+}
+
+// elements per work-item of the roof kernels: one on a GPU, a run the compiler vectorizes on the host
+#if defined(HC_HOST_BACKEND)
+constexpr std::size_t run = 4096;
+#else
+constexpr std::size_t run = 1;
+#endif
+
+// fills device memory with values in [0, 1) that differ from element to element
+void fill(hc::accelerator_view& view, double* data, std::size_t count, unsigned seed){
+  parallel_for_each(view, extent<1>(count), [=](hc::index<1> idx)[[hc]]{
+      data[idx[0]] = ((idx[0] * 2654435761u + seed) % 1000) / 1000.0;
+    }).wait();
+}
+
+std::vector<double> download(hc::accelerator_view& view, const double* data, std::size_t count){
+  pinned_vector<double> host(count, 0.0, am_allocator<double>(view.get_accelerator()));
+  view.copy(data, host.data(), count * sizeof(double));
+  return std::vector<double>(host.begin(), host.end());
+}
+
+bool matches(const std::vector<double>& result, const std::vector<double>& expected){
+  for(std::size_t i = 0; i != expected.size(); ++i){
+    if(std::abs(result[i] - expected[i]) > 1e-9 * (1 + std::abs(expected[i]))) return false;
+  }
+  return true;
+}
+
+// Both versions of every kernel on sizes that aren't multiples of any tile, against plain loops
+// on the host.
+bool check(hc::accelerator acc){
+  auto view = acc.create_view();
+  int m = 67, n = 45, k = 39, rows = 37, cols = 53, depth = 9;
+  av::device_buffer<double> a(acc, m * k), b(acc, k * n), c(acc, m * n), grid(acc, depth * rows * cols),
+    out(acc, depth * rows * cols);
+  fill(view, a.accelerator_pointer(), a.size(), 1);
+  fill(view, b.accelerator_pointer(), b.size(), 2);
+  fill(view, grid.accelerator_pointer(), grid.size(), 3);
+  auto ha = download(view, a.accelerator_pointer(), a.size());
+  auto hb = download(view, b.accelerator_pointer(), b.size());
+  auto hg = download(view, grid.accelerator_pointer(), grid.size());
+
+  std::vector<double> gemm(m * n), transposed(rows * cols), stencil2(rows * cols), stencil3(depth * rows * cols);
+  for(int i = 0; i != m; ++i){
+    for(int j = 0; j != n; ++j){
+      double sum = 0;
+      for(int l = 0; l != k; ++l) sum += ha[i * k + l] * hb[l * n + j];
+      gemm[i * n + j] = 2 * sum;
+    }
+  }
+  for(int r = 0; r != rows; ++r){
+    for(int q = 0; q != cols; ++q){
+      transposed[q * rows + r] = hg[r * cols + q];
+      bool edge = r == 0 || r == rows - 1 || q == 0 || q == cols - 1;
+      auto at = [&](int dr, int dq){ return hg[(r + dr) * cols + q + dq]; };
+      stencil2[r * cols + q] = edge ? at(0, 0) : (at(-1, 0) + at(1, 0) + at(0, -1) + at(0, 1) + at(0, 0)) * 0.2;
+    }
+  }
+  for(int z = 0; z != depth; ++z){
+    for(int r = 0; r != rows; ++r){
+      for(int q = 0; q != cols; ++q){
+        bool edge = z == 0 || z == depth - 1 || r == 0 || r == rows - 1 || q == 0 || q == cols - 1;
+        auto at = [&](int dz, int dr, int dq){ return hg[((z + dz) * rows + r + dr) * cols + q + dq]; };
+        stencil3[(z * rows + r) * cols + q] = edge ? at(0, 0, 0)
+          : (at(-1, 0, 0) + at(1, 0, 0) + at(0, -1, 0) + at(0, 1, 0) + at(0, 0, -1) + at(0, 0, 1) + at(0, 0, 0)) / 7;
+      }
+    }
+  }
+
+  bool ok = true;
+  auto expect = [&](const char* what, const double* result, const std::vector<double>& expected){
+    bool good = matches(download(view, result, expected.size()), expected);
+    if(!good) std::cerr << what << ": WRONG\n";
+    ok &= good;
+  };
+  auto pa = a.accelerator_pointer(), pb = b.accelerator_pointer(), pc = c.accelerator_pointer();
+  auto pg = grid.accelerator_pointer(), po = out.accelerator_pointer();
+  av::kernels::tiled::gemm(view, m, n, k, 2.0, pa, pb, 0.0, pc).wait();
+  expect("tiled gemm", pc, gemm);
+  av::kernels::blocked::gemm(view, m, n, k, 2.0, pa, pb, 0.0, pc).wait();
+  expect("blocked gemm", pc, gemm);
+  av::kernels::tiled::transpose(view, rows, cols, pg, po).wait();
+  expect("tiled transpose", po, transposed);
+  av::kernels::blocked::transpose(view, rows, cols, pg, po).wait();
+  expect("blocked transpose", po, transposed);
+  av::kernels::tiled::stencil_2d(view, rows, cols, pg, po).wait();
+  expect("tiled stencil_2d", po, stencil2);
+  av::kernels::blocked::stencil_2d(view, rows, cols, pg, po).wait();
+  expect("blocked stencil_2d", po, stencil2);
+  av::kernels::tiled::stencil_3d(view, depth, rows, cols, pg, po).wait();
+  expect("tiled stencil_3d", po, stencil3);
+  av::kernels::blocked::stencil_3d(view, depth, rows, cols, pg, po).wait();
+  expect("blocked stencil_3d", po, stencil3);
+  return ok;
+}
+
+// usage: accelerator_views [matrix size (1024)] [grid size (4096)]
+// gemm multiplies two square matrices, transpose and stencil_2d work on a square grid, and
+// stencil_3d on a cube with as many points.
+int main(int argc, char* argv[]){
+  float tm;
+  {
+    SystemTimer timer(tm);
+    int n = argc > 1 ? std::atoi(argv[1]) : 1024;
+    int g = argc > 2 ? std::atoi(argv[2]) : 4096;
+    int g3 = static_cast<int>(std::cbrt(1.0 * g * g));
+    std::size_t points = std::max<std::size_t>(std::size_t(g) * g, std::size_t(g3) * g3 * g3);
+
+    auto devices = get_devices();
+    if(devices.empty()){
+      std::cerr << "No GPU devices found, exiting.\n";
+      return 0;
+    }
+    auto acc = devices.front();
+    auto view = acc.create_view();
+
+    bool ok = check(acc);
+    std::cerr << (ok ? "tiled and blocked kernels correct\n" : "FAILED\n");
+
+    av::device_buffer<double> a(acc, std::size_t(n) * n), b(acc, std::size_t(n) * n), c(acc, std::size_t(n) * n);
+    av::device_buffer<double> in(acc, points), out(acc, points);
+    fill(view, a.accelerator_pointer(), a.size(), 1);
+    fill(view, b.accelerator_pointer(), b.size(), 2);
+    fill(view, in.accelerator_pointer(), in.size(), 3);
+    auto pa = a.accelerator_pointer(), pb = b.accelerator_pointer(), pc = c.accelerator_pointer();
+    auto pin = in.accelerator_pointer(), pout = out.accelerator_pointer();
+
+    // the roof: streaming bandwidth, and multiply-adds on registers
+    std::size_t count = points, work = count / 16;
+    auto copy = av::time_repeated(1, 5, [&]{
+        parallel_for_each(view, extent<1>((count + run - 1) / run), [=](hc::index<1> idx)[[hc]]{
+            std::size_t first = idx[0] * run, last = std::min(first + run, count);
+            for(std::size_t e = first; e < last; ++e) pout[e] = pin[e];
+          }).wait();
+      });
+    auto arithmetic = av::time_repeated(1, 5, [&]{
+        parallel_for_each(view, extent<1>((work + run - 1) / run), [=](hc::index<1> idx)[[hc]]{
+            std::size_t first = idx[0] * run, length = std::min(first + run, work) - first;
+            double v[run];
+            for(std::size_t e = 0; e < length; ++e) v[e] = pin[first + e];
+            for(int i = 0; i != 256; ++i){
+              for(std::size_t e = 0; e < length; ++e) v[e] = v[e] * 0.999 + 0.001;
+            }
+            for(std::size_t e = 0; e < length; ++e) pout[first + e] = v[e];
+          }).wait();
+      });
+    double peak_bytes = 2.0 * count * sizeof(double) / copy.median_seconds;
+    double peak_flops = 2.0 * 256 * work / arithmetic.median_seconds;
+    double balance = peak_flops / peak_bytes;
+    std::cerr << "roof: " << peak_bytes / 1e9 << " GB/s, " << peak_flops / 1e9 << " GFLOP/s, balance "
+              << balance << " flop/byte\n";
+
+    // the link, for what overlapping transfers with these kernels could gain
+    pinned_vector<double> host(count, 0.0, am_allocator<double>(acc));
+    auto h2d = av::time_repeated(1, 3, [&]{ view.copy(host.data(), pin, count * sizeof(double)); });
+    auto d2h = av::time_repeated(1, 3, [&]{ view.copy(pin, host.data(), count * sizeof(double)); });
+    double h2d_bytes = count * sizeof(double) / h2d.median_seconds;
+    double d2h_bytes = count * sizeof(double) / d2h.median_seconds;
+    std::cerr << "link: H2D " << h2d_bytes / 1e9 << " GB/s, D2H " << d2h_bytes / 1e9 << " GB/s\n\n";
+
+    struct kernel {
+      std::string name;
+      av::kernels::cost cost;
+      double bytes_in, bytes_out;  // over the link
+      std::function<hc::completion_future()> run;
+    };
+    double grid_bytes = double(g) * g * sizeof(double), cube_bytes = double(g3) * g3 * g3 * sizeof(double);
+    std::vector<kernel> kernels = {
+      {"gemm " + std::to_string(n) + "^3", av::kernels::gemm_cost<double>(n, n, n), 2.0 * n * n * sizeof(double),
+       1.0 * n * n * sizeof(double), [&]{ return av::kernels::gemm(view, n, n, n, 1.0, pa, pb, 0.0, pc); }},
+      {"transpose " + std::to_string(g) + "^2", av::kernels::transpose_cost<double>(g, g), grid_bytes, grid_bytes,
+       [&]{ return av::kernels::transpose(view, g, g, pin, pout); }},
+      {"stencil_2d " + std::to_string(g) + "^2", av::kernels::stencil_2d_cost<double>(g, g), grid_bytes, grid_bytes,
+       [&]{ return av::kernels::stencil_2d(view, g, g, pin, pout); }},
+      {"stencil_3d " + std::to_string(g3) + "^3", av::kernels::stencil_3d_cost<double>(g3, g3, g3), cube_bytes,
+       cube_bytes, [&]{ return av::kernels::stencil_3d(view, g3, g3, g3, pin, pout); }},
+    };
+    for(auto& k: kernels){
+      auto time = av::time_repeated(1, 3, [&]{ k.run().wait(); });
+      double seconds = time.median_seconds;
+      // the roofline time: whichever of arithmetic and memory traffic takes longer at the peaks
+      double roof = std::max(k.cost.flops / peak_flops, k.cost.bytes / peak_bytes);
+      double transfers = k.bytes_in / h2d_bytes + k.bytes_out / d2h_bytes;
+      // a pipeline of many chunks (example 06) at best hides the shorter of transfers and compute
+      double serial = transfers + seconds, overlapped = std::max(transfers, seconds);
+      std::cerr << k.name << ": " << seconds * 1e3 << " ms, " << k.cost.flops / seconds / 1e9 << " GFLOP/s, "
+                << k.cost.bytes / seconds / 1e9 << " GB/s, " << k.cost.intensity() << " flop/byte ("
+                << (k.cost.intensity() > balance ? "compute" : "memory") << "-bound), " << 100 * roof / seconds
+                << "% of the roof\n  with transfers: " << serial * 1e3 << " ms serial, " << overlapped * 1e3
+                << " ms overlapped at best, " << serial / overlapped << "x; "
+                << (transfers > seconds ? "the link" : "the kernel") << " dominates\n";
+    }
+  }
+  std::cerr << "total time: " << tm << " seconds\n";
+}
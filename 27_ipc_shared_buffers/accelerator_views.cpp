@@ -0,0 +1,160 @@
+#include <hc.hpp>
+#include <hc_am.hpp>
+#include <pinned_vector.hpp>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "scoped_timers.hpp"
+#include "device_buffer.hpp"
+#include "ipc.hpp"
+#include "reduction.hpp"
+
+using namespace hc;
+
+constexpr std::size_t operator "" _MiB(unsigned long long n){ return n * 1024 * 1024; }
+
+constexpr unsigned max_workers = 16;
+
+// what the loader and the workers share, in a shared_object
+struct table {
+  av::ipc_event uploaded;        // 1 once the data is on the device
+  av::ipc_event done;            // the number of workers finished
+  av::ipc_memory_handle data;
+  std::uint64_t count;
+  std::uint32_t workers;
+  double sums[max_workers];      // of each worker's slice, reduced on the device
+  std::uint32_t ok[max_workers]; // whether the slice copied back correctly
+  double seconds[max_workers];   // from the upload being signalled to the worker's result
+};
+
+std::vector<hc::accelerator> get_devices(){
+  std::vector<hc::accelerator> devices;
+  for(const auto& acc: accelerator::get_all()){
+    if(acc.get_device_path() != L"cpu"){
+      devices.push_back(acc);
+    }
+  }
+  return devices;
+}
+
+// small integers, so that sums are exact in any order
+double value(std::size_t i){ return double(i % 1024); }
+
+// the first element of worker w's slice; the next worker's is one past its last
+std::size_t slice_begin(std::size_t count, unsigned workers, unsigned w){ return count * w / workers; }
+
+int worker(const std::string& name, unsigned w){
+  auto shared = av::shared_object<table>::open(name);
+  auto& t = *shared;
+  auto devices = get_devices();
+  auto acc = devices[w % devices.size()];
+  auto view = acc.create_view();
+
+  t.uploaded.wait(1);
+  auto start = std::chrono::steady_clock::now();
+  av::ipc_mapping mapping(t.data, acc);
+  auto data = static_cast<const double*>(mapping.get());
+  std::size_t first = slice_begin(t.count, t.workers, w), count = slice_begin(t.count, t.workers, w + 1) - first;
+
+  // the slice back to the host, through the imported pointer, to check it
+  pinned_vector<double> check(count, 0.0, am_allocator<double>(acc));
+  if(count) view.copy_async(data + first, check.data(), count * sizeof(double)).wait();
+  bool ok = true;
+  for(std::size_t i = 0; i != count; ++i) ok &= check[i] == value(first + i);
+
+  // and a kernel on it
+  t.sums[w] = av::reduce_sum(view, data + first, count);
+  t.ok[w] = ok;
+  t.seconds[w] = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  t.done.advance();
+  return ok ? 0 : 1;
+}
+
+// usage: accelerator_views [workers (3)] [size in MiB (64)]
+// The loader uploads the data once and exports it; the workers, separate processes started from
+// the same executable, import it and each reduce a slice.
+int main(int argc, char* argv[]){
+  if(argc == 4 && std::strcmp(argv[1], "--worker") == 0) return worker(argv[2], std::atoi(argv[3]));
+
+  float tm;
+  {
+    SystemTimer timer(tm);
+    unsigned workers = argc > 1 ? std::atoi(argv[1]) : 3;
+    std::size_t size = (argc > 2 ? std::atoi(argv[2]) : 64) * 1_MiB / sizeof(double);
+    std::size_t bytes = size * sizeof(double);
+    if(workers == 0 || workers > max_workers){
+      std::cerr << "between 1 and " << max_workers << " workers, please\n";
+      return 1;
+    }
+
+    auto devices = get_devices();
+    if(devices.empty()){
+      std::cerr << "No GPU devices found, exiting.\n";
+      return 0;
+    }
+    auto acc = devices.front();
+    auto view = acc.create_view();
+
+    std::string name = "/accelerator_views." + std::to_string(getpid());
+    auto shared = av::shared_object<table>::create(name);
+    auto& t = *shared;
+    t.count = size;
+    t.workers = workers;
+
+    // exported before the upload: the first export may move the memory
+    av::device_buffer<double> device_data(acc, size);
+    t.data = av::ipc_export(device_data.accelerator_pointer(), bytes);
+
+    // the workers start now, and wait for the upload to be signalled
+    std::vector<pid_t> children;
+    for(unsigned w = 0; w != workers; ++w){
+      std::string index = std::to_string(w);
+      char* args[] = {argv[0], const_cast<char*>("--worker"), const_cast<char*>(name.c_str()),
+                      const_cast<char*>(index.c_str()), nullptr};
+      pid_t pid;
+      if(posix_spawn(&pid, "/proc/self/exe", nullptr, nullptr, args, environ) == 0) children.push_back(pid);
+      else std::cerr << "can't start worker " << w << "\n";
+    }
+
+    float upload;
+    {
+      SystemTimer timer(upload);
+      pinned_vector<double> host_data(size, 0.0, am_allocator<double>(acc));
+      for(std::size_t i = 0; i != size; ++i) host_data[i] = value(i);
+      auto fut = view.copy_async(host_data.data(), device_data.accelerator_pointer(), bytes);
+      t.uploaded.signal_on(fut, 1);
+      fut.wait();
+    }
+
+    bool finished = t.done.wait(children.size(), std::chrono::seconds(120));
+    bool all_ok = finished && children.size() == workers;
+    for(auto pid: children){
+      int status = 0;
+      waitpid(pid, &status, 0);
+      all_ok &= WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    }
+
+    double expected = 0, total = 0;
+    for(std::size_t i = 0; i != size; ++i) expected += value(i);
+    for(unsigned w = 0; w != workers && finished; ++w){
+      total += t.sums[w];
+      all_ok &= t.ok[w] != 0;
+      std::cerr << "worker " << w << ": " << slice_begin(size, workers, w + 1) - slice_begin(size, workers, w)
+                << " elements, import, copy back and reduction " << t.seconds[w] << " s"
+                << (t.ok[w] ? "" : " -- MISMATCH") << "\n";
+    }
+    all_ok &= total == expected;
+
+    std::cerr << "1 upload of " << bytes / 1_MiB << " MiB in " << upload << " s, shared by " << workers
+              << " processes; a copy per process would upload and hold " << workers * bytes / 1_MiB << " MiB\n"
+              << (all_ok ? "all workers correct\n" : "FAILED\n");
+  }
+  std::cerr << "total time: " << tm << " seconds\n";
+}
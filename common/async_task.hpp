@@ -0,0 +1,306 @@
+#ifndef ASYNC_TASK_HPP
+#define ASYNC_TASK_HPP
+
+// Continuations on completion_futures, without a host thread parked in wait() per operation.
+//
+// A reactor is a thread that runs callbacks: reactor::watch(fut, fn) runs fn on the reactor once
+// fut has completed, so fn never runs on, or holds up, a view's completion path. The reactor polls
+// the futures it watches (every few microseconds, and only while it watches any) rather than using
+// completion_future::then: hcc keeps one continuation per future, runs it on a thread that refers
+// to the functor and the future, and joins that thread in the future's destructor, so dropping the
+// future would block until the operation is done. reactor::get() is a process-wide one.
+//
+// With C++20 coroutines, av::task<T> is a coroutine that can co_await completion_futures and other
+// tasks:
+//
+//   av::task<float> serve(hc::accelerator_view view, request r){
+//     co_await view.copy_async(r.input, r.device_input, r.bytes);
+//     co_await hc::parallel_for_each(view, ...);
+//     co_await view.copy_async(r.device_output, r.output, r.bytes);
+//     co_return r.output[0];
+//   }
+//
+// A task starts right away on the calling thread, and after its first co_await on an operation
+// that hasn't completed yet, continues on the reactor thread, so one thread drives any number of
+// concurrent pipelines. Errors from the operations are rethrown by co_await. task::get() waits
+// for the result from outside a coroutine; a task's destructor waits for it to finish.
+// av::then(fut, fn) is the continuation form: a task that runs fn() once fut completes, and also
+// waits for the completion_future fn returns, if it returns one.
+
+#include <hc.hpp>
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+#if defined(__cpp_impl_coroutine)
+#include <coroutine>
+#include <optional>
+#endif
+
+namespace av {
+
+class reactor {
+public:
+  reactor() : worker_([this]{ work(); }) {}
+
+  reactor(const reactor&) = delete;
+  reactor& operator=(const reactor&) = delete;
+
+  // runs the callbacks posted so far, and those of the futures watched so far once they complete
+  ~reactor(){
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    cv_.notify_one();
+    worker_.join();
+  }
+
+  // never destroyed, so it can be used from static destructors
+  static reactor& get(){
+    static auto instance = new reactor();
+    return *instance;
+  }
+
+  void post(std::function<void()> fn){
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      ready_.push_back(std::move(fn));
+    }
+    cv_.notify_one();
+  }
+
+  // fn runs on the reactor thread once fut has completed
+  void watch(hc::completion_future fut, std::function<void()> fn){
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      watched_.emplace_back(std::move(fut), std::move(fn));
+    }
+    cv_.notify_one();
+  }
+
+  bool on_reactor_thread() const { return std::this_thread::get_id() == worker_.get_id(); }
+
+private:
+  void work(){
+    const auto poll_interval = std::chrono::microseconds(20);
+    std::unique_lock<std::mutex> lock(mutex_);
+    for(;;){
+      // the callbacks of completed futures join the ready ones, in the order they were watched
+      for(auto it = watched_.begin(); it != watched_.end();){
+        if(!it->first.is_ready()){
+          ++it;
+          continue;
+        }
+        ready_.push_back(std::move(it->second));
+        it = watched_.erase(it);
+      }
+      if(!ready_.empty()){
+        while(!ready_.empty()){
+          auto fn = std::move(ready_.front());
+          ready_.pop_front();
+          lock.unlock();
+          fn();
+          lock.lock();
+        }
+        continue;
+      }
+      if(watched_.empty()){
+        if(stop_) return;
+        cv_.wait(lock);
+      }
+      else cv_.wait_for(lock, poll_interval);
+    }
+  }
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::deque<std::function<void()>> ready_;
+  std::list<std::pair<hc::completion_future, std::function<void()>>> watched_;
+  bool stop_ = false;
+  std::thread worker_;
+};
+
+#if defined(__cpp_impl_coroutine)
+
+template<typename T = void>
+class task;
+
+namespace detail {
+
+// suspends until fut completes, then resumes on the reactor
+struct completion_awaiter {
+  hc::completion_future fut;
+
+  bool await_ready(){ return fut.is_ready(); }
+  void await_suspend(std::coroutine_handle<> h){ reactor::get().watch(fut, [h]{ h.resume(); }); }
+  void await_resume(){ fut.get(); }
+};
+
+class task_promise_base {
+public:
+  std::suspend_never initial_suspend() noexcept { return {}; }
+
+  // resumes the coroutine awaiting this one, if any; otherwise wakes up get()
+  auto final_suspend() noexcept {
+    struct awaiter {
+      task_promise_base* promise;
+      bool await_ready() noexcept { return false; }
+      std::coroutine_handle<> await_suspend(std::coroutine_handle<>) noexcept {
+        std::lock_guard<std::mutex> lock(promise->mutex_);
+        promise->done_ = true;
+        promise->cv_.notify_all();
+        return promise->continuation_ ? promise->continuation_ : std::noop_coroutine();
+      }
+      void await_resume() noexcept {}
+    };
+    return awaiter{this};
+  }
+
+  void unhandled_exception(){ error_ = std::current_exception(); }
+
+  completion_awaiter await_transform(hc::completion_future fut){ return {std::move(fut)}; }
+  template<typename Awaitable>
+  Awaitable&& await_transform(Awaitable&& a){ return std::forward<Awaitable>(a); }
+
+  bool done(){
+    std::lock_guard<std::mutex> lock(mutex_);
+    return done_;
+  }
+
+  void wait(){
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [this]{ return done_; });
+  }
+
+  // false if the task has finished already, and the awaiting coroutine should just go on
+  bool set_continuation(std::coroutine_handle<> h){
+    std::lock_guard<std::mutex> lock(mutex_);
+    if(done_) return false;
+    continuation_ = h;
+    return true;
+  }
+
+  void rethrow() const {
+    if(error_) std::rethrow_exception(error_);
+  }
+
+private:
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  bool done_ = false;
+  std::coroutine_handle<> continuation_;
+  std::exception_ptr error_;
+};
+
+template<typename T>
+class task_promise : public task_promise_base {
+public:
+  task<T> get_return_object();
+  void return_value(T value){ value_.emplace(std::move(value)); }
+  T& value(){ rethrow(); return *value_; }
+
+private:
+  std::optional<T> value_;
+};
+
+template<>
+class task_promise<void> : public task_promise_base {
+public:
+  task<void> get_return_object();
+  void return_void(){}
+  void value(){ rethrow(); }
+};
+
+} // namespace detail
+
+template<typename T>
+class task {
+public:
+  using promise_type = detail::task_promise<T>;
+
+  task() = default;
+  explicit task(std::coroutine_handle<promise_type> h) : handle_(h) {}
+  task(task&& other) noexcept : handle_(std::exchange(other.handle_, {})) {}
+  task& operator=(task&& other) noexcept {
+    if(this != &other){
+      reset();
+      handle_ = std::exchange(other.handle_, {});
+    }
+    return *this;
+  }
+
+  ~task(){ reset(); }
+
+  bool valid() const { return static_cast<bool>(handle_); }
+  bool is_ready() const { return !handle_ || handle_.promise().done(); }
+
+  // blocks until the task has finished; rethrows what it threw. Not from the reactor thread.
+  decltype(auto) get(){
+    handle_.promise().wait();
+    return handle_.promise().value();
+  }
+
+  auto operator co_await() & { return awaiter{handle_}; }
+  auto operator co_await() && { return awaiter{handle_}; }
+
+private:
+  struct awaiter {
+    std::coroutine_handle<promise_type> handle;
+    bool await_ready(){ return handle.promise().done(); }
+    bool await_suspend(std::coroutine_handle<> h){ return handle.promise().set_continuation(h); }
+    decltype(auto) await_resume(){ return handle.promise().value(); }
+  };
+
+  void reset(){
+    if(!handle_) return;
+    handle_.promise().wait();
+    handle_.destroy();
+    handle_ = {};
+  }
+
+  std::coroutine_handle<promise_type> handle_;
+};
+
+namespace detail {
+
+template<typename T>
+task<T> task_promise<T>::get_return_object(){
+  return task<T>(std::coroutine_handle<task_promise<T>>::from_promise(*this));
+}
+
+inline task<void> task_promise<void>::get_return_object(){
+  return task<void>(std::coroutine_handle<task_promise<void>>::from_promise(*this));
+}
+
+template<typename R>
+using then_result = std::conditional_t<std::is_same<R, hc::completion_future>::value, void, R>;
+
+} // namespace detail
+
+// fn() on the reactor thread once fut has completed; if fn returns a completion_future, the task
+// finishes when that does
+template<typename Function>
+task<detail::then_result<std::invoke_result_t<Function&>>> then(hc::completion_future fut, Function fn){
+  co_await fut;
+  if constexpr(std::is_same<std::invoke_result_t<Function&>, hc::completion_future>::value){
+    co_await fn();
+  }
+  else {
+    co_return fn();
+  }
+}
+
+#endif // __cpp_impl_coroutine
+
+} // namespace av
+
+#endif // ASYNC_TASK_HPP
@@ -0,0 +1,150 @@
+#ifndef BATCHED_COPY_HPP
+#define BATCHED_COPY_HPP
+
+// Many small host to device copies as one transfer.
+//
+// Every accelerator_view::copy_async pays for its submission and DMA setup, which for KiB-sized
+// copies costs more than moving the data. copy_batch_async takes a list of (src, dst, bytes)
+// regions and:
+//  - sorts them by destination and merges regions that are adjacent on both sides,
+//  - copies regions of at least direct_bytes from am_alloc-ed memory with their own copy_async,
+//  - packs everything else into one pinned staging block, behind a table of (offset, bytes, dst),
+//    copies the block to device scratch with a single copy_async, and scatters it to the
+//    destinations with a kernel, one work-item per 8 bytes.
+// The staging block comes from the process-wide pinned pool and the scratch from the device pool
+// of av::caching_allocator, and go back stream-ordered, so a steady stream of batches doesn't
+// allocate.
+//
+// src may be any host memory; dst is device memory accessible from view. Destinations must not
+// overlap.
+
+#include <hc.hpp>
+#include <hc_am.hpp>
+#include "caching_allocator.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace av {
+
+struct copy_region {
+  const void* src;
+  void* dst;
+  std::size_t bytes;
+};
+
+namespace detail {
+
+struct scatter_entry {
+  std::uint64_t offset;  // in the packed payload, a multiple of scatter_word
+  std::uint64_t bytes;
+  char* dst;
+};
+
+constexpr std::size_t scatter_word = 8;
+
+inline std::size_t round_up(std::size_t bytes, std::size_t multiple){
+  return (bytes + multiple - 1) / multiple * multiple;
+}
+
+inline bool is_am_tracked(hc::accelerator& acc, const void* ptr){
+  hc::AmPointerInfo info(NULL, NULL, NULL, 0, acc, 0, 0);
+  return hc::am_memtracker_getinfo(&info, ptr) == AM_SUCCESS;
+}
+
+// submits the copy of the packed block to view, then the kernel that scatters it
+inline hc::completion_future submit_packed(hc::accelerator_view& view, const std::vector<copy_region>& regions){
+  std::size_t table_bytes = regions.size() * sizeof(scatter_entry);
+  std::vector<scatter_entry> table;
+  std::size_t payload_bytes = 0;
+  for(auto& r: regions){
+    table.push_back({payload_bytes, r.bytes, static_cast<char*>(r.dst)});
+    payload_bytes += round_up(r.bytes, scatter_word);
+  }
+  std::size_t total = table_bytes + payload_bytes;
+
+  auto& pinned = caching_allocator::pinned_pool();
+  auto& scratch_pool = caching_allocator::device_pool(view.get_accelerator());
+  // written by the host right away, so not a block the view may still be using
+  auto staging = static_cast<char*>(pinned.allocate(total));
+  std::memcpy(staging, table.data(), table_bytes);
+  for(std::size_t i = 0; i != regions.size(); ++i){
+    std::memcpy(staging + table_bytes + table[i].offset, regions[i].src, regions[i].bytes);
+  }
+  auto scratch = static_cast<char*>(scratch_pool.allocate(total, view));
+  view.copy_async(staging, scratch, total);
+
+  const scatter_entry* entries = reinterpret_cast<const scatter_entry*>(scratch);
+  const char* payload = scratch + table_bytes;
+  std::size_t count = regions.size();
+  auto done = hc::parallel_for_each(view, hc::extent<1>(payload_bytes / scatter_word), [=](hc::index<1> idx)[[hc]]{
+      std::uint64_t at = idx[0] * scatter_word;
+      // the last entry starting at or before at
+      std::size_t lo = 0, hi = count;
+      while(hi - lo > 1){
+        std::size_t mid = (lo + hi) / 2;
+        if(entries[mid].offset <= at) lo = mid;
+        else hi = mid;
+      }
+      const scatter_entry& e = entries[lo];
+      if(at >= e.offset + e.bytes) return; // padding
+      std::uint64_t n = e.offset + e.bytes - at < scatter_word ? e.offset + e.bytes - at : scatter_word;
+      char* to = e.dst + (at - e.offset);
+      if(n == scatter_word && reinterpret_cast<std::uintptr_t>(to) % scatter_word == 0){
+        *reinterpret_cast<std::uint64_t*>(to) = *reinterpret_cast<const std::uint64_t*>(payload + at);
+      }
+      else{
+        for(std::uint64_t b = 0; b != n; ++b) to[b] = payload[at + b];
+      }
+    });
+  scratch_pool.deallocate(scratch, view);
+  pinned.deallocate(staging, view);
+  return done;
+}
+
+} // namespace detail
+
+// Sorts regions by destination, drops empty ones, and merges neighbours that are adjacent in both
+// source and destination.
+inline std::vector<copy_region> coalesce(std::vector<copy_region> regions){
+  regions.erase(std::remove_if(regions.begin(), regions.end(), [](const copy_region& r){ return r.bytes == 0; }),
+                regions.end());
+  std::sort(regions.begin(), regions.end(), [](const copy_region& a, const copy_region& b){
+      return std::less<void*>()(a.dst, b.dst);
+    });
+  std::vector<copy_region> merged;
+  for(auto& r: regions){
+    if(!merged.empty()){
+      auto& last = merged.back();
+      if(static_cast<const char*>(last.src) + last.bytes == r.src
+         && static_cast<char*>(last.dst) + last.bytes == r.dst){
+        last.bytes += r.bytes;
+        continue;
+      }
+    }
+    merged.push_back(r);
+  }
+  return merged;
+}
+
+// Copies all regions, in at most one packed transfer plus one copy per large region from
+// am_alloc-ed memory. The future is that of the last operation submitted to view, so all of the
+// batch is done when it is; an empty batch gives a default-constructed future.
+inline hc::completion_future copy_batch_async(hc::accelerator_view& view, std::vector<copy_region> regions,
+                                              std::size_t direct_bytes = 256 * 1024){
+  auto acc = view.get_accelerator();
+  hc::completion_future done;
+  std::vector<copy_region> packed;
+  for(auto& r: coalesce(std::move(regions))){
+    if(r.bytes >= direct_bytes && detail::is_am_tracked(acc, r.src)) done = view.copy_async(r.src, r.dst, r.bytes);
+    else packed.push_back(r);
+  }
+  if(!packed.empty()) done = detail::submit_packed(view, packed);
+  return done;
+}
+
+} // namespace av
+
+#endif // BATCHED_COPY_HPP
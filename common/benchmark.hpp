@@ -0,0 +1,105 @@
+#ifndef BENCHMARK_HPP
+#define BENCHMARK_HPP
+
+// Repeated steady_clock timing with warm-up, summary statistics, and CSV / JSON output, for
+// benchmarks that need latency and bandwidth curves rather than one number from a single run.
+//
+// The timed function must block until the operation it measures has completed, e.g. end with
+// .wait() on the completion_future, otherwise only the submission gets timed.
+
+#include "json.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace av {
+
+struct timing_stats {
+  std::size_t reps = 0;
+  double min_seconds = 0;
+  double median_seconds = 0;
+  double p99_seconds = 0;
+  double mean_seconds = 0;
+};
+
+// nearest-rank percentile of an ascending range, p in [0, 100]
+inline double percentile(const std::vector<double>& sorted, double p){
+  if(sorted.empty()) return 0;
+  auto rank = static_cast<std::size_t>(std::ceil(p / 100 * sorted.size()));
+  return sorted[std::min(sorted.size(), std::max<std::size_t>(rank, 1)) - 1];
+}
+
+inline timing_stats summarize(std::vector<double> seconds){
+  timing_stats stats;
+  if(seconds.empty()) return stats;
+  std::sort(seconds.begin(), seconds.end());
+  stats.reps = seconds.size();
+  stats.min_seconds = seconds.front();
+  stats.median_seconds = seconds.size() % 2 ? seconds[seconds.size() / 2]
+    : (seconds[seconds.size() / 2 - 1] + seconds[seconds.size() / 2]) / 2;
+  stats.p99_seconds = percentile(seconds, 99);
+  double sum = 0;
+  for(auto s: seconds) sum += s;
+  stats.mean_seconds = sum / seconds.size();
+  return stats;
+}
+
+// runs fn warmup times untimed, then reps times timed
+template<typename Function>
+timing_stats time_repeated(std::size_t warmup, std::size_t reps, Function fn){
+  for(std::size_t i = 0; i != warmup; ++i) fn();
+  std::vector<double> seconds;
+  seconds.reserve(reps);
+  for(std::size_t i = 0; i != reps; ++i){
+    auto start = std::chrono::steady_clock::now();
+    fn();
+    seconds.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+  }
+  return summarize(std::move(seconds));
+}
+
+// One measured configuration. bytes is what one repetition moves, over all views.
+struct benchmark_record {
+  std::string operation;    // e.g. "H2D"
+  std::string host_memory;  // "pinned", "pageable", or "" where there is no host side
+  std::string api;          // the call that was timed
+  std::size_t views = 1;
+  std::size_t bytes = 0;
+  timing_stats time;
+
+  double gib_per_second() const {
+    return time.median_seconds > 0 ? bytes / time.median_seconds / (1024.0 * 1024 * 1024) : 0;
+  }
+};
+
+inline void write_csv(std::ostream& out, const std::vector<benchmark_record>& records){
+  out << "operation,host_memory,api,views,bytes,reps,min_us,median_us,p99_us,mean_us,gib_per_second\n";
+  for(auto& r: records){
+    out << r.operation << ',' << r.host_memory << ",\"" << r.api << "\"," << r.views << ',' << r.bytes << ','
+        << r.time.reps << ',' << r.time.min_seconds * 1e6 << ',' << r.time.median_seconds * 1e6 << ','
+        << r.time.p99_seconds * 1e6 << ',' << r.time.mean_seconds * 1e6 << ',' << r.gib_per_second() << '\n';
+  }
+}
+
+inline void write_json(std::ostream& out, const std::vector<benchmark_record>& records){
+  out << "[\n";
+  for(std::size_t i = 0; i != records.size(); ++i){
+    auto& r = records[i];
+    out << "  {\"operation\": \"" << json_escape(r.operation)
+        << "\", \"host_memory\": \"" << json_escape(r.host_memory)
+        << "\", \"api\": \"" << json_escape(r.api) << '"'
+        << ", \"views\": " << r.views << ", \"bytes\": " << r.bytes << ", \"reps\": " << r.time.reps
+        << ", \"min_us\": " << r.time.min_seconds * 1e6 << ", \"median_us\": " << r.time.median_seconds * 1e6
+        << ", \"p99_us\": " << r.time.p99_seconds * 1e6 << ", \"mean_us\": " << r.time.mean_seconds * 1e6
+        << ", \"gib_per_second\": " << r.gib_per_second() << '}' << (i + 1 != records.size() ? "," : "") << '\n';
+  }
+  out << "]\n";
+}
+
+} // namespace av
+
+#endif // BENCHMARK_HPP
@@ -0,0 +1,237 @@
+#ifndef CACHING_ALLOCATOR_HPP
+#define CACHING_ALLOCATOR_HPP
+
+// Caching allocator in front of am_alloc, for device memory of one accelerator, or for pinned host
+// memory.
+//
+// Requests are rounded up to a power of two (at least min_block_bytes), and freed blocks are kept
+// in per-size free lists instead of going back to am_free. Reuse is stream-ordered: a block freed
+// with deallocate(ptr, view) may still be in use by operations queued on that view. Since a view
+// executes in order, the block can be handed out again right away for use on the same view; for
+// any other view, only once the marker created on the freeing view at deallocation has completed.
+//
+// When am_alloc fails, all idle blocks are returned to the system and the allocation is retried.
+
+#include <hc.hpp>
+#include <hc_am.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string>
+#include <vector>
+
+namespace av {
+
+struct pool_stats {
+  std::size_t requests = 0;
+  std::size_t hits = 0;                 // requests served from the cache
+  std::size_t bytes_in_use = 0;         // sum of the handed out blocks, after rounding up
+  std::size_t bytes_requested = 0;      // what was asked for, for the same blocks
+  std::size_t bytes_cached = 0;         // idle blocks
+  std::size_t bytes_allocated = 0;      // everything obtained from am_alloc: in use plus cached
+  std::size_t high_water_bytes = 0;     // peak of bytes_allocated
+  std::size_t total_bytes_handed_out = 0;  // over all requests so far, after rounding up
+  std::size_t total_bytes_requested = 0;
+
+  double hit_rate() const { return requests ? 1.0 * hits / requests : 0; }
+  // share of the memory handed out so far that was lost to rounding up to size classes
+  double fragmentation() const {
+    return total_bytes_handed_out ? 1 - 1.0 * total_bytes_requested / total_bytes_handed_out : 0;
+  }
+};
+
+class caching_allocator {
+public:
+  static constexpr std::size_t min_block_bytes = 512;
+
+  // flags as for am_alloc: 0 for device memory, amHostPinned for pinned host memory
+  explicit caching_allocator(hc::accelerator acc, unsigned flags = 0) : acc_(acc), flags_(flags) {}
+
+  caching_allocator(const caching_allocator&) = delete;
+  caching_allocator& operator=(const caching_allocator&) = delete;
+
+  // Frees the cached blocks, once operations queued before they were returned are done with them;
+  // blocks still handed out are left alone.
+  ~caching_allocator(){
+    for(auto& entry: free_){
+      if(entry.second.marker.valid()) entry.second.marker.wait();
+      hc::am_free(entry.second.ptr);
+    }
+  }
+
+  // One device memory pool per accelerator, and one pinned host memory pool, for the whole
+  // process. They are never destroyed, so they can be used from static destructors.
+  static caching_allocator& device_pool(hc::accelerator acc){
+    static std::mutex mutex;
+    static auto pools = new std::map<std::wstring, std::unique_ptr<caching_allocator>>();
+    std::lock_guard<std::mutex> lock(mutex);
+    auto& pool = (*pools)[acc.get_device_path()];
+    if(!pool) pool.reset(new caching_allocator(acc, 0));
+    return *pool;
+  }
+
+  static caching_allocator& pinned_pool(){
+    static auto pool = new caching_allocator(hc::accelerator(), amHostPinned);
+    return *pool;
+  }
+
+  hc::accelerator get_accelerator() const { return acc_; }
+  unsigned get_flags() const { return flags_; }
+
+  // A block that is safe to use on any view.
+  void* allocate(std::size_t bytes){ return allocate(bytes, nullptr); }
+
+  // A block for use on view; may be one that operations queued on view are still using.
+  void* allocate(std::size_t bytes, const hc::accelerator_view& view){ return allocate(bytes, &view); }
+
+  // Returns a block that no pending operation uses anymore.
+  void deallocate(void* ptr){ deallocate(ptr, nullptr); }
+
+  // Returns a block that operations already submitted to view may still be using.
+  void deallocate(void* ptr, hc::accelerator_view& view){ deallocate(ptr, &view); }
+
+  // am_free-s all idle blocks whose last use has completed.
+  void release_cached(){
+    std::lock_guard<std::mutex> lock(mutex_);
+    release_cached_locked();
+  }
+
+  pool_stats stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+  }
+
+  static std::size_t size_class(std::size_t bytes){
+    std::size_t block = min_block_bytes;
+    while(block < bytes) block *= 2;
+    return block;
+  }
+
+private:
+  struct free_block {
+    void* ptr;
+    std::shared_ptr<hc::accelerator_view> view;  // view it was freed on, if any
+    hc::completion_future marker;                // completes when that view is done with the block
+
+    bool usable_on(const hc::accelerator_view* other){
+      return !view || (other && *view == *other) || marker.is_ready();
+    }
+  };
+
+  struct used_block {
+    std::size_t block_bytes;
+    std::size_t requested_bytes;
+  };
+
+  void* allocate(std::size_t bytes, const hc::accelerator_view* view){
+    if(bytes == 0) return nullptr;
+    std::size_t block = size_class(bytes);
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++stats_.requests;
+
+    void* ptr = nullptr;
+    auto range = free_.equal_range(block);
+    for(auto it = range.first; it != range.second; ++it){
+      if(it->second.usable_on(view)){
+        ptr = it->second.ptr;
+        free_.erase(it);
+        ++stats_.hits;
+        stats_.bytes_cached -= block;
+        break;
+      }
+    }
+    if(!ptr){
+      ptr = hc::am_alloc(block, acc_, flags_);
+      if(!ptr){
+        release_cached_locked();
+        ptr = hc::am_alloc(block, acc_, flags_);
+        if(!ptr) throw std::bad_alloc();
+      }
+      stats_.bytes_allocated += block;
+      stats_.high_water_bytes = std::max(stats_.high_water_bytes, stats_.bytes_allocated);
+    }
+    used_[ptr] = used_block{block, bytes};
+    stats_.bytes_in_use += block;
+    stats_.bytes_requested += bytes;
+    stats_.total_bytes_handed_out += block;
+    stats_.total_bytes_requested += bytes;
+    return ptr;
+  }
+
+  void deallocate(void* ptr, hc::accelerator_view* view){
+    if(!ptr) return;
+    free_block freed{ptr, nullptr, hc::completion_future()};
+    if(view){
+      freed.view = std::make_shared<hc::accelerator_view>(*view);
+      freed.marker = view->create_marker();
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = used_.find(ptr);
+    if(it == used_.end()) return; // not ours
+    auto block = it->second.block_bytes;
+    stats_.bytes_in_use -= block;
+    stats_.bytes_requested -= it->second.requested_bytes;
+    stats_.bytes_cached += block;
+    used_.erase(it);
+    free_.emplace(block, std::move(freed));
+  }
+
+  void release_cached_locked(){
+    for(auto it = free_.begin(); it != free_.end();){
+      if(it->second.usable_on(nullptr)){
+        hc::am_free(it->second.ptr);
+        stats_.bytes_cached -= it->first;
+        stats_.bytes_allocated -= it->first;
+        it = free_.erase(it);
+      }
+      else {
+        ++it;
+      }
+    }
+  }
+
+  hc::accelerator acc_;
+  unsigned flags_;
+  mutable std::mutex mutex_;
+  std::multimap<std::size_t, free_block> free_;
+  std::map<void*, used_block> used_;
+  pool_stats stats_;
+};
+
+// Standard allocator drawing from a caching_allocator, e.g. to replace the am_allocator of
+// pinned_vector: std::vector<T, av::pool_allocator<T>>.
+template<typename T>
+class pool_allocator {
+public:
+  using value_type = T;
+
+  pool_allocator() : pool_(&caching_allocator::pinned_pool()) {}
+  explicit pool_allocator(caching_allocator& pool) : pool_(&pool) {}
+  template<typename U>
+  pool_allocator(const pool_allocator<U>& other) : pool_(&other.get_pool()) {}
+
+  T* allocate(std::size_t n){ return static_cast<T*>(pool_->allocate(n * sizeof(T))); }
+  void deallocate(T* ptr, std::size_t){ pool_->deallocate(ptr); }
+
+  caching_allocator& get_pool() const { return *pool_; }
+
+  template<typename U>
+  bool operator==(const pool_allocator<U>& other) const { return pool_ == &other.get_pool(); }
+  template<typename U>
+  bool operator!=(const pool_allocator<U>& other) const { return !(*this == other); }
+
+private:
+  caching_allocator* pool_;
+};
+
+// pinned_vector whose memory comes from the process-wide pinned pool
+template<typename T>
+using pooled_pinned_vector = std::vector<T, pool_allocator<T>>;
+
+} // namespace av
+
+#endif // CACHING_ALLOCATOR_HPP
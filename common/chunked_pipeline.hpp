@@ -0,0 +1,132 @@
+#ifndef CHUNKED_PIPELINE_HPP
+#define CHUNKED_PIPELINE_HPP
+
+// Overlapping host->device copies, kernels and device->host copies by streaming a host buffer
+// through the device in chunks.
+//
+// Chunk i goes to accelerator_view i % num_views, and is copied in, processed and copied out on
+// that view. Operations on one view execute in order, so each view needs only one chunk-sized
+// device buffer, and everything can be submitted up front without any host-side waits. Operations
+// on different views do overlap, so while view 0 computes on chunk i, view 1 uploads chunk i+1 and
+// view 2 downloads chunk i-1. With num_views == 2 this is classic double buffering.
+
+#include <hc.hpp>
+#include <hc_am.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+namespace av {
+
+struct pipeline_stats {
+  std::size_t chunks = 0;
+  std::size_t bytes = 0;        // bytes moved in each direction
+  double seconds = 0;           // wall clock time, submission of the first chunk to completion of the last
+  double h2d_seconds = 0;       // summed execution times of the individual operations
+  double kernel_seconds = 0;
+  double d2h_seconds = 0;
+
+  double busy_seconds() const { return h2d_seconds + kernel_seconds + d2h_seconds; }
+  // 1.0 means the operations ran back to back; 3.0 would be perfect overlap of copy in, compute and copy out
+  double concurrency() const { return seconds > 0 ? busy_seconds() / seconds : 0; }
+  // host->device plus device->host traffic per second
+  double gib_per_second() const { return seconds > 0 ? 2.0 * bytes / seconds / (1024.0 * 1024 * 1024) : 0; }
+};
+
+template<typename T>
+class chunked_pipeline {
+public:
+  chunked_pipeline(hc::accelerator acc, std::size_t chunk_elements, std::size_t num_views)
+    : acc_(acc), chunk_elements_(chunk_elements)
+  {
+    if(chunk_elements == 0 || num_views == 0){
+      throw std::invalid_argument("chunked_pipeline: chunk size and number of views must be non-zero");
+    }
+    for(std::size_t i = 0; i != num_views; ++i){
+      views_.push_back(acc_.create_view());
+      auto ptr = static_cast<T*>(hc::am_alloc(chunk_elements * sizeof(T), acc_, 0));
+      if(!ptr){
+        release();
+        throw std::bad_alloc();
+      }
+      buffers_.push_back(ptr);
+    }
+  }
+
+  chunked_pipeline(const chunked_pipeline&) = delete;
+  chunked_pipeline& operator=(const chunked_pipeline&) = delete;
+
+  ~chunked_pipeline(){ release(); }
+
+  std::size_t chunk_elements() const { return chunk_elements_; }
+  std::size_t num_views() const { return views_.size(); }
+
+  // Copies [src, src + count) to the device chunk by chunk, calls kernel(hc::array<T,1>& chunk) on
+  // each chunk, and copies the results to [dst, dst + count); src == dst is fine. Both must be
+  // am_alloc-ed host memory, e.g. the data() of a pinned_vector. The kernel must submit its work
+  // to chunk.get_accelerator_view() and return the resulting completion_future, like busywork does.
+  // Blocks until all chunks are back on the host.
+  template<typename Kernel>
+  pipeline_stats run(const T* src, T* dst, std::size_t count, Kernel kernel){
+    struct chunk_ops {
+      hc::completion_future h2d, kernel, d2h;
+    };
+    std::size_t num_chunks = (count + chunk_elements_ - 1) / chunk_elements_;
+    std::vector<std::unique_ptr<hc::array<T, 1>>> chunks; // kernels may hold references until they finish
+    std::vector<chunk_ops> ops(num_chunks);
+
+    auto start = std::chrono::steady_clock::now();
+    for(std::size_t i = 0; i != num_chunks; ++i){
+      auto& view = views_[i % views_.size()];
+      T* device_ptr = buffers_[i % views_.size()];
+      std::size_t offset = i * chunk_elements_;
+      std::size_t elements = std::min(chunk_elements_, count - offset);
+      chunks.emplace_back(new hc::array<T, 1>(hc::extent<1>(elements), view, device_ptr));
+
+      ops[i].h2d = view.copy_async(src + offset, device_ptr, elements * sizeof(T));
+      ops[i].kernel = kernel(*chunks.back());
+      ops[i].d2h = view.copy_async(device_ptr, dst + offset, elements * sizeof(T));
+    }
+    for(auto& view: views_) view.create_marker().wait();
+    auto stop = std::chrono::steady_clock::now();
+
+    pipeline_stats stats;
+    stats.chunks = num_chunks;
+    stats.bytes = count * sizeof(T);
+    stats.seconds = std::chrono::duration<double>(stop - start).count();
+    for(auto& op: ops){
+      stats.h2d_seconds += elapsed(op.h2d);
+      stats.kernel_seconds += elapsed(op.kernel);
+      stats.d2h_seconds += elapsed(op.d2h);
+    }
+    return stats;
+  }
+
+  template<typename Kernel>
+  pipeline_stats run(T* data, std::size_t count, Kernel kernel){
+    return run(data, data, count, kernel);
+  }
+
+private:
+  static double elapsed(hc::completion_future& fut){
+    return 1.0 * (fut.get_end_tick() - fut.get_begin_tick()) / fut.get_tick_frequency();
+  }
+
+  void release(){
+    for(auto& view: views_) view.wait();
+    for(auto ptr: buffers_) hc::am_free(ptr);
+    buffers_.clear();
+  }
+
+  hc::accelerator acc_;
+  std::size_t chunk_elements_;
+  std::vector<hc::accelerator_view> views_;
+  std::vector<T*> buffers_;
+};
+
+} // namespace av
+
+#endif // CHUNKED_PIPELINE_HPP
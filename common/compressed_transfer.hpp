@@ -0,0 +1,389 @@
+#ifndef COMPRESSED_TRANSFER_HPP
+#define COMPRESSED_TRANSFER_HPP
+
+// Host <-> device copies that compress what they send, for data that is sparse or repetitive
+// (all zeros, a constant fill, mostly unchanged values), where the link is the bottleneck.
+//
+// Data goes in chunks, each split into blocks of 64 eight-byte words. Within a block, every word
+// is XOR-ed with the one before (the first with 0), so runs of equal values turn into zeros, and
+// the block is sent as a 64-bit mask of the non-zero deltas plus those deltas, packed. Blocks are
+// independent, so one work-item (or host thread) decodes a block; a table of per-block offsets
+// into the packed deltas goes along. A block of zeros takes 12 bytes instead of 512, a block of
+// one repeated value 20.
+//
+// upload: the host encodes chunk k (on all cores) into a pinned staging slot while chunk k-1 is
+// being copied to device scratch and decoded into place by a kernel. download: kernels encode the
+// chunk into device scratch, the header (masks and offsets) comes back first, then the packed
+// deltas, and the host decodes them into place while the next chunks are being encoded. A chunk
+// whose encoding is larger than max_ratio of the raw bytes is sent raw instead, and after two such
+// chunks in a row, only every probe_every-th chunk is tried until one compresses again, so
+// incompressible data costs little more than a staged copy. Chunks whose size isn't a multiple of
+// 8, or whose device address isn't 8-byte aligned, always go raw.
+//
+// Host memory may be anything (pageable or pinned), device memory must be of the accelerator the
+// transfer was created for.
+
+#include <hc.hpp>
+#include <hc_am.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace av {
+
+struct compressed_transfer_stats {
+  std::size_t bytes = 0;
+  std::size_t wire_bytes = 0;        // what crossed the link, headers included
+  std::size_t chunks = 0;
+  std::size_t compressed_chunks = 0; // the others went raw
+  double seconds = 0;
+
+  double ratio() const { return wire_bytes ? 1.0 * bytes / wire_bytes : 0; }
+  double gib_per_second() const { return seconds > 0 ? bytes / seconds / (1024.0 * 1024 * 1024) : 0; }
+};
+
+namespace detail {
+
+constexpr std::size_t codec_block_words = 64;
+
+// Layout of an encoded chunk of words words: offsets[blocks] (uint32, in words, padded to 8
+// bytes), masks[blocks], total (one word), then the packed deltas.
+struct codec_layout {
+  std::size_t words, blocks, offsets_bytes;
+
+  explicit codec_layout(std::size_t words)
+    : words(words), blocks((words + codec_block_words - 1) / codec_block_words),
+      offsets_bytes((blocks * sizeof(std::uint32_t) + 7) / 8 * 8) {}
+
+  std::size_t masks_at() const { return offsets_bytes; }
+  std::size_t total_at() const { return offsets_bytes + blocks * 8; }
+  std::size_t header_bytes() const { return total_at() + 8; }
+  std::size_t bytes(std::size_t packed_words) const { return header_bytes() + packed_words * 8; }
+};
+
+inline std::uint64_t load_word(const char* p){
+  std::uint64_t w;
+  std::memcpy(&w, p, 8);
+  return w;
+}
+
+// runs fn(first, last) on num ranges covering [0, count)
+template<typename Function>
+void parallel_ranges(unsigned threads, std::size_t count, Function fn){
+  threads = static_cast<unsigned>(std::min<std::size_t>(threads, count / 64 + 1));
+  std::vector<std::thread> pool;
+  for(unsigned t = 1; t < threads; ++t) pool.emplace_back(fn, count * t / threads, count * (t + 1) / threads);
+  fn(0, count / threads);
+  for(auto& thread: pool) thread.join();
+}
+
+} // namespace detail
+
+class compressed_transfer {
+public:
+  struct options {
+    std::size_t chunk_bytes = 4 * 1024 * 1024;
+    std::size_t slots = 3;         // chunks in flight
+    double max_ratio = 0.75;       // send raw if the encoding is larger than this share of the chunk
+    std::size_t probe_every = 8;   // while data doesn't compress, try every probe_every-th chunk
+    unsigned threads = 0;          // host encoder/decoder threads; 0: all cores
+  };
+
+  explicit compressed_transfer(hc::accelerator acc) : compressed_transfer(acc, options()) {}
+
+  compressed_transfer(hc::accelerator acc, const options& opts)
+    : acc_(acc), opts_(opts), view_(acc_.create_view()), copy_view_(acc_.create_view())
+  {
+    if(opts_.chunk_bytes < 8 || opts_.chunk_bytes % 8 != 0 || opts_.slots == 0 || opts_.probe_every == 0){
+      throw std::invalid_argument("compressed_transfer: chunk size must be a non-zero multiple of 8, with at least one slot");
+    }
+    if(opts_.threads == 0) opts_.threads = std::max(1u, std::thread::hardware_concurrency());
+    std::size_t slot_bytes = detail::codec_layout(opts_.chunk_bytes / 8).bytes(opts_.chunk_bytes / 8);
+    for(std::size_t i = 0; i != opts_.slots; ++i){
+      auto staging = static_cast<char*>(hc::am_alloc(slot_bytes, acc_, amHostPinned));
+      auto scratch = static_cast<char*>(hc::am_alloc(slot_bytes, acc_, 0));
+      if(staging) staging_.push_back(staging);
+      if(scratch) scratch_.push_back(scratch);
+      if(!staging || !scratch){
+        release();
+        throw std::bad_alloc();
+      }
+    }
+  }
+
+  compressed_transfer(const compressed_transfer&) = delete;
+  compressed_transfer& operator=(const compressed_transfer&) = delete;
+
+  ~compressed_transfer(){
+    view_.wait();
+    copy_view_.wait();
+    release();
+  }
+
+  // src: any host memory; dst: device memory of the accelerator. Blocks until done.
+  compressed_transfer_stats upload(const void* src, void* dst, std::size_t bytes){
+    compressed_transfer_stats stats;
+    auto start = std::chrono::steady_clock::now();
+    std::size_t num = (bytes + opts_.chunk_bytes - 1) / opts_.chunk_bytes;
+    std::vector<hc::completion_future> done(num);
+    skip_policy skip(opts_.probe_every);
+    for(std::size_t k = 0; k != num; ++k){
+      std::size_t s = k % opts_.slots;
+      if(k >= opts_.slots) done[k - opts_.slots].wait();
+      std::size_t offset = k * opts_.chunk_bytes;
+      std::size_t length = std::min(opts_.chunk_bytes, bytes - offset);
+      auto from = static_cast<const char*>(src) + offset;
+      auto to = static_cast<char*>(dst) + offset;
+      std::size_t encoded = 0;
+      if(compressible(to, length) && skip.try_chunk(k)){
+        encoded = encode(from, length / 8, staging_[s], limit(length));
+        skip.result(encoded != 0);
+      }
+      if(encoded){
+        view_.copy_async(staging_[s], scratch_[s], encoded);
+        done[k] = submit_decode(scratch_[s], reinterpret_cast<std::uint64_t*>(to), length / 8);
+        stats.wire_bytes += encoded;
+        stats.compressed_chunks++;
+      }
+      else {
+        std::memcpy(staging_[s], from, length);
+        done[k] = view_.copy_async(staging_[s], to, length);
+        stats.wire_bytes += length;
+      }
+    }
+    for(auto& f: done) f.get();
+    stats.bytes = bytes;
+    stats.chunks = num;
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return stats;
+  }
+
+  // src: device memory of the accelerator; dst: any host memory. Blocks until done.
+  compressed_transfer_stats download(const void* src, void* dst, std::size_t bytes){
+    compressed_transfer_stats stats;
+    auto start = std::chrono::steady_clock::now();
+    std::size_t num = (bytes + opts_.chunk_bytes - 1) / opts_.chunk_bytes;
+    std::vector<hc::completion_future> headers(num);
+    skip_policy skip(opts_.probe_every);
+    auto chunk = [&](std::size_t k, const char** from, char** to, std::size_t* length){
+      std::size_t offset = k * opts_.chunk_bytes;
+      *length = std::min(opts_.chunk_bytes, bytes - offset);
+      *from = static_cast<const char*>(src) + offset;
+      *to = static_cast<char*>(dst) + offset;
+    };
+    // encodes chunk k on the device, and brings its header back
+    auto submit = [&](std::size_t k){
+      const char* from; char* to; std::size_t length;
+      chunk(k, &from, &to, &length);
+      if(!compressible(from, length) || !skip.try_chunk(k)) return;
+      std::size_t s = k % opts_.slots;
+      detail::codec_layout layout(length / 8);
+      submit_encode(reinterpret_cast<const std::uint64_t*>(from), length / 8, scratch_[s]);
+      headers[k] = view_.copy_async(scratch_[s], staging_[s], layout.header_bytes());
+    };
+    for(std::size_t k = 0; k != std::min(num, opts_.slots); ++k) submit(k);
+    for(std::size_t k = 0; k != num; ++k){
+      const char* from; char* to; std::size_t length;
+      chunk(k, &from, &to, &length);
+      std::size_t s = k % opts_.slots;
+      bool compressed = false;
+      if(headers[k].valid()){
+        headers[k].get();
+        detail::codec_layout layout(length / 8);
+        std::uint64_t packed;
+        std::memcpy(&packed, staging_[s] + layout.total_at(), 8);
+        std::size_t encoded = layout.bytes(packed);
+        skip.result(encoded <= limit(length));
+        if(encoded <= limit(length)){
+          copy_view_.copy_async(scratch_[s] + layout.header_bytes(), staging_[s] + layout.header_bytes(),
+                                encoded - layout.header_bytes()).get();
+          decode(staging_[s], length / 8, to);
+          stats.wire_bytes += encoded;
+          stats.compressed_chunks++;
+          compressed = true;
+        }
+        else {
+          stats.wire_bytes += layout.header_bytes();
+        }
+      }
+      if(!compressed){
+        copy_view_.copy_async(from, staging_[s], length).get();
+        std::memcpy(to, staging_[s], length);
+        stats.wire_bytes += length;
+      }
+      if(k + opts_.slots < num) submit(k + opts_.slots);
+    }
+    stats.bytes = bytes;
+    stats.chunks = num;
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return stats;
+  }
+
+  hc::accelerator get_accelerator() const { return acc_; }
+
+private:
+  // after two chunks in a row that didn't compress, tries only every probe_every-th chunk
+  class skip_policy {
+  public:
+    explicit skip_policy(std::size_t probe_every) : probe_every_(probe_every) {}
+    bool try_chunk(std::size_t k) const { return misses_ < 2 || k % probe_every_ == 0; }
+    void result(bool compressed){ misses_ = compressed ? 0 : misses_ + 1; }
+
+  private:
+    std::size_t probe_every_;
+    std::size_t misses_ = 0;
+  };
+
+  static bool compressible(const void* device_ptr, std::size_t length){
+    return length % 8 == 0 && reinterpret_cast<std::uintptr_t>(device_ptr) % 8 == 0;
+  }
+
+  std::size_t limit(std::size_t length) const { return static_cast<std::size_t>(length * opts_.max_ratio); }
+
+  // Encodes words words from src (any alignment) into out. Returns the encoded size, or 0 if it
+  // would exceed max_bytes.
+  std::size_t encode(const char* src, std::size_t words, char* out, std::size_t max_bytes){
+    detail::codec_layout layout(words);
+    auto offsets = reinterpret_cast<std::uint32_t*>(out);
+    auto masks = reinterpret_cast<std::uint64_t*>(out + layout.masks_at());
+    // masks first, all blocks in parallel
+    detail::parallel_ranges(opts_.threads, layout.blocks, [&](std::size_t first, std::size_t last){
+        for(std::size_t b = first; b != last; ++b){
+          std::size_t begin = b * detail::codec_block_words;
+          std::size_t end = std::min(begin + detail::codec_block_words, words);
+          std::uint64_t mask = 0;
+          std::uint64_t prev = 0;
+          for(std::size_t i = begin; i != end; ++i){
+            std::uint64_t w = detail::load_word(src + i * 8);
+            mask |= std::uint64_t((w ^ prev) != 0) << (i - begin);
+            prev = w;
+          }
+          masks[b] = mask;
+        }
+      });
+    std::uint64_t total = 0;
+    for(std::size_t b = 0; b != layout.blocks; ++b){
+      offsets[b] = static_cast<std::uint32_t>(total);
+      total += __builtin_popcountll(masks[b]);
+    }
+    std::size_t bytes = layout.bytes(total);
+    if(bytes > max_bytes) return 0;
+    std::memcpy(out + layout.total_at(), &total, 8);
+    auto packed = reinterpret_cast<std::uint64_t*>(out + layout.header_bytes());
+    detail::parallel_ranges(opts_.threads, layout.blocks, [&](std::size_t first, std::size_t last){
+        for(std::size_t b = first; b != last; ++b){
+          std::size_t begin = b * detail::codec_block_words;
+          std::size_t end = std::min(begin + detail::codec_block_words, words);
+          std::uint64_t* v = packed + offsets[b];
+          std::uint64_t prev = 0;
+          for(std::size_t i = begin; i != end; ++i){
+            std::uint64_t w = detail::load_word(src + i * 8);
+            if(w != prev) *v++ = w ^ prev;
+            prev = w;
+          }
+        }
+      });
+    return bytes;
+  }
+
+  void decode(const char* in, std::size_t words, char* dst){
+    detail::codec_layout layout(words);
+    auto offsets = reinterpret_cast<const std::uint32_t*>(in);
+    auto masks = reinterpret_cast<const std::uint64_t*>(in + layout.masks_at());
+    auto packed = reinterpret_cast<const std::uint64_t*>(in + layout.header_bytes());
+    detail::parallel_ranges(opts_.threads, layout.blocks, [&](std::size_t first, std::size_t last){
+        for(std::size_t b = first; b != last; ++b){
+          std::size_t begin = b * detail::codec_block_words;
+          std::size_t end = std::min(begin + detail::codec_block_words, words);
+          const std::uint64_t* v = packed + offsets[b];
+          std::uint64_t mask = masks[b];
+          std::uint64_t w = 0;
+          for(std::size_t i = begin; i != end; ++i){
+            if(mask >> (i - begin) & 1) w ^= *v++;
+            std::memcpy(dst + i * 8, &w, 8);
+          }
+        }
+      });
+  }
+
+  hc::completion_future submit_decode(const char* scratch, std::uint64_t* dst, std::size_t words){
+    detail::codec_layout layout(words);
+    auto offsets = reinterpret_cast<const std::uint32_t*>(scratch);
+    auto masks = reinterpret_cast<const std::uint64_t*>(scratch + layout.masks_at());
+    auto packed = reinterpret_cast<const std::uint64_t*>(scratch + layout.header_bytes());
+    return hc::parallel_for_each(view_, hc::extent<1>(layout.blocks), [=](hc::index<1> idx)[[hc]]{
+        std::size_t begin = idx[0] * detail::codec_block_words;
+        std::size_t end = begin + detail::codec_block_words < words ? begin + detail::codec_block_words : words;
+        const std::uint64_t* v = packed + offsets[idx[0]];
+        std::uint64_t mask = masks[idx[0]];
+        std::uint64_t w = 0;
+        for(std::size_t i = begin; i != end; ++i){
+          if(mask >> (i - begin) & 1) w ^= *v++;
+          dst[i] = w;
+        }
+      });
+  }
+
+  // the masks, then the offsets (a sequential scan, by one work-item), then the packed deltas
+  void submit_encode(const std::uint64_t* src, std::size_t words, char* scratch){
+    detail::codec_layout layout(words);
+    auto offsets = reinterpret_cast<std::uint32_t*>(scratch);
+    auto masks = reinterpret_cast<std::uint64_t*>(scratch + layout.masks_at());
+    auto total = reinterpret_cast<std::uint64_t*>(scratch + layout.total_at());
+    auto packed = reinterpret_cast<std::uint64_t*>(scratch + layout.header_bytes());
+    std::size_t blocks = layout.blocks;
+    hc::parallel_for_each(view_, hc::extent<1>(blocks), [=](hc::index<1> idx)[[hc]]{
+        std::size_t begin = idx[0] * detail::codec_block_words;
+        std::size_t end = begin + detail::codec_block_words < words ? begin + detail::codec_block_words : words;
+        std::uint64_t mask = 0;
+        std::uint64_t prev = 0;
+        for(std::size_t i = begin; i != end; ++i){
+          mask |= std::uint64_t(src[i] != prev) << (i - begin);
+          prev = src[i];
+        }
+        masks[idx[0]] = mask;
+      });
+    hc::parallel_for_each(view_, hc::extent<1>(1), [=](hc::index<1>)[[hc]]{
+        std::uint64_t sum = 0;
+        for(std::size_t b = 0; b != blocks; ++b){
+          offsets[b] = static_cast<std::uint32_t>(sum);
+          sum += __builtin_popcountll(masks[b]);
+        }
+        *total = sum;
+      });
+    hc::parallel_for_each(view_, hc::extent<1>(blocks), [=](hc::index<1> idx)[[hc]]{
+        std::size_t begin = idx[0] * detail::codec_block_words;
+        std::size_t end = begin + detail::codec_block_words < words ? begin + detail::codec_block_words : words;
+        std::uint64_t* v = packed + offsets[idx[0]];
+        std::uint64_t prev = 0;
+        for(std::size_t i = begin; i != end; ++i){
+          if(src[i] != prev) *v++ = src[i] ^ prev;
+          prev = src[i];
+        }
+      });
+  }
+
+  void release(){
+    for(auto p: staging_) hc::am_free(p);
+    for(auto p: scratch_) hc::am_free(p);
+    staging_.clear();
+    scratch_.clear();
+  }
+
+  hc::accelerator acc_;
+  options opts_;
+  hc::accelerator_view view_;       // encode/decode kernels, and uploads
+  hc::accelerator_view copy_view_;  // download payloads, so they don't queue behind later encodes
+  std::vector<char*> staging_;      // pinned, per slot
+  std::vector<char*> scratch_;      // device, per slot
+};
+
+} // namespace av
+
+#endif // COMPRESSED_TRANSFER_HPP
@@ -0,0 +1,145 @@
+#ifndef CONTIGUOUS_COPY_HPP
+#define CONTIGUOUS_COPY_HPP
+
+// Front-end for the iterator overloads of hc::copy_async, which walk the range element by element
+// and buffer it, even for pinned_vector::begin(), making them much slower than passing data().
+//
+// av::copy_async takes the same arguments. Contiguous iterators are detected at compile time; if
+// they point into am_alloc-ed memory, the range is copied straight with the array's
+// accelerator_view::copy_async, as if data() had been passed. Other ranges, and contiguous ones in
+// pageable memory, are gathered into (or scattered from) a pinned staging block from the
+// process-wide pinned pool, which is copied with accelerator_view::copy_async. Nothing goes through
+// the global hc::copy_async, which on hcc isn't ordered with the operations on the view.
+//
+// is_contiguous_iterator is std::contiguous_iterator where the standard library has it (C++20),
+// and otherwise covers pointers (which includes std::array iterators) and the std::vector and
+// std::basic_string iterators of libstdc++ and libc++. It can be specialized for other iterators.
+
+#include <hc.hpp>
+#include <hc_am.hpp>
+#include "caching_allocator.hpp"
+
+#include <algorithm>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+
+#if __cplusplus > 201703L
+#include <version>
+#endif
+
+namespace av {
+
+#if defined(__cpp_lib_concepts)
+
+template<typename Iter>
+struct is_contiguous_iterator : std::integral_constant<bool, std::contiguous_iterator<Iter>> {};
+
+#else
+
+template<typename Iter>
+struct is_contiguous_iterator : std::false_type {};
+
+template<typename T>
+struct is_contiguous_iterator<T*> : std::true_type {};
+
+#if defined(__GLIBCXX__)
+template<typename T, typename Container>
+struct is_contiguous_iterator<__gnu_cxx::__normal_iterator<T*, Container>> : std::true_type {};
+#elif defined(_LIBCPP_VERSION)
+template<typename T>
+struct is_contiguous_iterator<std::__wrap_iter<T*>> : std::true_type {};
+#endif
+
+#endif
+
+namespace detail {
+
+template<typename T>
+bool is_am_alloced(const T* ptr, hc::accelerator acc){
+  hc::AmPointerInfo info(NULL, NULL, NULL, 0, acc, 0, 0);
+  return hc::am_memtracker_getinfo(&info, ptr) == AM_SUCCESS;
+}
+
+template<typename InputIter, typename T, int N>
+hc::completion_future copy_range_async(InputIter first, std::size_t count, hc::array<T, N>& dst, std::false_type){
+  auto& pool = caching_allocator::pinned_pool();
+  auto view = dst.get_accelerator_view();
+  // written by the host right away, so not a block the view may still be using
+  auto staging = static_cast<T*>(pool.allocate(count * sizeof(T)));
+  std::copy_n(first, count, staging);
+  auto done = view.copy_async(staging, dst.accelerator_pointer(), count * sizeof(T));
+  pool.deallocate(staging, view);
+  return done;
+}
+
+template<typename InputIter, typename T, int N>
+hc::completion_future copy_range_async(InputIter first, std::size_t count, hc::array<T, N>& dst, std::true_type){
+  const T* src = &*first;
+  if(!is_am_alloced(src, dst.get_accelerator_view().get_accelerator())){
+    return copy_range_async(first, count, dst, std::false_type());
+  }
+  return dst.get_accelerator_view().copy_async(src, dst.accelerator_pointer(), count * sizeof(T));
+}
+
+// has to wait for the copy before it can scatter, so this one returns a completed future
+template<typename OutputIter, typename T, int N>
+hc::completion_future copy_range_async(const hc::array<T, N>& src, OutputIter first, std::false_type){
+  auto& pool = caching_allocator::pinned_pool();
+  auto view = src.get_accelerator_view();
+  std::size_t count = src.get_extent().size();
+  auto staging = static_cast<T*>(pool.allocate(count * sizeof(T)));
+  auto done = view.copy_async(src.accelerator_pointer(), staging, count * sizeof(T));
+  done.wait();
+  std::copy_n(staging, count, first);
+  pool.deallocate(staging);
+  return done;
+}
+
+template<typename OutputIter, typename T, int N>
+hc::completion_future copy_range_async(const hc::array<T, N>& src, OutputIter first, std::true_type){
+  T* dst = &*first;
+  auto view = src.get_accelerator_view();
+  if(!is_am_alloced(dst, view.get_accelerator())) return copy_range_async(src, first, std::false_type());
+  return view.copy_async(src.accelerator_pointer(), dst, src.get_extent().size() * sizeof(T));
+}
+
+} // namespace detail
+
+template<typename InputIter, typename T, int N>
+hc::completion_future copy_async(InputIter src_begin, InputIter src_end, hc::array<T, N>& dst){
+  auto count = static_cast<std::size_t>(std::distance(src_begin, src_end));
+  if(count > dst.get_extent().size()){
+    throw std::out_of_range("av::copy_async: source range larger than destination array");
+  }
+  if(count == 0) return hc::completion_future();
+  return detail::copy_range_async(src_begin, count, dst, is_contiguous_iterator<InputIter>());
+}
+
+// copies as many elements as dst has
+template<typename InputIter, typename T, int N>
+hc::completion_future copy_async(InputIter src_begin, hc::array<T, N>& dst){
+  std::size_t count = dst.get_extent().size();
+  if(count == 0) return hc::completion_future();
+  return detail::copy_range_async(src_begin, count, dst, is_contiguous_iterator<InputIter>());
+}
+
+template<typename T, int N, typename OutputIter>
+hc::completion_future copy_async(const hc::array<T, N>& src, OutputIter dst_begin){
+  if(src.get_extent().size() == 0) return hc::completion_future();
+  return detail::copy_range_async(src, dst_begin, is_contiguous_iterator<OutputIter>());
+}
+
+template<typename InputIter, typename T, int N>
+void copy(InputIter src_begin, InputIter src_end, hc::array<T, N>& dst){ av::copy_async(src_begin, src_end, dst).get(); }
+
+template<typename InputIter, typename T, int N>
+void copy(InputIter src_begin, hc::array<T, N>& dst){ av::copy_async(src_begin, dst).get(); }
+
+template<typename T, int N, typename OutputIter>
+void copy(const hc::array<T, N>& src, OutputIter dst_begin){ av::copy_async(src, dst_begin).get(); }
+
+} // namespace av
+
+#endif // CONTIGUOUS_COPY_HPP
@@ -0,0 +1,244 @@
+#ifndef D2D_COPY_ENGINE_HPP
+#define D2D_COPY_ENGINE_HPP
+
+// Device-to-device copies that pick the fastest route per device pair and transfer size.
+//
+// Strategies:
+// * direct: one peer copy on a view of the source device, after mapping the destination memory to
+//   the source device with am_map_to_peers (example 05);
+// * staged: bounce through a ring of pinned host buffers; chunk k is copied device->host on the
+//   source device while chunk k-1 is copied host->device on the destination device;
+// * split: the leading part of the buffer goes direct, the rest staged, both at the same time.
+//   The split point follows the measured bandwidths of the other two.
+//
+// The first copy between a pair of devices in a given size class (powers of two) calibrates: it
+// copies the first probe_bytes of the buffer with each strategy, times them, and caches the
+// winner. Probing copies real data to its real destination, so no scratch memory is needed.
+
+#include <hc.hpp>
+#include <hc_am.hpp>
+#include "peer_mapper.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace av {
+
+enum class d2d_strategy { direct, staged, split, automatic };
+
+inline const char* to_string(d2d_strategy strategy){
+  switch(strategy){
+  case d2d_strategy::direct: return "direct";
+  case d2d_strategy::staged: return "staged";
+  case d2d_strategy::split: return "split";
+  default: return "automatic";
+  }
+}
+
+struct d2d_calibration {
+  double direct_gib_per_second = 0;  // 0 if the peer mapping failed
+  double staged_gib_per_second = 0;
+  double split_gib_per_second = 0;
+  double direct_fraction = 0;        // share of the bytes that the split strategy sends direct
+  d2d_strategy best = d2d_strategy::staged;
+};
+
+class d2d_copy_engine {
+public:
+  struct options {
+    std::size_t chunk_bytes = 4 * 1024 * 1024;   // staging chunk size
+    std::size_t staging_buffers = 3;             // pinned chunks per device pair
+    std::size_t probe_bytes = 32 * 1024 * 1024;  // calibration copies at most this much
+  };
+
+  d2d_copy_engine() : d2d_copy_engine(options()) {}
+
+  explicit d2d_copy_engine(const options& opts) : opts_(opts) {
+    if(opts_.chunk_bytes == 0 || opts_.staging_buffers < 2){
+      throw std::invalid_argument("d2d_copy_engine: need a non-zero chunk size and at least two staging buffers");
+    }
+  }
+
+  d2d_copy_engine(const d2d_copy_engine&) = delete;
+  d2d_copy_engine& operator=(const d2d_copy_engine&) = delete;
+
+  ~d2d_copy_engine(){
+    for(auto& entry: pairs_){
+      for(auto ptr: entry.second->staging) hc::am_free(ptr);
+    }
+  }
+
+  // Copies bytes from src, device memory of src_acc, to dst, device memory of dst_acc, and waits
+  // for the copy to complete. Returns the strategy that was used.
+  d2d_strategy copy(const void* src, hc::accelerator src_acc, void* dst, hc::accelerator dst_acc,
+                    std::size_t bytes, d2d_strategy strategy = d2d_strategy::automatic){
+    if(bytes == 0) return strategy;
+    auto& pair = get_pair(src_acc, dst_acc);
+    std::lock_guard<std::mutex> lock(pair.mutex);
+    if(pair.same_device){
+      pair.peer_view.copy_async(src, dst, bytes).wait();
+      return d2d_strategy::direct;
+    }
+    bool mapped = map_peer(dst, src_acc);
+    if(strategy == d2d_strategy::automatic){
+      auto& cal = calibrate(pair, src, dst, bytes, mapped);
+      strategy = cal.best;
+    }
+    if(!mapped && strategy != d2d_strategy::staged){
+      throw std::runtime_error("d2d_copy_engine: destination cannot be mapped to the source device");
+    }
+    run(pair, strategy, src, dst, bytes, direct_fraction(pair, bytes));
+    return strategy;
+  }
+
+  // Calibration results so far for a device pair, by size class (log2 of the transfer size,
+  // rounded up).
+  std::map<int, d2d_calibration> calibration(hc::accelerator src_acc, hc::accelerator dst_acc){
+    auto& pair = get_pair(src_acc, dst_acc);
+    std::lock_guard<std::mutex> lock(pair.mutex);
+    return pair.calibrations;
+  }
+
+private:
+  struct pair_state {
+    pair_state(hc::accelerator src_acc, hc::accelerator dst_acc)
+      : src_acc(src_acc), dst_acc(dst_acc), same_device(src_acc == dst_acc),
+        d2h_view(this->src_acc.create_view()), h2d_view(this->dst_acc.create_view()),
+        peer_view(this->src_acc.create_view())
+    {}
+    hc::accelerator src_acc;
+    hc::accelerator dst_acc;
+    bool same_device;
+    hc::accelerator_view d2h_view;   // staged, source side
+    hc::accelerator_view h2d_view;   // staged, destination side
+    hc::accelerator_view peer_view;  // direct
+    std::vector<char*> staging;
+    std::map<int, d2d_calibration> calibrations;
+    std::mutex mutex;
+  };
+
+  static int size_class(std::size_t bytes){
+    int bucket = 0;
+    while((std::size_t(1) << bucket) < bytes) ++bucket;
+    return bucket;
+  }
+
+  pair_state& get_pair(hc::accelerator& src_acc, hc::accelerator& dst_acc){
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto key = std::make_pair(src_acc.get_device_path(), dst_acc.get_device_path());
+    auto& pair = pairs_[key];
+    if(!pair){
+      pair.reset(new pair_state(src_acc, dst_acc));
+      for(std::size_t i = 0; i != opts_.staging_buffers && !pair->same_device; ++i){
+        auto ptr = static_cast<char*>(hc::am_alloc(opts_.chunk_bytes, src_acc, amHostPinned));
+        if(!ptr) throw std::bad_alloc();
+        pair->staging.push_back(ptr);
+      }
+    }
+    return *pair;
+  }
+
+  // idempotent and cached; the direct and split strategies need it
+  static bool map_peer(void* dst, hc::accelerator& src_acc){
+    return peer_mapper::get().ensure(dst, src_acc);
+  }
+
+  double direct_fraction(pair_state& pair, std::size_t bytes){
+    auto it = pair.calibrations.find(size_class(bytes));
+    return it != pair.calibrations.end() ? it->second.direct_fraction : 0.5;
+  }
+
+  const d2d_calibration& calibrate(pair_state& pair, const void* src, void* dst, std::size_t bytes, bool mapped){
+    auto it = pair.calibrations.find(size_class(bytes));
+    if(it != pair.calibrations.end()) return it->second;
+
+    d2d_calibration cal;
+    std::size_t probe = std::min(bytes, opts_.probe_bytes);
+    auto gib_per_second = [probe](double seconds){ return probe / seconds / (1024.0 * 1024 * 1024); };
+    cal.staged_gib_per_second = gib_per_second(time(pair, d2d_strategy::staged, src, dst, probe, 0));
+    if(mapped){
+      cal.direct_gib_per_second = gib_per_second(time(pair, d2d_strategy::direct, src, dst, probe, 0));
+      cal.direct_fraction = cal.direct_gib_per_second / (cal.direct_gib_per_second + cal.staged_gib_per_second);
+      cal.split_gib_per_second = gib_per_second(time(pair, d2d_strategy::split, src, dst, probe, cal.direct_fraction));
+    }
+    cal.best = d2d_strategy::staged;
+    double best = cal.staged_gib_per_second;
+    if(cal.direct_gib_per_second > best){
+      cal.best = d2d_strategy::direct;
+      best = cal.direct_gib_per_second;
+    }
+    if(cal.split_gib_per_second > best){
+      cal.best = d2d_strategy::split;
+    }
+    return pair.calibrations[size_class(bytes)] = cal;
+  }
+
+  double time(pair_state& pair, d2d_strategy strategy, const void* src, void* dst, std::size_t bytes,
+              double fraction){
+    auto start = std::chrono::steady_clock::now();
+    run(pair, strategy, src, dst, bytes, fraction);
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  }
+
+  void run(pair_state& pair, d2d_strategy strategy, const void* src, void* dst, std::size_t bytes,
+           double fraction){
+    switch(strategy){
+    case d2d_strategy::direct:
+      pair.peer_view.copy_async(src, dst, bytes).wait();
+      break;
+    case d2d_strategy::staged:
+      staged(pair, src, dst, bytes);
+      break;
+    default: {
+      // the direct part stays a multiple of 4 KiB, so the staged part starts page aligned
+      std::size_t direct_bytes = static_cast<std::size_t>(bytes * fraction) & ~std::size_t(4095);
+      auto direct = pair.peer_view.copy_async(src, dst, direct_bytes);
+      staged(pair, static_cast<const char*>(src) + direct_bytes, static_cast<char*>(dst) + direct_bytes,
+             bytes - direct_bytes);
+      direct.wait();
+      break;
+    }
+    }
+  }
+
+  // Chunk k goes device->host into staging buffer k % n while chunk k-1 goes host->device. A
+  // staging buffer is reused only after the host->device copy out of it has completed.
+  void staged(pair_state& pair, const void* src, void* dst, std::size_t bytes){
+    std::size_t chunk = opts_.chunk_bytes;
+    std::size_t num_chunks = (bytes + chunk - 1) / chunk;
+    std::size_t slots = pair.staging.size();
+    std::vector<hc::completion_future> d2h(num_chunks), h2d(num_chunks);
+    auto src_bytes = static_cast<const char*>(src);
+    auto dst_bytes = static_cast<char*>(dst);
+    auto upload = [&](std::size_t k){
+      d2h[k].wait();
+      std::size_t offset = k * chunk;
+      h2d[k] = pair.h2d_view.copy_async(pair.staging[k % slots], dst_bytes + offset,
+                                        std::min(chunk, bytes - offset));
+    };
+    for(std::size_t k = 0; k != num_chunks; ++k){
+      if(k >= slots) h2d[k - slots].wait();
+      std::size_t offset = k * chunk;
+      d2h[k] = pair.d2h_view.copy_async(src_bytes + offset, pair.staging[k % slots],
+                                        std::min(chunk, bytes - offset));
+      if(k >= 1) upload(k - 1);
+    }
+    if(num_chunks != 0) upload(num_chunks - 1);
+    pair.h2d_view.wait();
+  }
+
+  options opts_;
+  std::mutex mutex_;
+  std::map<std::pair<std::wstring, std::wstring>, std::unique_ptr<pair_state>> pairs_;
+};
+
+} // namespace av
+
+#endif // D2D_COPY_ENGINE_HPP
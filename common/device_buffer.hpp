@@ -0,0 +1,141 @@
+#ifndef DEVICE_BUFFER_HPP
+#define DEVICE_BUFFER_HPP
+
+// Owning wrapper around am_alloc-ed device memory, replacing the am_alloc / hc::array / am_free
+// triple from the examples.
+//
+// device_buffer<T> is move-only, like std::unique_ptr; shared_device_buffer<T> is the
+// reference-counted variant. The memory is freed when the (last) owner goes away, which must be
+// after the last operation using it has completed, same as for am_free. Buffers can also take
+// their memory from a caching_allocator, and give it back there.
+
+#include <hc.hpp>
+#include <hc_am.hpp>
+#include "caching_allocator.hpp"
+#include "peer_mapper.hpp"
+
+#include <algorithm>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+namespace av {
+
+// am_free, or return to a pool; stream-ordered if the buffer was allocated for a specific view
+struct device_deleter {
+  caching_allocator* pool = nullptr;
+  std::shared_ptr<hc::accelerator_view> view;
+
+  void operator()(void* ptr) const {
+    if(!pool) hc::am_free(ptr);
+    else if(view) pool->deallocate(ptr, *view);
+    else pool->deallocate(ptr);
+  }
+};
+
+template<typename T>
+class device_buffer {
+public:
+  device_buffer() = default;
+
+  // throws std::bad_alloc when the accelerator is out of memory
+  device_buffer(hc::accelerator acc, std::size_t count)
+    : ptr_(static_cast<T*>(hc::am_alloc(count * sizeof(T), acc, 0))), count_(count), acc_(acc)
+  {
+    if(!ptr_ && count != 0) throw std::bad_alloc();
+  }
+
+  // memory from a device memory pool, returned to the pool on destruction
+  device_buffer(caching_allocator& pool, std::size_t count)
+    : ptr_(static_cast<T*>(pool.allocate(count * sizeof(T))), device_deleter{&pool, nullptr}),
+      count_(count), acc_(pool.get_accelerator())
+  {}
+
+  // Same, with stream-ordered reuse: the memory may still be in use by operations on view when
+  // the buffer is created, and may be in use by operations queued on view when it is destroyed.
+  device_buffer(caching_allocator& pool, std::size_t count, hc::accelerator_view view)
+    : ptr_(static_cast<T*>(pool.allocate(count * sizeof(T), view)),
+           device_deleter{&pool, std::make_shared<hc::accelerator_view>(view)}),
+      count_(count), acc_(pool.get_accelerator())
+  {}
+
+  // takes ownership of memory am_alloc-ed on acc
+  device_buffer(hc::accelerator acc, T* ptr, std::size_t count)
+    : ptr_(ptr), count_(count), acc_(acc)
+  {}
+
+  device_buffer(device_buffer&& other) noexcept
+    : ptr_(std::move(other.ptr_)), count_(other.count_), acc_(other.acc_), peers_(std::move(other.peers_))
+  {
+    other.count_ = 0;
+  }
+
+  device_buffer& operator=(device_buffer&& other) noexcept {
+    ptr_ = std::move(other.ptr_);
+    count_ = other.count_;
+    acc_ = other.acc_;
+    peers_ = std::move(other.peers_);
+    other.count_ = 0;
+    return *this;
+  }
+
+  T* accelerator_pointer() const { return ptr_.get(); }
+  std::size_t size() const { return count_; }
+  std::size_t size_bytes() const { return count_ * sizeof(T); }
+  bool empty() const { return !ptr_; }
+  explicit operator bool() const { return static_cast<bool>(ptr_); }
+
+  // the accelerator the memory lives on
+  hc::accelerator get_accelerator() const { return acc_; }
+
+  // Non-owning hc::array over the whole buffer, for use in parallel_for_each on the given view. The
+  // view must be on the home accelerator, or on a peer the buffer was mapped to.
+  hc::array<T, 1> get_array(hc::accelerator_view view) const {
+    return hc::array<T, 1>(hc::extent<1>(count_), view, ptr_.get());
+  }
+
+  hc::array<T, 1> get_array() const { return get_array(acc_.get_default_view()); }
+
+  // Maps the buffer to another accelerator (am_map_to_peers), so that it can be copied to/from on
+  // that accelerator's views. Mapping twice, or mapping to the home accelerator, is a no-op.
+  bool map_to_peer(hc::accelerator peer){
+    if(is_accessible_from(peer)) return true;
+    if(!peer_mapper::get().ensure(ptr_.get(), peer)) return false;
+    peers_.push_back(peer);
+    return true;
+  }
+
+  bool is_accessible_from(const hc::accelerator& acc) const {
+    return acc == acc_ || std::find(peers_.begin(), peers_.end(), acc) != peers_.end();
+  }
+
+  const std::vector<hc::accelerator>& get_peers() const { return peers_; }
+
+  // gives up ownership; the caller is responsible for am_free, or for returning it to the pool
+  T* release(){
+    count_ = 0;
+    peers_.clear();
+    return ptr_.release();
+  }
+
+  void reset(){ *this = device_buffer(); }
+
+private:
+  std::unique_ptr<T, device_deleter> ptr_;
+  std::size_t count_ = 0;
+  hc::accelerator acc_;
+  std::vector<hc::accelerator> peers_;
+};
+
+template<typename T>
+using shared_device_buffer = std::shared_ptr<device_buffer<T>>;
+
+template<typename T>
+shared_device_buffer<T> make_shared_device_buffer(hc::accelerator acc, std::size_t count){
+  return std::make_shared<device_buffer<T>>(acc, count);
+}
+
+} // namespace av
+
+#endif // DEVICE_BUFFER_HPP
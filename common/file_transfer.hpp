@@ -0,0 +1,372 @@
+#ifndef FILE_TRANSFER_HPP
+#define FILE_TRANSFER_HPP
+
+// Loads files straight into device memory, and stores device memory to files, without a
+// full-size host buffer.
+//
+// Reading a file into a pinned_vector and then copying that to the device reads every byte twice
+// and pins as much memory as the file is large. file_transfer streams the file in chunks through a
+// few pinned staging slots: several worker threads each take the next chunk, read it from the file
+// into a free slot and submit its copy_async to the device, so the disk reads of some chunks
+// overlap each other and the DMA of others. A slot is reused once the copy out of it has
+// completed. store() is the reverse: a worker copies a chunk from the device into its slot, waits
+// for that, and writes it to the file while other workers' copies are in flight.
+//
+// The file is read in one of three ways:
+//  - direct: O_DIRECT reads into the slots, bypassing the page cache, so there is no memcpy at
+//    all; slots and file offsets are aligned to 4 KiB for that. File systems that refuse O_DIRECT
+//    (tmpfs, some overlays) get buffered reads instead, and the stats say so.
+//  - buffered: pread into the slots, one copy out of the page cache.
+//  - mapped: the file is mmap-ed, and chunks are memcpy-ed from the mapping, with the next chunks
+//    madvise-d WILLNEED so that the kernel reads ahead of the workers.
+// Writes go the same ways. Errors from the file system are thrown as std::system_error.
+
+#include <hc.hpp>
+#include <hc_am.hpp>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace av {
+
+struct file_transfer_stats {
+  std::size_t bytes = 0;
+  std::size_t chunks = 0;
+  double seconds = 0;
+  double io_seconds = 0;     // reading or writing the file, summed over the workers
+  double copy_seconds = 0;   // waiting for copies to or from the device, summed over the workers
+  bool direct = false;       // O_DIRECT was used
+
+  double gib_per_second() const { return seconds > 0 ? bytes / seconds / (1024.0 * 1024 * 1024) : 0; }
+};
+
+namespace detail {
+
+constexpr std::size_t file_alignment = 4096;
+
+inline std::size_t align_down(std::size_t n){ return n / file_alignment * file_alignment; }
+inline std::size_t align_up(std::size_t n){ return align_down(n + file_alignment - 1); }
+
+[[noreturn]] inline void throw_errno(const std::string& what){
+  throw std::system_error(errno, std::generic_category(), "file_transfer: " + what);
+}
+
+// closes on destruction
+class file_descriptor {
+public:
+  file_descriptor() = default;
+  explicit file_descriptor(int fd) : fd_(fd) {}
+  file_descriptor(const file_descriptor&) = delete;
+  file_descriptor& operator=(const file_descriptor&) = delete;
+  file_descriptor(file_descriptor&& other) noexcept : fd_(other.fd_) { other.fd_ = -1; }
+  file_descriptor& operator=(file_descriptor&& other) noexcept {
+    std::swap(fd_, other.fd_);
+    return *this;
+  }
+  ~file_descriptor(){ if(fd_ >= 0) close(fd_); }
+
+  int get() const { return fd_; }
+  explicit operator bool() const { return fd_ >= 0; }
+
+private:
+  int fd_ = -1;
+};
+
+// unmaps on destruction
+class file_mapping {
+public:
+  file_mapping(int fd, std::size_t offset, std::size_t bytes, bool writable)
+    : start_(align_down(offset)), length_(offset + bytes - align_down(offset))
+  {
+    int prot = writable ? PROT_READ | PROT_WRITE : PROT_READ;
+    ptr_ = mmap(nullptr, length_, prot, MAP_SHARED, fd, start_);
+    if(ptr_ == MAP_FAILED) throw_errno("mmap");
+    madvise(ptr_, length_, MADV_SEQUENTIAL);
+  }
+  file_mapping(const file_mapping&) = delete;
+  file_mapping& operator=(const file_mapping&) = delete;
+  ~file_mapping(){ munmap(ptr_, length_); }
+
+  // the mapped byte at file offset offset
+  char* at(std::size_t offset) const { return static_cast<char*>(ptr_) + (offset - start_); }
+
+  // asks the kernel to start reading [offset, offset + bytes)
+  void prefetch(std::size_t offset, std::size_t bytes) const {
+    std::size_t first = align_down(offset - start_);
+    std::size_t last = std::min(length_, offset - start_ + bytes);
+    if(first < last) madvise(static_cast<char*>(ptr_) + first, last - first, MADV_WILLNEED);
+  }
+
+private:
+  std::size_t start_, length_;
+  void* ptr_;
+};
+
+} // namespace detail
+
+class file_transfer {
+public:
+  enum class method { direct, buffered, mapped };
+
+  struct options {
+    std::size_t chunk_bytes = 8 * 1024 * 1024;  // rounded up to a multiple of 4 KiB
+    std::size_t slots = 6;                      // pinned staging buffers, at least workers
+    unsigned workers = 3;                       // threads reading or writing the file
+    method io = method::direct;
+  };
+
+  explicit file_transfer(hc::accelerator acc) : file_transfer(acc, options()) {}
+
+  file_transfer(hc::accelerator acc, const options& opts)
+    : acc_(acc), opts_(opts), view_(acc_.create_view())
+  {
+    if(opts_.chunk_bytes == 0 || opts_.workers == 0 || opts_.slots < opts_.workers){
+      throw std::invalid_argument("file_transfer: need a non-zero chunk size, and at least as many slots as workers");
+    }
+    opts_.chunk_bytes = detail::align_up(opts_.chunk_bytes);
+    // a chunk that starts in the middle of a 4 KiB block needs one block more for O_DIRECT
+    slot_bytes_ = opts_.chunk_bytes + detail::file_alignment;
+    block_ = static_cast<char*>(hc::am_alloc(opts_.slots * slot_bytes_ + detail::file_alignment, acc_, amHostPinned));
+    if(!block_) throw std::bad_alloc();
+    auto first = reinterpret_cast<std::uintptr_t>(block_);
+    first = (first + detail::file_alignment - 1) / detail::file_alignment * detail::file_alignment;
+    for(std::size_t i = 0; i != opts_.slots; ++i){
+      slots_.push_back(slot{reinterpret_cast<char*>(first) + i * slot_bytes_, hc::completion_future()});
+      free_.push_back(i);
+    }
+  }
+
+  file_transfer(const file_transfer&) = delete;
+  file_transfer& operator=(const file_transfer&) = delete;
+
+  ~file_transfer(){
+    view_.wait();
+    hc::am_free(block_);
+  }
+
+  static std::size_t file_size(const std::string& path){
+    struct stat st;
+    if(stat(path.c_str(), &st) != 0) detail::throw_errno("stat " + path);
+    return st.st_size;
+  }
+
+  // Reads bytes of the file at path, from offset on, into device memory dst of the accelerator.
+  // Blocks until the data is on the device.
+  file_transfer_stats load(const std::string& path, void* dst, std::size_t bytes, std::size_t offset = 0){
+    if(offset + bytes > file_size(path)) throw std::out_of_range("file_transfer: " + path + " is shorter than requested");
+    file_transfer_stats stats;
+    auto start = std::chrono::steady_clock::now();
+    auto files = open_files(path, O_RDONLY, stats);
+    std::unique_ptr<detail::file_mapping> mapping;
+    if(opts_.io == method::mapped && bytes) mapping.reset(new detail::file_mapping(files.buffered.get(), offset, bytes, false));
+
+    run(bytes, stats, [&](std::size_t k, slot& s, file_transfer_stats& local){
+        std::size_t at = offset + k * opts_.chunk_bytes;
+        std::size_t length = std::min(opts_.chunk_bytes, bytes - k * opts_.chunk_bytes);
+        if(s.pending.valid()){
+          timed(local.copy_seconds, [&]{ s.pending.get(); });
+        }
+        const char* data = s.data;
+        timed(local.io_seconds, [&]{
+            if(mapping){
+              mapping->prefetch(at + opts_.slots * opts_.chunk_bytes, opts_.chunk_bytes);
+              std::memcpy(s.data, mapping->at(at), length);
+            }
+            else if(files.direct){
+              std::size_t first = detail::align_down(at);
+              read_fully(files.direct.get(), s.data, detail::align_up(at + length) - first, first, at + length - first, path);
+              data = s.data + (at - first);
+            }
+            else read_fully(files.buffered.get(), s.data, length, at, length, path);
+          });
+        s.pending = view_.copy_async(data, static_cast<char*>(dst) + k * opts_.chunk_bytes, length);
+      });
+
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return stats;
+  }
+
+  // the whole file
+  file_transfer_stats load(const std::string& path, void* dst){ return load(path, dst, file_size(path)); }
+
+  // Writes bytes of device memory src of the accelerator to the file at path, which is created,
+  // or truncated.
+  file_transfer_stats store(const void* src, std::size_t bytes, const std::string& path){
+    file_transfer_stats stats;
+    auto start = std::chrono::steady_clock::now();
+    auto files = open_files(path, O_RDWR | O_CREAT | O_TRUNC, stats);
+    if(ftruncate(files.buffered.get(), bytes) != 0) detail::throw_errno("ftruncate " + path);
+    std::unique_ptr<detail::file_mapping> mapping;
+    if(opts_.io == method::mapped && bytes) mapping.reset(new detail::file_mapping(files.buffered.get(), 0, bytes, true));
+
+    run(bytes, stats, [&](std::size_t k, slot& s, file_transfer_stats& local){
+        std::size_t at = k * opts_.chunk_bytes;
+        std::size_t length = std::min(opts_.chunk_bytes, bytes - at);
+        timed(local.copy_seconds, [&]{ view_.copy_async(static_cast<const char*>(src) + at, s.data, length).get(); });
+        timed(local.io_seconds, [&]{
+            if(mapping) std::memcpy(mapping->at(at), s.data, length);
+            // O_DIRECT needs whole blocks; the last chunk may end within one
+            else if(files.direct && length % detail::file_alignment == 0) write_fully(files.direct.get(), s.data, length, at, path);
+            else write_fully(files.buffered.get(), s.data, length, at, path);
+          });
+      });
+
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return stats;
+  }
+
+  hc::accelerator get_accelerator() const { return acc_; }
+  std::size_t pinned_bytes() const { return opts_.slots * slot_bytes_; }
+
+private:
+  struct slot {
+    char* data;
+    hc::completion_future pending;  // the copy out of data (loads)
+  };
+
+  struct open_file_pair {
+    detail::file_descriptor buffered;
+    detail::file_descriptor direct;  // O_DIRECT, if asked for and supported
+  };
+
+  open_file_pair open_files(const std::string& path, int flags, file_transfer_stats& stats){
+    open_file_pair files;
+    files.buffered = detail::file_descriptor(open(path.c_str(), flags, 0644));
+    if(!files.buffered) detail::throw_errno("open " + path);
+    if(opts_.io == method::direct){
+      files.direct = detail::file_descriptor(open(path.c_str(), (flags & ~(O_CREAT | O_TRUNC)) | O_DIRECT));
+      stats.direct = static_cast<bool>(files.direct);
+    }
+    return files;
+  }
+
+  // reads at least needed of the bytes at offset into data; O_DIRECT reads of the last block stop
+  // at the end of the file
+  static void read_fully(int fd, char* data, std::size_t bytes, std::size_t offset, std::size_t needed,
+                         const std::string& path){
+    std::size_t done = 0;
+    while(done < needed){
+      auto n = pread(fd, data + done, bytes - done, offset + done);
+      if(n < 0 && errno == EINTR) continue;
+      if(n < 0) detail::throw_errno("read " + path);
+      if(n == 0) throw std::runtime_error("file_transfer: " + path + " ended early");
+      done += n;
+    }
+  }
+
+  static void write_fully(int fd, const char* data, std::size_t bytes, std::size_t offset, const std::string& path){
+    std::size_t done = 0;
+    while(done < bytes){
+      auto n = pwrite(fd, data + done, bytes - done, offset + done);
+      if(n < 0 && errno == EINTR) continue;
+      if(n < 0) detail::throw_errno("write " + path);
+      done += n;
+    }
+  }
+
+  template<typename Function>
+  static void timed(double& seconds, Function fn){
+    auto start = std::chrono::steady_clock::now();
+    fn();
+    seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  }
+
+  // chunk(k, slot, stats) for every chunk of bytes, on the workers, each chunk with a free slot
+  template<typename Chunk>
+  void run(std::size_t bytes, file_transfer_stats& stats, Chunk chunk){
+    std::size_t num = (bytes + opts_.chunk_bytes - 1) / opts_.chunk_bytes;
+    std::atomic<std::size_t> next(0);
+    std::atomic<bool> failed(false);
+    std::exception_ptr error;
+    std::mutex error_mutex;
+
+    auto work = [&]{
+      file_transfer_stats local;
+      for(std::size_t k; !failed && (k = next++) < num;){
+        std::size_t i = take_slot();
+        try {
+          chunk(k, slots_[i], local);
+        }
+        catch(...){
+          std::lock_guard<std::mutex> lock(error_mutex);
+          if(!error) error = std::current_exception();
+          failed = true;
+        }
+        give_slot(i);
+      }
+      std::lock_guard<std::mutex> lock(error_mutex);
+      stats.io_seconds += local.io_seconds;
+      stats.copy_seconds += local.copy_seconds;
+    };
+    unsigned workers = static_cast<unsigned>(std::min<std::size_t>(opts_.workers, num));
+    std::vector<std::thread> pool;
+    for(unsigned t = 1; t < workers; ++t) pool.emplace_back(work);
+    if(workers) work();
+    for(auto& thread: pool) thread.join();
+
+    // the last copies out of the slots
+    for(auto& s: slots_){
+      if(!s.pending.valid()) continue;
+      try {
+        s.pending.get();
+      }
+      catch(...){
+        if(!error) error = std::current_exception();
+      }
+      s.pending = hc::completion_future();
+    }
+    if(error) std::rethrow_exception(error);
+    stats.bytes = bytes;
+    stats.chunks = num;
+  }
+
+  std::size_t take_slot(){
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [this]{ return !free_.empty(); });
+    std::size_t i = free_.back();
+    free_.pop_back();
+    return i;
+  }
+
+  void give_slot(std::size_t i){
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      free_.insert(free_.begin(), i);  // least recently used first, so its copy is most likely done
+    }
+    cv_.notify_one();
+  }
+
+  hc::accelerator acc_;
+  options opts_;
+  hc::accelerator_view view_;
+  std::size_t slot_bytes_;
+  char* block_;
+  std::vector<slot> slots_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::vector<std::size_t> free_;  // indices into slots_, taken from the back
+};
+
+} // namespace av
+
+#endif // FILE_TRANSFER_HPP
@@ -0,0 +1,275 @@
+#ifndef IPC_HPP
+#define IPC_HPP
+
+// Sharing device buffers between processes on one node, so that data is uploaded once and then
+// used by every process, instead of each process uploading (and holding) a copy of its own.
+//
+//   loader:                                          every worker:
+//     auto table = shared_object<T>::create(name);     auto table = shared_object<T>::open(name);
+//     table->data = ipc_export(ptr, bytes);            table->uploaded.wait(1);
+//     table->uploaded.signal_on(upload_future, 1);     ipc_mapping data(table->data, acc);
+//     table->done.wait(workers);                       ... data.get() in copy_async and kernels ...
+//                                                      table->done.advance();
+//
+// ipc_export() turns an allocation into a handle, which is plain bytes and can go to the other
+// process through any channel; ipc_mapping maps it there (and unmaps it when destroyed). On ROCm
+// this is hsa_amd_ipc_memory_create/attach/detach, with the mapping added to (and removed from)
+// the memory tracker as device memory of acc, which copy_async needs. The host backend stands in
+// with POSIX shared memory (hc::am_ipc_memory_*): exporting moves the allocation into a shared
+// memory object in place, so nothing may be writing to it during the first export. Either way,
+// ptr must be the base of an am_alloc-ed block, not memory registered with am_memory_host_lock.
+//
+// shared_object<T> is a named block of shared memory holding a T: the table through which the
+// handles and the signalling go. ipc_event is a counter in shared memory that processes wait on
+// (a futex, so waiting doesn't spin); signal_on() sets it when a completion_future completes, which
+// is how a process learns that another one's copy or kernel is done.
+
+#include <hc.hpp>
+#include <hc_am.hpp>
+#include "async_task.hpp"
+#if !defined(HC_HOST_BACKEND)
+#include <hsa/hsa_ext_amd.h>
+#endif
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace av {
+
+struct ipc_memory_handle {
+#if defined(HC_HOST_BACKEND)
+  hc::am_ipc_memory_handle handle;
+#else
+  hsa_amd_ipc_memory_t handle;
+#endif
+  std::uint64_t size;
+};
+
+// a handle for the first bytes of the allocation ptr is the base of; throws if it can't be shared
+inline ipc_memory_handle ipc_export(void* ptr, std::size_t bytes){
+  ipc_memory_handle h{};
+  h.size = bytes;
+#if defined(HC_HOST_BACKEND)
+  bool ok = hc::am_ipc_memory_create(ptr, bytes, &h.handle) == AM_SUCCESS;
+#else
+  bool ok = hsa_amd_ipc_memory_create(ptr, bytes, &h.handle) == HSA_STATUS_SUCCESS;
+#endif
+  if(!ok) throw std::runtime_error("ipc_export: can't share this memory");
+  return h;
+}
+
+// An exported allocation, mapped into this process and accessible from acc.
+class ipc_mapping {
+public:
+  ipc_mapping(const ipc_memory_handle& h, hc::accelerator acc) : size_(h.size) {
+#if defined(HC_HOST_BACKEND)
+    bool ok = hc::am_ipc_memory_attach(&h.handle, acc, &ptr_) == AM_SUCCESS;
+#else
+    auto agent = *static_cast<hsa_agent_t*>(acc.get_hsa_agent());
+    bool ok = hsa_amd_ipc_memory_attach(&h.handle, h.size, 1, &agent, &ptr_) == HSA_STATUS_SUCCESS;
+    if(ok){
+      // so that the view's copy_async knows it for device memory of acc, as it does for am_alloc
+      hc::AmPointerInfo info(nullptr, ptr_, ptr_, size_, acc, true, false);
+      hc::am_memtracker_add(ptr_, info);
+    }
+#endif
+    if(!ok) throw std::runtime_error("ipc_mapping: can't attach to the shared memory");
+  }
+
+  ipc_mapping(const ipc_mapping&) = delete;
+  ipc_mapping& operator=(const ipc_mapping&) = delete;
+
+  ipc_mapping(ipc_mapping&& other) noexcept : ptr_(other.ptr_), size_(other.size_) { other.ptr_ = nullptr; }
+
+  ipc_mapping& operator=(ipc_mapping&& other) noexcept {
+    std::swap(ptr_, other.ptr_);
+    std::swap(size_, other.size_);
+    return *this;
+  }
+
+  ~ipc_mapping(){
+    if(!ptr_) return;
+#if defined(HC_HOST_BACKEND)
+    hc::am_ipc_memory_detach(ptr_);
+#else
+    hc::am_memtracker_remove(ptr_);
+    hsa_amd_ipc_memory_detach(ptr_);
+#endif
+  }
+
+  void* get() const { return ptr_; }
+  std::size_t size() const { return size_; }
+
+private:
+  void* ptr_ = nullptr;
+  std::size_t size_;
+};
+
+namespace detail {
+
+[[noreturn]] inline void throw_ipc_errno(const std::string& what){
+  throw std::system_error(errno, std::generic_category(), what);
+}
+
+// futex on a word in memory shared between processes (so not FUTEX_PRIVATE)
+inline void futex_wait(std::atomic<std::uint32_t>* word, std::uint32_t expected, std::chrono::nanoseconds timeout){
+  static_assert(sizeof(std::atomic<std::uint32_t>) == sizeof(std::uint32_t), "futex needs a plain 32-bit word");
+  auto s = std::chrono::duration_cast<std::chrono::seconds>(timeout);
+  timespec ts{static_cast<time_t>(s.count()), static_cast<long>((timeout - s).count())};
+  syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(word), FUTEX_WAIT, expected, &ts, nullptr, 0);
+}
+
+inline void futex_wake_all(std::atomic<std::uint32_t>* word){
+  syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(word), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
+
+} // namespace detail
+
+// A counter that only goes up, for processes to wait on. Lives in shared memory (inside a
+// shared_object); it must not move once other processes use it.
+class ipc_event {
+public:
+  ipc_event() = default;
+  ipc_event(const ipc_event&) = delete;
+  ipc_event& operator=(const ipc_event&) = delete;
+
+  // raises the value to at least value
+  void signal(std::uint32_t value){
+    auto current = value_.load();
+    while(current < value && !value_.compare_exchange_weak(current, value)){}
+    detail::futex_wake_all(&value_);
+  }
+
+  void advance(std::uint32_t n = 1){
+    value_.fetch_add(n);
+    detail::futex_wake_all(&value_);
+  }
+
+  std::uint32_t value() const { return value_.load(); }
+
+  // until the value is at least value; false on timeout
+  template<typename Rep = std::chrono::hours::rep, typename Period = std::chrono::hours::period>
+  bool wait(std::uint32_t value, std::chrono::duration<Rep, Period> timeout = std::chrono::hours(24 * 365)) const {
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    for(;;){
+      auto current = value_.load();
+      if(current >= value) return true;
+      auto left = deadline - std::chrono::steady_clock::now();
+      if(left <= left.zero()) return false;
+      detail::futex_wait(&value_, current, std::chrono::duration_cast<std::chrono::nanoseconds>(left));
+    }
+  }
+
+  // signal(value) from the reactor (async_task.hpp) once fut has completed; the event must still
+  // be there by then
+  void signal_on(hc::completion_future fut, std::uint32_t value){
+    reactor::get().watch(std::move(fut), [this, value]{ signal(value); });
+  }
+
+private:
+  mutable std::atomic<std::uint32_t> value_{0};
+};
+
+// A T in a named POSIX shared memory object. create() makes it (value-initialized) and removes
+// the name again when destroyed, open() waits for it to have been created. T must be usable from
+// several processes at once: no pointers, no heap, only lock-free atomics.
+template<typename T>
+class shared_object {
+public:
+  static shared_object create(const std::string& name){
+    int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if(fd < 0) detail::throw_ipc_errno("shm_open " + name);
+    if(ftruncate(fd, sizeof(block)) != 0){
+      close(fd);
+      shm_unlink(name.c_str());
+      detail::throw_ipc_errno("ftruncate " + name);
+    }
+    shared_object result(name, fd, true);
+    new(&result.block_->value) T();
+    result.block_->ready.store(ready_magic, std::memory_order_release);
+    return result;
+  }
+
+  template<typename Rep = std::chrono::seconds::rep, typename Period = std::chrono::seconds::period>
+  static shared_object open(const std::string& name, std::chrono::duration<Rep, Period> timeout = std::chrono::seconds(30)){
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    for(;;){
+      int fd = shm_open(name.c_str(), O_RDWR, 0);
+      struct stat st;
+      if(fd >= 0 && fstat(fd, &st) == 0 && static_cast<std::size_t>(st.st_size) >= sizeof(block)){
+        shared_object result(name, fd, false);
+        while(result.block_->ready.load(std::memory_order_acquire) != ready_magic){
+          if(std::chrono::steady_clock::now() > deadline) throw std::runtime_error("shared_object: " + name + " not ready");
+          std::this_thread::yield();
+        }
+        return result;
+      }
+      if(fd >= 0) close(fd);
+      if(std::chrono::steady_clock::now() > deadline) throw std::runtime_error("shared_object: no " + name);
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  }
+
+  shared_object(const shared_object&) = delete;
+  shared_object& operator=(const shared_object&) = delete;
+
+  shared_object(shared_object&& other) noexcept
+    : name_(std::move(other.name_)), block_(other.block_), owner_(other.owner_)
+  {
+    other.block_ = nullptr;
+    other.owner_ = false;
+  }
+
+  ~shared_object(){
+    if(block_) munmap(block_, sizeof(block));
+    if(owner_) shm_unlink(name_.c_str());
+  }
+
+  T* get() const { return &block_->value; }
+  T* operator->() const { return get(); }
+  T& operator*() const { return *get(); }
+  const std::string& name() const { return name_; }
+
+private:
+  static constexpr std::uint32_t ready_magic = 0x61767368; // "avsh"
+
+  struct block {
+    std::atomic<std::uint32_t> ready;
+    T value;
+  };
+
+  shared_object(const std::string& name, int fd, bool owner) : name_(name), owner_(owner) {
+    void* p = mmap(nullptr, sizeof(block), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(p == MAP_FAILED){
+      if(owner) shm_unlink(name.c_str());
+      detail::throw_ipc_errno("mmap " + name);
+    }
+    block_ = static_cast<block*>(p);
+  }
+
+  std::string name_;
+  block* block_ = nullptr;
+  bool owner_;
+};
+
+} // namespace av
+
+#endif // IPC_HPP
@@ -0,0 +1,36 @@
+#ifndef JSON_HPP
+#define JSON_HPP
+
+// Helpers for the JSON that trace.hpp and metrics.hpp write by hand.
+
+#include <cstdio>
+#include <string>
+
+namespace av {
+
+// s as the contents of a JSON string: quotes, backslashes and control characters escaped
+inline std::string json_escape(const std::string& s){
+  std::string out;
+  out.reserve(s.size());
+  for(char c: s){
+    switch(c){
+    case '"': out += "\\\""; break;
+    case '\\': out += "\\\\"; break;
+    case '\n': out += "\\n"; break;
+    case '\r': out += "\\r"; break;
+    case '\t': out += "\\t"; break;
+    default:
+      if(static_cast<unsigned char>(c) < 0x20){
+        char code[8];
+        std::snprintf(code, sizeof(code), "\\u%04x", static_cast<unsigned>(c));
+        out += code;
+      }
+      else out += c;
+    }
+  }
+  return out;
+}
+
+} // namespace av
+
+#endif // JSON_HPP
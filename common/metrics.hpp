@@ -0,0 +1,332 @@
+#ifndef METRICS_HPP
+#define METRICS_HPP
+
+// Process-wide registry of timings and counters, by hierarchical scope name.
+//
+//   {
+//     av::metrics::scope s("upload");            // nests: inside "step", this is "step/upload"
+//     s.add_bytes(bytes);                        // throughput per scope
+//     auto done = av::metrics::timed("copy_async", [&]{ return view.copy_async(src, dst, bytes); }, bytes);
+//   }
+//   av::metrics::count("retries");
+//
+// Every scope keeps count, total, min, max and a histogram (powers of two of nanoseconds) of its
+// durations, and the bytes attributed to it. timed() runs a call under a scope; if the call
+// returns a completion_future, the host time of the call goes into <name>/submit, and once the
+// operation has completed, the time it waited in the queue into <name>/queue and its execution
+// into <name>/exec, from the future's ticks. That separates the cost of submitting a copy from the
+// DMA itself, which a wall-clock timer around the call can't. The registry keeps the future and
+// reads its ticks later, when it is ready by the time another one is added, or in flush(), which
+// the dumps call; not with completion_future::then, which on hcc makes destroying the future wait
+// for the operation.
+//
+// The clock is steady_clock. dump_text() and dump_json() print everything; with AV_METRICS set in
+// the environment, the text goes to stderr at exit, and with AV_METRICS_JSON=<file>, the JSON goes
+// to that file. enabled() tells whether either is set, for callers that only want to pay for
+// timed() (which keeps the future until it is ready) when the result is printed.
+
+#include <hc.hpp>
+#include "json.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace av {
+namespace metrics {
+
+using clock = std::chrono::steady_clock;
+
+struct scope_stats {
+  static constexpr int buckets = 48;  // bucket b: [2^b, 2^(b+1)) nanoseconds; bucket 0 includes 0
+
+  std::uint64_t count = 0;
+  double total_seconds = 0;
+  double min_seconds = std::numeric_limits<double>::infinity();
+  double max_seconds = 0;
+  std::uint64_t bytes = 0;
+  std::uint64_t histogram[buckets] = {};
+
+  void add(double seconds){
+    ++count;
+    total_seconds += seconds;
+    min_seconds = std::min(min_seconds, seconds);
+    max_seconds = std::max(max_seconds, seconds);
+    auto ns = static_cast<std::uint64_t>(std::max(seconds, 0.0) * 1e9);
+    int b = 0;
+    while(b + 1 < buckets && (ns >> (b + 1)) != 0) ++b;
+    ++histogram[b];
+  }
+
+  double mean_seconds() const { return count ? total_seconds / count : 0; }
+  double gib_per_second() const { return total_seconds > 0 ? bytes / total_seconds / (1024.0 * 1024 * 1024) : 0; }
+};
+
+// whether AV_METRICS or AV_METRICS_JSON is set, i.e. whether anything will be dumped at exit
+inline bool enabled(){
+  static const bool on = std::getenv("AV_METRICS") || std::getenv("AV_METRICS_JSON");
+  return on;
+}
+
+namespace detail {
+
+inline std::vector<std::string>& scope_stack(){
+  thread_local std::vector<std::string> stack;
+  return stack;
+}
+
+} // namespace detail
+
+class registry {
+public:
+  // never destroyed, so it can be used from static destructors and atexit handlers
+  static registry& get(){
+    static auto instance = new registry();
+    return *instance;
+  }
+
+  // the full name of name, inside the scopes open on this thread
+  static std::string path(const std::string& name){
+    auto& stack = detail::scope_stack();
+    return stack.empty() ? name : stack.back() + "/" + name;
+  }
+
+  void record(const std::string& path, double seconds, std::uint64_t bytes = 0){
+    std::lock_guard<std::mutex> lock(mutex_);
+    record_locked(path, seconds, bytes);
+  }
+
+  // Records the queue wait and execution time of fut under path/queue and path/exec once it has
+  // completed; submitted is the system tick just before it was submitted.
+  void record_device_times(const std::string& path, hc::completion_future fut, std::uint64_t submitted,
+                           std::uint64_t bytes = 0){
+    if(!fut.valid()) return;
+    std::lock_guard<std::mutex> lock(mutex_);
+    pending_.push_back(pending_times{path, fut, submitted, bytes});
+    // the ones that have completed in the meantime, so that the list doesn't grow
+    auto still_running = std::partition(pending_.begin(), pending_.end(),
+                                        [](pending_times& p){ return !p.fut.is_ready(); });
+    for(auto it = still_running; it != pending_.end(); ++it) record_locked(*it);
+    pending_.erase(still_running, pending_.end());
+  }
+
+  // waits for the operations passed to record_device_times so far, and records their times
+  void flush(){
+    std::vector<pending_times> pending;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      pending.swap(pending_);
+    }
+    for(auto& p: pending) p.fut.wait();
+    std::lock_guard<std::mutex> lock(mutex_);
+    for(auto& p: pending) record_locked(p);
+  }
+
+  void count(const std::string& path, std::int64_t n = 1){
+    std::lock_guard<std::mutex> lock(mutex_);
+    counters_[path] += n;
+  }
+
+  // after flush()
+  std::map<std::string, scope_stats> scopes(){
+    flush();
+    std::lock_guard<std::mutex> lock(mutex_);
+    return scopes_;
+  }
+
+  std::map<std::string, std::int64_t> counters() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return counters_;
+  }
+
+  void clear(){
+    std::lock_guard<std::mutex> lock(mutex_);
+    pending_.clear();
+    scopes_.clear();
+    counters_.clear();
+  }
+
+  // one line per scope, indented by nesting depth
+  void dump_text(std::ostream& out){
+    auto scopes = this->scopes();
+    auto counters = this->counters();
+    auto flags = out.flags();
+    out << std::left << std::setw(48) << "scope" << std::right << std::setw(8) << "count" << std::setw(12) << "total s"
+        << std::setw(12) << "mean ms" << std::setw(12) << "min ms" << std::setw(12) << "max ms" << std::setw(12)
+        << "GiB/s" << '\n';
+    std::string previous;
+    for(auto& entry: scopes){
+      auto& name = entry.first;
+      auto& s = entry.second;
+      // parents that only have children recorded (like those of timed()) get a line of their own
+      for(auto slash = name.find('/'); slash != std::string::npos; slash = name.find('/', slash + 1)){
+        auto parent = name.substr(0, slash);
+        if(scopes.count(parent) == 0 && previous.compare(0, slash + 1, parent + "/") != 0) out << indented(parent) << '\n';
+      }
+      previous = name;
+      out << std::left << std::setw(48) << indented(name) << std::right << std::setw(8) << s.count
+          << std::setw(12) << s.total_seconds << std::setw(12) << s.mean_seconds() * 1e3 << std::setw(12)
+          << s.min_seconds * 1e3 << std::setw(12) << s.max_seconds * 1e3 << std::setw(12);
+      if(s.bytes) out << s.gib_per_second();
+      else out << "";
+      out << '\n';
+    }
+    for(auto& entry: counters) out << std::left << std::setw(48) << entry.first << std::right << std::setw(8) << entry.second << '\n';
+    out.flags(flags);
+  }
+
+  void dump_json(std::ostream& out){
+    auto scopes = this->scopes();
+    auto counters = this->counters();
+    out << "{\"scopes\": {";
+    bool first = true;
+    for(auto& entry: scopes){
+      auto& s = entry.second;
+      out << (first ? "\n" : ",\n") << "  \"" << json_escape(entry.first) << "\": {\"count\": " << s.count
+          << ", \"total_seconds\": " << s.total_seconds << ", \"min_seconds\": " << s.min_seconds
+          << ", \"max_seconds\": " << s.max_seconds << ", \"bytes\": " << s.bytes << ", \"histogram_ns_log2\": [";
+      int last = scope_stats::buckets - 1;
+      while(last > 0 && s.histogram[last] == 0) --last;
+      for(int b = 0; b <= last; ++b) out << (b ? ", " : "") << s.histogram[b];
+      out << "]}";
+      first = false;
+    }
+    out << "\n}, \"counters\": {";
+    first = true;
+    for(auto& entry: counters){
+      out << (first ? "\n" : ",\n") << "  \"" << json_escape(entry.first) << "\": " << entry.second;
+      first = false;
+    }
+    out << "\n}}\n";
+  }
+
+private:
+  struct pending_times {
+    std::string path;
+    hc::completion_future fut;
+    std::uint64_t submitted;
+    std::uint64_t bytes;
+  };
+
+  void record_locked(const std::string& path, double seconds, std::uint64_t bytes){
+    auto& s = scopes_[path];
+    s.add(seconds);
+    s.bytes += bytes;
+  }
+
+  void record_locked(pending_times& p){
+    double frequency = p.fut.get_tick_frequency();
+    auto begin = p.fut.get_begin_tick();
+    auto end = p.fut.get_end_tick();
+    record_locked(p.path + "/queue", begin > p.submitted ? (begin - p.submitted) / frequency : 0, 0);
+    record_locked(p.path + "/exec", (end - begin) / frequency, p.bytes);
+  }
+
+  // the last component of path, indented by its depth
+  static std::string indented(const std::string& path){
+    auto slash = path.rfind('/');
+    auto depth = std::count(path.begin(), path.end(), '/');
+    return std::string(2 * depth, ' ') + (slash == std::string::npos ? path : path.substr(slash + 1));
+  }
+
+  registry(){
+    if(enabled()) std::atexit(dump_at_exit);
+  }
+
+  static void dump_at_exit(){
+    if(std::getenv("AV_METRICS")) get().dump_text(std::cerr);
+    if(auto file = std::getenv("AV_METRICS_JSON")){
+      std::ofstream out(file);
+      get().dump_json(out);
+    }
+  }
+
+  mutable std::mutex mutex_;
+  std::map<std::string, scope_stats> scopes_;
+  std::map<std::string, std::int64_t> counters_;
+  std::vector<pending_times> pending_;
+};
+
+// Times its lifetime under name, nested inside the scopes open on this thread.
+class scope {
+public:
+  explicit scope(const std::string& name, std::uint64_t bytes = 0)
+    : path_(registry::path(name)), bytes_(bytes), start_(clock::now())
+  {
+    detail::scope_stack().push_back(path_);
+  }
+
+  scope(const scope&) = delete;
+  scope& operator=(const scope&) = delete;
+
+  ~scope(){
+    detail::scope_stack().pop_back();
+    registry::get().record(path_, seconds(), bytes_);
+  }
+
+  void add_bytes(std::uint64_t bytes){ bytes_ += bytes; }
+  double seconds() const { return std::chrono::duration<double>(clock::now() - start_).count(); }
+  const std::string& path() const { return path_; }
+
+private:
+  std::string path_;
+  std::uint64_t bytes_;
+  clock::time_point start_;
+};
+
+inline void count(const std::string& name, std::int64_t n = 1){ registry::get().count(registry::path(name), n); }
+
+// see registry::record_device_times
+inline void record_device_times(const std::string& path, hc::completion_future fut, std::uint64_t submitted,
+                                std::uint64_t bytes = 0){
+  registry::get().record_device_times(path, std::move(fut), submitted, bytes);
+}
+
+namespace detail {
+
+template<typename Result>
+struct timed_call {
+  template<typename Function>
+  static Result run(const std::string& name, Function& fn, std::uint64_t bytes){
+    scope s(name, bytes);
+    return fn();
+  }
+};
+
+template<>
+struct timed_call<hc::completion_future> {
+  template<typename Function>
+  static hc::completion_future run(const std::string& name, Function& fn, std::uint64_t bytes){
+    std::string path = registry::path(name);
+    auto submitted = hc::get_system_ticks();
+    auto start = clock::now();
+    hc::completion_future fut = fn();
+    registry::get().record(path + "/submit", std::chrono::duration<double>(clock::now() - start).count());
+    record_device_times(path, fut, submitted, bytes);
+    return fut;
+  }
+};
+
+} // namespace detail
+
+// fn() under name; see the top of the file for what is recorded when it returns a completion_future
+template<typename Function>
+auto timed(const std::string& name, Function fn, std::uint64_t bytes = 0) -> decltype(fn()){
+  return detail::timed_call<decltype(fn())>::run(name, fn, bytes);
+}
+
+} // namespace metrics
+} // namespace av
+
+#endif // METRICS_HPP
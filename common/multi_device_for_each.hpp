@@ -0,0 +1,146 @@
+#ifndef MULTI_DEVICE_FOR_EACH_HPP
+#define MULTI_DEVICE_FOR_EACH_HPP
+
+// An elementwise parallel_for_each over host data, spread over several accelerators.
+//
+// The index range is cut in tiles, and each device starts out with a contiguous share of them in
+// its own deque. A host thread per device drives a few in-flight slots, each with its own view and
+// tile-sized device buffer: copy the tile in, run the kernel on it, copy it back out. Slots on one
+// device overlap each other, so scatter and gather of some tiles overlap with compute on others.
+// A device takes tiles from the front of its own deque; when that is empty, it steals from the
+// back of the fullest other deque, so fast devices end up doing more tiles than slow ones.
+
+#include <hc.hpp>
+#include <hc_am.hpp>
+#include "device_buffer.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace av {
+
+struct multi_device_options {
+  std::size_t tile_elements = 4 * 1024 * 1024;
+  std::size_t slots_per_device = 3;
+};
+
+struct multi_device_stats {
+  double seconds = 0;
+  std::vector<std::size_t> tiles;   // per device, tiles processed
+  std::vector<std::size_t> stolen;  // per device, tiles taken from another device's deque
+};
+
+namespace detail {
+
+class tile_deques {
+public:
+  tile_deques(std::size_t num_tiles, std::size_t num_devices) : deques_(num_devices) {
+    for(std::size_t t = 0; t != num_tiles; ++t){
+      deques_[t * num_devices / num_tiles].push_back(t);
+    }
+  }
+
+  // false when there is nothing left anywhere
+  bool claim(std::size_t device, std::size_t& tile, bool& stolen){
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& own = deques_[device];
+    if(!own.empty()){
+      tile = own.front();
+      own.pop_front();
+      stolen = false;
+      return true;
+    }
+    auto victim = std::max_element(deques_.begin(), deques_.end(),
+                                   [](const std::deque<std::size_t>& a, const std::deque<std::size_t>& b){
+                                     return a.size() < b.size();
+                                   });
+    if(victim->empty()) return false;
+    tile = victim->back();
+    victim->pop_back();
+    stolen = true;
+    return true;
+  }
+
+private:
+  std::mutex mutex_;
+  std::vector<std::deque<std::size_t>> deques_;
+};
+
+} // namespace detail
+
+// For every i in [0, count): out[i] = in[i], after kernel(out[i], i) on one of the devices.
+// kernel is called on the device, so it must be [[hc]]. in and out must be am_alloc-ed host memory
+// (e.g. pinned_vector::data()) and may be the same.
+template<typename T, typename Kernel>
+multi_device_stats multi_device_for_each(std::vector<hc::accelerator> devices, const T* in, T* out,
+                                         std::size_t count, Kernel kernel,
+                                         const multi_device_options& opts = multi_device_options()){
+  if(devices.empty() || opts.tile_elements == 0 || opts.slots_per_device == 0){
+    throw std::invalid_argument("multi_device_for_each: need devices, and non-zero tile size and slot count");
+  }
+  std::size_t num_tiles = (count + opts.tile_elements - 1) / opts.tile_elements;
+  detail::tile_deques tiles(num_tiles, devices.size());
+  multi_device_stats stats;
+  stats.tiles.assign(devices.size(), 0);
+  stats.stolen.assign(devices.size(), 0);
+  std::vector<std::exception_ptr> errors(devices.size());
+
+  auto drive = [&](std::size_t dev){
+    struct slot {
+      slot(hc::accelerator& acc, std::size_t elements) : view(acc.create_view()), buffer(acc, elements) {}
+      hc::accelerator_view view;
+      device_buffer<T> buffer;
+      hc::completion_future done;
+    };
+    std::vector<slot> slots;
+    slots.reserve(opts.slots_per_device);
+    try {
+      for(std::size_t s = 0; s != opts.slots_per_device; ++s){
+        slots.emplace_back(devices[dev], opts.tile_elements);
+      }
+      std::size_t tile;
+      bool stolen;
+      for(std::size_t i = 0; tiles.claim(dev, tile, stolen); ++i){
+        auto& s = slots[i % slots.size()];
+        s.done.wait();
+        std::size_t offset = tile * opts.tile_elements;
+        std::size_t elements = std::min(opts.tile_elements, count - offset);
+        T* data = s.buffer.accelerator_pointer();
+        s.view.copy_async(in + offset, data, elements * sizeof(T));
+        hc::parallel_for_each(s.view, hc::extent<1>(elements), [=](hc::index<1> idx)[[hc]]{
+            kernel(data[idx[0]], offset + idx[0]);
+          });
+        s.done = s.view.copy_async(data, out + offset, elements * sizeof(T));
+        ++stats.tiles[dev];
+        if(stolen) ++stats.stolen[dev];
+      }
+    }
+    catch(...){
+      errors[dev] = std::current_exception();
+    }
+    for(auto& s: slots) s.view.wait();
+  };
+
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> threads;
+  for(std::size_t dev = 0; dev != devices.size(); ++dev){
+    threads.emplace_back(drive, dev);
+  }
+  for(auto& thread: threads) thread.join();
+  stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  for(auto& error: errors){
+    if(error) std::rethrow_exception(error);
+  }
+  return stats;
+}
+
+} // namespace av
+
+#endif // MULTI_DEVICE_FOR_EACH_HPP
@@ -0,0 +1,110 @@
+#ifndef NUMA_HPP
+#define NUMA_HPP
+
+// Minimal NUMA helpers on top of Linux sysfs and sched_setaffinity, so that nothing needs libnuma.
+// On systems without /sys/devices/system/node, everything is node 0.
+
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <climits>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace av {
+namespace numa {
+
+namespace detail {
+
+inline std::string read_first_line(const std::string& path){
+  std::ifstream in(path);
+  std::string line;
+  std::getline(in, line);
+  return line;
+}
+
+// "0-3,8,10-11" -> {0, 1, 2, 3, 8, 10, 11}
+inline std::vector<int> parse_list(const std::string& list){
+  std::vector<int> ids;
+  std::stringstream ranges(list);
+  std::string range;
+  while(std::getline(ranges, range, ',')){
+    if(range.empty()) continue;
+    auto dash = range.find('-');
+    int first = std::stoi(range.substr(0, dash));
+    int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+    for(int id = first; id <= last; ++id) ids.push_back(id);
+  }
+  return ids;
+}
+
+} // namespace detail
+
+inline std::vector<int> online_nodes(){
+  auto nodes = detail::parse_list(detail::read_first_line("/sys/devices/system/node/online"));
+  if(nodes.empty()) nodes.push_back(0);
+  return nodes;
+}
+
+// empty if the node doesn't exist, or there is no sysfs
+inline std::vector<int> node_cpus(int node){
+  return detail::parse_list(detail::read_first_line("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist"));
+}
+
+// Restricts the calling thread to the cpus of node. Memory it first touches from then on is
+// allocated on that node, under the default policy. False if the node has no cpus.
+inline bool bind_current_thread(int node){
+  auto cpus = node_cpus(node);
+  if(cpus.empty()) return false;
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for(int cpu: cpus) CPU_SET(cpu, &set);
+  return sched_setaffinity(0, sizeof(set), &set) == 0;
+}
+
+// Binds (pages of) [addr, addr + bytes) to node with mbind(MPOL_BIND): pages faulted in from then
+// on come from that node. addr must be page aligned.
+inline bool bind_memory(void* addr, std::size_t bytes, int node){
+#ifdef SYS_mbind
+  constexpr int mpol_bind = 2;
+  constexpr std::size_t bits = sizeof(unsigned long) * CHAR_BIT;
+  std::vector<unsigned long> mask(node / bits + 1, 0);
+  mask[node / bits] |= 1UL << (node % bits);
+  return syscall(SYS_mbind, addr, bytes, mpol_bind, mask.data(), mask.size() * bits + 1, 0) == 0;
+#else
+  (void)addr; (void)bytes; (void)node;
+  return false;
+#endif
+}
+
+// Binds the calling thread to node for its lifetime, and restores the previous affinity after,
+// e.g. around the submission loop that feeds a GPU from node-local buffers.
+class scoped_binding {
+public:
+  explicit scoped_binding(int node){
+    saved_ = sched_getaffinity(0, sizeof(previous_), &previous_) == 0;
+    bound_ = bind_current_thread(node);
+  }
+
+  scoped_binding(const scoped_binding&) = delete;
+  scoped_binding& operator=(const scoped_binding&) = delete;
+
+  ~scoped_binding(){
+    if(bound_ && saved_) sched_setaffinity(0, sizeof(previous_), &previous_);
+  }
+
+  bool bound() const { return bound_; }
+
+private:
+  cpu_set_t previous_;
+  bool saved_ = false;
+  bool bound_ = false;
+};
+
+} // namespace numa
+} // namespace av
+
+#endif // NUMA_HPP
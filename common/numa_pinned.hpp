@@ -0,0 +1,114 @@
+#ifndef NUMA_PINNED_HPP
+#define NUMA_PINNED_HPP
+
+// Pinned host memory on a chosen NUMA node, for feeding a GPU from the socket it hangs off.
+//
+// am_alloc(amHostPinned) puts host memory wherever first touch or the driver decide, which on a
+// multi-socket host is often the far socket, and every H2D copy then crosses the socket link.
+// numa_pinned_alloc mmaps the memory, binds it to the node with mbind, faults it in, and registers
+// it with am_memory_host_lock, after which it works with accelerator_view::copy_async like any
+// pinned memory. numa_pinned_allocator does the same for containers, with the node either given,
+// or the one closest to an accelerator according to av::topology (probed once, then cached).
+
+#include <hc.hpp>
+#include <hc_am.hpp>
+#include "numa.hpp"
+#include "topology.hpp"
+
+#include <sys/mman.h>
+
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <new>
+#include <string>
+#include <vector>
+
+namespace av {
+
+// null if bytes is 0, or if mapping, binding or locking fails
+inline void* numa_pinned_alloc(std::size_t bytes, int node, hc::accelerator acc){
+  if(bytes == 0) return nullptr;
+  void* ptr = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if(ptr == MAP_FAILED) return nullptr;
+  if(!numa::bind_memory(ptr, bytes, node) && numa::online_nodes().size() > 1){
+    munmap(ptr, bytes);
+    return nullptr;
+  }
+  std::memset(ptr, 0, bytes); // faults the pages in, on node
+  // the GPUs only: the cpu accelerator has no agent to grant access to
+  std::vector<hc::accelerator> peers;
+  for(const auto& peer: hc::accelerator::get_all()){
+    if(peer.get_device_path() != L"cpu") peers.push_back(peer);
+  }
+  if(hc::am_memory_host_lock(acc, ptr, bytes, peers.data(), peers.size()) != AM_SUCCESS){
+    munmap(ptr, bytes);
+    return nullptr;
+  }
+  return ptr;
+}
+
+inline void numa_pinned_free(void* ptr, hc::accelerator acc){
+  if(!ptr) return;
+  hc::AmPointerInfo info(NULL, NULL, NULL, 0, acc, 0, 0);
+  if(hc::am_memtracker_getinfo(&info, ptr) != AM_SUCCESS) return;
+  std::size_t bytes = info._sizeBytes;
+  hc::am_memory_host_unlock(acc, ptr);
+  munmap(ptr, bytes);
+}
+
+namespace detail {
+
+// topology::get() reads the cache file, or probes; containers construct allocators freely, so that
+// is done once per accelerator for the whole process
+inline int closest_numa_node(const hc::accelerator& acc){
+  static std::mutex mutex;
+  static auto nodes = new std::map<std::wstring, int>();
+  std::lock_guard<std::mutex> lock(mutex);
+  auto it = nodes->find(acc.get_device_path());
+  if(it == nodes->end()) it = nodes->emplace(acc.get_device_path(), topology::get().closest_numa_node(acc)).first;
+  return it->second;
+}
+
+} // namespace detail
+
+template<typename T>
+class numa_pinned_allocator {
+public:
+  using value_type = T;
+
+  numa_pinned_allocator(int node, hc::accelerator acc) : node_(node), acc_(acc) {}
+  // on the node closest to acc
+  explicit numa_pinned_allocator(hc::accelerator acc) : node_(detail::closest_numa_node(acc)), acc_(acc) {}
+  template<typename U>
+  numa_pinned_allocator(const numa_pinned_allocator<U>& other) : node_(other.get_node()), acc_(other.get_accelerator()) {}
+
+  T* allocate(std::size_t n){
+    auto ptr = static_cast<T*>(numa_pinned_alloc(n * sizeof(T), node_, acc_));
+    if(!ptr && n != 0) throw std::bad_alloc();
+    return ptr;
+  }
+  void deallocate(T* ptr, std::size_t){ numa_pinned_free(ptr, acc_); }
+
+  int get_node() const { return node_; }
+  hc::accelerator get_accelerator() const { return acc_; }
+
+  template<typename U>
+  bool operator==(const numa_pinned_allocator<U>& other) const {
+    return node_ == other.get_node() && acc_ == other.get_accelerator();
+  }
+  template<typename U>
+  bool operator!=(const numa_pinned_allocator<U>& other) const { return !(*this == other); }
+
+private:
+  int node_;
+  hc::accelerator acc_;
+};
+
+// pinned_vector on a chosen NUMA node, e.g. numa_pinned_vector<double> v(size, 0.0, numa_pinned_allocator<double>(acc));
+template<typename T>
+using numa_pinned_vector = std::vector<T, numa_pinned_allocator<T>>;
+
+} // namespace av
+
+#endif // NUMA_PINNED_HPP
@@ -0,0 +1,182 @@
+#ifndef PEER_MAPPER_HPP
+#define PEER_MAPPER_HPP
+
+// Lazy, idempotent am_map_to_peers.
+//
+// Device memory of one accelerator can only be used by another accelerator's copies and kernels
+// after am_map_to_peers; forgetting the call crashes (example 05). Calling it before every use
+// isn't free either: on ROCm each call reprograms the access of the whole allocation. peer_mapper
+// remembers, per allocation (identified by base address and allocation sequence number, so a
+// block freed and reallocated at the same address starts over), which accelerators it has been
+// mapped to, and only calls am_map_to_peers for accelerators it hasn't been mapped to yet. It
+// always passes the full set of peers, so the result is the same whether the runtime adds to the
+// previous set or replaces it.
+//
+// ensure(ptr, acc) is the call to make on first use from acc; ensure(ptrs, acc) does it for many
+// buffers with one call per allocation; premap(ptr, accs) maps hot buffers to everything up
+// front. peer_mapper::get() is a process-wide instance, used by device_buffer, task_graph and
+// d2d_copy_engine.
+
+#include <hc.hpp>
+#include <hc_am.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <vector>
+
+namespace av {
+
+struct peer_mapper_stats {
+  std::size_t lookups = 0;        // (pointer, accelerator) pairs asked for
+  std::size_t hits = 0;           // already accessible: owner, or mapped before
+  std::size_t map_calls = 0;      // am_map_to_peers calls
+  std::size_t failures = 0;       // not am_alloc-ed, or am_map_to_peers failed
+};
+
+class peer_mapper {
+public:
+  peer_mapper() = default;
+  peer_mapper(const peer_mapper&) = delete;
+  peer_mapper& operator=(const peer_mapper&) = delete;
+
+  // never destroyed, so it can be used from static destructors
+  static peer_mapper& get(){
+    static auto instance = new peer_mapper();
+    return *instance;
+  }
+
+  // Makes the allocation containing ptr accessible from acc. False if ptr isn't am_alloc-ed, or if
+  // mapping failed.
+  bool ensure(const void* ptr, const hc::accelerator& acc){
+    return ensure(std::vector<const void*>{ptr}, acc);
+  }
+
+  // the same for several pointers, with at most one am_map_to_peers per allocation
+  bool ensure(const std::vector<const void*>& ptrs, const hc::accelerator& acc){
+    std::lock_guard<std::mutex> lock(mutex_);
+    bool ok = true;
+    std::vector<void*> pending;
+    for(auto ptr: ptrs){
+      ++stats_.lookups;
+      void* base;
+      if(!lookup(ptr, acc, &base)){
+        ok = false;
+        continue;
+      }
+      if(base && std::find(pending.begin(), pending.end(), base) == pending.end()) pending.push_back(base);
+    }
+    for(auto base: pending) ok &= map(base, {acc});
+    return ok;
+  }
+
+  // Maps the allocation containing ptr to all of accs now, e.g. at startup for buffers every
+  // device will touch.
+  bool premap(const void* ptr, const std::vector<hc::accelerator>& accs){
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<hc::accelerator> missing;
+    void* base = nullptr;
+    for(auto& acc: accs){
+      ++stats_.lookups;
+      void* b;
+      if(!lookup(ptr, acc, &b)) return false;
+      if(b){
+        base = b;
+        missing.push_back(acc);
+      }
+    }
+    return !base || map(base, missing);
+  }
+
+  // Both ends of a copy on view accessible from its accelerator. Pointers that aren't am_alloc-ed
+  // are left alone (as for the global hc::copy_async, which takes any host memory).
+  void prepare_copy(const hc::accelerator_view& view, const void* src, const void* dst){
+    auto acc = view.get_accelerator();
+    std::vector<const void*> tracked;
+    for(auto ptr: {src, dst}){
+      hc::AmPointerInfo info(NULL, NULL, NULL, 0, acc, 0, 0);
+      if(hc::am_memtracker_getinfo(&info, ptr) == AM_SUCCESS) tracked.push_back(ptr);
+    }
+    ensure(tracked, acc);
+  }
+
+  bool is_mapped(const void* ptr, const hc::accelerator& acc){
+    std::lock_guard<std::mutex> lock(mutex_);
+    hc::accelerator peer = acc;
+    hc::AmPointerInfo info(NULL, NULL, NULL, 0, peer, 0, 0);
+    if(hc::am_memtracker_getinfo(&info, ptr) != AM_SUCCESS) return false;
+    if(info._acc == acc) return true;
+    auto it = mapped_.find(info._devicePointer);
+    return it != mapped_.end() && it->second.seq == info._allocSeqNum && it->second.has(acc);
+  }
+
+  // drops what is known about the allocation containing ptr, before it is freed
+  void forget(const void* ptr){
+    std::lock_guard<std::mutex> lock(mutex_);
+    hc::accelerator acc;
+    hc::AmPointerInfo info(NULL, NULL, NULL, 0, acc, 0, 0);
+    if(hc::am_memtracker_getinfo(&info, ptr) == AM_SUCCESS) mapped_.erase(info._devicePointer);
+  }
+
+  peer_mapper_stats stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+  }
+
+private:
+  struct entry {
+    std::uint64_t seq = 0;
+    std::vector<hc::accelerator> peers;
+
+    bool has(const hc::accelerator& acc) const { return std::find(peers.begin(), peers.end(), acc) != peers.end(); }
+  };
+
+  // False if ptr isn't am_alloc-ed. Otherwise *base is the allocation if it needs mapping to acc,
+  // and null if it is accessible already.
+  bool lookup(const void* ptr, const hc::accelerator& acc, void** base){
+    hc::accelerator peer = acc;
+    hc::AmPointerInfo info(NULL, NULL, NULL, 0, peer, 0, 0);
+    if(hc::am_memtracker_getinfo(&info, ptr) != AM_SUCCESS){
+      ++stats_.failures;
+      return false;
+    }
+    *base = nullptr;
+    if(info._acc == acc){
+      ++stats_.hits;
+      return true;
+    }
+    auto& e = mapped_[info._devicePointer];
+    if(e.seq != info._allocSeqNum){
+      e.seq = info._allocSeqNum;
+      e.peers.clear();
+    }
+    if(e.has(acc)) ++stats_.hits;
+    else *base = info._devicePointer;
+    return true;
+  }
+
+  // maps base to its known peers plus accs
+  bool map(void* base, const std::vector<hc::accelerator>& accs){
+    auto& e = mapped_[base];
+    auto peers = e.peers;
+    for(auto& acc: accs){
+      if(std::find(peers.begin(), peers.end(), acc) == peers.end()) peers.push_back(acc);
+    }
+    ++stats_.map_calls;
+    if(hc::am_map_to_peers(base, peers.size(), peers.data()) != AM_SUCCESS){
+      ++stats_.failures;
+      return false;
+    }
+    e.peers = std::move(peers);
+    return true;
+  }
+
+  mutable std::mutex mutex_;
+  std::map<void*, entry> mapped_;  // by allocation base
+  peer_mapper_stats stats_;
+};
+
+} // namespace av
+
+#endif // PEER_MAPPER_HPP
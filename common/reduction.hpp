@@ -0,0 +1,205 @@
+#ifndef REDUCTION_HPP
+#define REDUCTION_HPP
+
+// Reductions (sum, min, max, mean, or any associative and commutative [[hc]] operation) of device
+// memory, on the device, so that only a scalar comes back instead of the whole array.
+//
+// The reduction is a tree of kernels: a pass over n values runs ceil(n / fanout) work-items, item i
+// combining the values i, i + items, i + 2 * items, ... (so neighbouring items read neighbouring
+// values), and writes one partial each; passes repeat until a single value is left, which is then
+// copied back. Partials live in blocks from the device pool of av::caching_allocator, taken and
+// returned stream-ordered, so repeated reductions on a view don't allocate.
+//
+// reduce() over several (view, pointer, count) slices runs the trees on all views at once and
+// combines the per-slice results on the host. host_reduce() is the fallback for data on the host:
+// one thread per core, each with several independent accumulators so the compiler can vectorize.
+
+#include <hc.hpp>
+#include <hc_am.hpp>
+#include "caching_allocator.hpp"
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+namespace av {
+
+template<typename T>
+struct plus {
+  T operator()(T a, T b) const [[hc]] { return a + b; }
+};
+
+template<typename T>
+struct minimum {
+  T operator()(T a, T b) const [[hc]] { return b < a ? b : a; }
+};
+
+template<typename T>
+struct maximum {
+  T operator()(T a, T b) const [[hc]] { return a < b ? b : a; }
+};
+
+template<typename T>
+struct device_slice {
+  hc::accelerator_view view;
+  const T* data;     // device memory accessible from view
+  std::size_t count;
+};
+
+namespace detail {
+
+constexpr std::size_t reduction_fanout = 256;
+
+// the device pointer of a submitted reduction's result, inside a scratch block from the device pool
+template<typename T>
+struct pending_reduce {
+  T* result;
+  T* scratch;  // to go back to the pool for view once the read of result has been submitted
+};
+
+// Submits the reduction tree of data[0, count), count > 0, to view.
+template<typename T, typename Op>
+pending_reduce<T> submit_reduce(hc::accelerator_view& view, const T* data, std::size_t count, Op op){
+  auto& pool = caching_allocator::device_pool(view.get_accelerator());
+  std::size_t items = (count + reduction_fanout - 1) / reduction_fanout;
+  // passes alternate between the two parts, so a pass never overwrites its own input
+  std::size_t second = (items + reduction_fanout - 1) / reduction_fanout;
+  auto scratch = static_cast<T*>(pool.allocate((items + second) * sizeof(T), view));
+  T* in_place[2] = {scratch, scratch + items};
+  const T* in = data;
+  T* out = in_place[0];
+  for(std::size_t pass = 0; ; ++pass){
+    out = in_place[pass % 2];
+    hc::parallel_for_each(view, hc::extent<1>(items), [=](hc::index<1> idx)[[hc]]{
+        std::size_t i = idx[0];
+        T acc = in[i];
+        for(i += items; i < count; i += items) acc = op(acc, in[i]);
+        out[idx[0]] = acc;
+      });
+    if(items == 1) break;
+    in = out;
+    count = items;
+    items = (count + reduction_fanout - 1) / reduction_fanout;
+  }
+  return pending_reduce<T>{out, scratch};
+}
+
+// the reduction of each slice (slices must not be empty), computed on all views concurrently
+template<typename T, typename Op>
+std::vector<T> reduce_slices(std::vector<device_slice<T>> slices, Op op){
+  if(slices.empty()) return {};
+  // the results come back with each slice's own view, so that they are read before the scratch
+  // blocks, freed stream-ordered on that view, can be handed out again
+  auto& pinned = caching_allocator::pinned_pool();
+  auto results = static_cast<T*>(pinned.allocate(slices.size() * sizeof(T)));
+  std::vector<hc::completion_future> copies;
+  for(std::size_t s = 0; s != slices.size(); ++s){
+    auto& slice = slices[s];
+    auto pending = submit_reduce(slice.view, slice.data, slice.count, op);
+    copies.push_back(slice.view.copy_async(pending.result, results + s, sizeof(T)));
+    caching_allocator::device_pool(slice.view.get_accelerator()).deallocate(pending.scratch, slice.view);
+  }
+  for(auto& copy: copies) copy.get();
+  std::vector<T> values(results, results + slices.size());
+  pinned.deallocate(results);
+  return values;
+}
+
+} // namespace detail
+
+// op(init, data[0], ..., data[count - 1]), in some order; data is device memory accessible from view
+template<typename T, typename Op>
+T reduce(hc::accelerator_view view, const T* data, std::size_t count, T init, Op op){
+  if(count == 0) return init;
+  return op(init, detail::reduce_slices(std::vector<device_slice<T>>{{view, data, count}}, op).front());
+}
+
+template<typename T, typename Op>
+T reduce(const hc::array<T, 1>& a, T init, Op op){
+  return reduce(a.get_accelerator_view(), a.accelerator_pointer(), a.get_extent().size(), init, op);
+}
+
+// the reduction over several slices, e.g. parts of a dataset spread over several devices
+template<typename T, typename Op>
+T reduce(std::vector<device_slice<T>> slices, T init, Op op){
+  slices.erase(std::remove_if(slices.begin(), slices.end(), [](const device_slice<T>& s){ return s.count == 0; }),
+               slices.end());
+  for(auto partial: detail::reduce_slices(slices, op)) init = op(init, partial);
+  return init;
+}
+
+// copies data[0] back
+template<typename T>
+T first_element(hc::accelerator_view view, const T* data){
+  auto& pinned = caching_allocator::pinned_pool();
+  auto staging = static_cast<T*>(pinned.allocate(sizeof(T)));
+  view.copy_async(data, staging, sizeof(T)).get();
+  T value = *staging;
+  pinned.deallocate(staging);
+  return value;
+}
+
+template<typename T>
+T reduce_sum(hc::accelerator_view view, const T* data, std::size_t count){
+  return reduce(view, data, count, T(), plus<T>());
+}
+
+template<typename T>
+T reduce_min(hc::accelerator_view view, const T* data, std::size_t count){
+  return count ? reduce(view, data + 1, count - 1, first_element(view, data), minimum<T>()) : T();
+}
+
+template<typename T>
+T reduce_max(hc::accelerator_view view, const T* data, std::size_t count){
+  return count ? reduce(view, data + 1, count - 1, first_element(view, data), maximum<T>()) : T();
+}
+
+template<typename T>
+double reduce_mean(hc::accelerator_view view, const T* data, std::size_t count){
+  return count ? 1.0 * reduce_sum(view, data, count) / count : 0;
+}
+
+// Host-side fallback: op(init, data[0], ..., data[count - 1]), in some order, on all cores.
+template<typename T, typename Op>
+T host_reduce(const T* data, std::size_t count, T init, Op op, unsigned threads = 0){
+  constexpr std::size_t lanes = 8;
+  if(threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+  threads = static_cast<unsigned>(std::min<std::size_t>(threads, count / (64 * 1024) + 1));
+  std::vector<T> partials(threads, init);
+  std::vector<char> has_partial(threads, false);
+  auto work = [&](unsigned t){
+    std::size_t begin = count * t / threads;
+    std::size_t end = count * (t + 1) / threads;
+    if(end - begin < lanes){
+      if(begin == end) return;
+      T acc = data[begin];
+      for(std::size_t i = begin + 1; i != end; ++i) acc = op(acc, data[i]);
+      partials[t] = acc;
+      has_partial[t] = true;
+      return;
+    }
+    // independent accumulators: no dependency from one element to the next, so this vectorizes
+    T acc[lanes];
+    for(std::size_t l = 0; l != lanes; ++l) acc[l] = data[begin + l];
+    std::size_t i = begin + lanes;
+    for(; i + lanes <= end; i += lanes){
+      for(std::size_t l = 0; l != lanes; ++l) acc[l] = op(acc[l], data[i + l]);
+    }
+    for(; i != end; ++i) acc[0] = op(acc[0], data[i]);
+    for(std::size_t l = 1; l != lanes; ++l) acc[0] = op(acc[0], acc[l]);
+    partials[t] = acc[0];
+    has_partial[t] = true;
+  };
+  std::vector<std::thread> pool;
+  for(unsigned t = 1; t < threads; ++t) pool.emplace_back(work, t);
+  work(0);
+  for(auto& thread: pool) thread.join();
+  for(unsigned t = 0; t != threads; ++t){
+    if(has_partial[t]) init = op(init, partials[t]);
+  }
+  return init;
+}
+
+} // namespace av
+
+#endif // REDUCTION_HPP
@@ -0,0 +1,35 @@
+#ifndef SCOPED_TIMERS_H
+#define SCOPED_TIMERS_H
+
+// Wall-clock time of a scope, written to time when the timer goes out of scope. Given a name, the
+// scope is also recorded in the av::metrics registry (see metrics.hpp), nested in the scopes
+// open around it.
+
+#include <chrono>
+#include <memory>
+#include <string>
+
+#include "metrics.hpp"
+
+class SystemTimer {
+public:
+  explicit SystemTimer(float& time)
+    : time(time), start(std::chrono::steady_clock::now())
+  {}
+
+  SystemTimer(float& time, const std::string& name)
+    : time(time), scope(new av::metrics::scope(name)), start(std::chrono::steady_clock::now())
+  {}
+
+  ~SystemTimer()
+  {
+    time = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+    scope.reset();
+  }
+private:
+  float& time;
+  std::unique_ptr<av::metrics::scope> scope;
+  std::chrono::steady_clock::time_point start;
+};
+
+#endif // SCOPED_TIMERS_H
@@ -0,0 +1,164 @@
+#ifndef STAGING_RING_HPP
+#define STAGING_RING_HPP
+
+// Copies between pageable host memory (std::vector, mmap-ed files) and device memory, through a
+// small ring of pinned staging buffers, at close to pinned bandwidth without pinning the data.
+//
+// accelerator_view::copy_async needs am_alloc-ed memory on both sides, and pinning a copy of a
+// 1 GiB buffer just to transfer it doubles its footprint. The ring needs buffers * chunk_bytes of
+// pinned memory, a few MiB. Uploads memcpy chunk k into staging buffer k % buffers while chunk k-1
+// is on its way to the device with copy_async; downloads memcpy chunk k out of its staging buffer
+// while chunk k+1 is on its way up. A staging buffer is reused only once the copy_async using it
+// has completed.
+//
+// Transfers run on the ring's own worker thread, in submission order, so upload_async and
+// download_async return right away; upload and download wait.
+
+#include <hc.hpp>
+#include <hc_am.hpp>
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace av {
+
+class staging_ring {
+public:
+  struct options {
+    std::size_t chunk_bytes = 1024 * 1024;
+    std::size_t buffers = 4;
+  };
+
+  explicit staging_ring(hc::accelerator acc) : staging_ring(acc, options()) {}
+
+  staging_ring(hc::accelerator acc, const options& opts)
+    : acc_(acc), opts_(opts), view_(acc_.create_view())
+  {
+    if(opts_.chunk_bytes == 0 || opts_.buffers < 2){
+      throw std::invalid_argument("staging_ring: need a non-zero chunk size and at least two buffers");
+    }
+    for(std::size_t i = 0; i != opts_.buffers; ++i){
+      auto ptr = static_cast<char*>(hc::am_alloc(opts_.chunk_bytes, acc_, amHostPinned));
+      if(!ptr){
+        for(auto p: staging_) hc::am_free(p);
+        throw std::bad_alloc();
+      }
+      staging_.push_back(ptr);
+    }
+    worker_ = std::thread([this]{ work(); });
+  }
+
+  staging_ring(const staging_ring&) = delete;
+  staging_ring& operator=(const staging_ring&) = delete;
+
+  // finishes the transfers already submitted
+  ~staging_ring(){
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    cv_.notify_one();
+    worker_.join();
+    for(auto ptr: staging_) hc::am_free(ptr);
+  }
+
+  // src is any host memory, dst device memory of the ring's accelerator (or mapped to it)
+  std::future<void> upload_async(const void* src, void* dst, std::size_t bytes){
+    return submit([=]{ run_upload(static_cast<const char*>(src), static_cast<char*>(dst), bytes); });
+  }
+
+  // src is device memory of the ring's accelerator (or mapped to it), dst any host memory
+  std::future<void> download_async(const void* src, void* dst, std::size_t bytes){
+    return submit([=]{ run_download(static_cast<const char*>(src), static_cast<char*>(dst), bytes); });
+  }
+
+  void upload(const void* src, void* dst, std::size_t bytes){ upload_async(src, dst, bytes).get(); }
+  void download(const void* src, void* dst, std::size_t bytes){ download_async(src, dst, bytes).get(); }
+
+  hc::accelerator get_accelerator() const { return acc_; }
+  std::size_t pinned_bytes() const { return staging_.size() * opts_.chunk_bytes; }
+
+private:
+  template<typename Function>
+  std::future<void> submit(Function f){
+    std::packaged_task<void()> task(f);
+    auto done = task.get_future();
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      jobs_.push_back(std::move(task));
+    }
+    cv_.notify_one();
+    return done;
+  }
+
+  void work(){
+    for(;;){
+      std::packaged_task<void()> task;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this]{ return stop_ || !jobs_.empty(); });
+        if(jobs_.empty()) return;
+        task = std::move(jobs_.front());
+        jobs_.pop_front();
+      }
+      task();
+      // a transfer that threw may have left copies in flight; they must not outlive it
+      view_.wait();
+    }
+  }
+
+  void run_upload(const char* src, char* dst, std::size_t bytes){
+    std::size_t chunk = opts_.chunk_bytes;
+    std::size_t num_chunks = (bytes + chunk - 1) / chunk;
+    std::size_t slots = staging_.size();
+    std::vector<hc::completion_future> h2d(num_chunks);
+    for(std::size_t k = 0; k != num_chunks; ++k){
+      if(k >= slots) h2d[k - slots].get();
+      std::size_t offset = k * chunk;
+      std::size_t length = std::min(chunk, bytes - offset);
+      std::memcpy(staging_[k % slots], src + offset, length);
+      h2d[k] = view_.copy_async(staging_[k % slots], dst + offset, length);
+    }
+    for(auto& f: h2d) f.get();
+  }
+
+  void run_download(const char* src, char* dst, std::size_t bytes){
+    std::size_t chunk = opts_.chunk_bytes;
+    std::size_t num_chunks = (bytes + chunk - 1) / chunk;
+    std::size_t slots = staging_.size();
+    std::vector<hc::completion_future> d2h(num_chunks);
+    auto fetch = [&](std::size_t k){
+      std::size_t offset = k * chunk;
+      d2h[k] = view_.copy_async(src + offset, staging_[k % slots], std::min(chunk, bytes - offset));
+    };
+    for(std::size_t k = 0; k != std::min(slots, num_chunks); ++k) fetch(k);
+    for(std::size_t k = 0; k != num_chunks; ++k){
+      d2h[k].get();
+      std::size_t offset = k * chunk;
+      std::memcpy(dst + offset, staging_[k % slots], std::min(chunk, bytes - offset));
+      if(k + slots < num_chunks) fetch(k + slots);
+    }
+  }
+
+  hc::accelerator acc_;
+  options opts_;
+  hc::accelerator_view view_;
+  std::vector<char*> staging_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::deque<std::packaged_task<void()>> jobs_;
+  bool stop_ = false;
+  std::thread worker_;
+};
+
+} // namespace av
+
+#endif // STAGING_RING_HPP
@@ -0,0 +1,243 @@
+#ifndef STREAMING_EXECUTOR_HPP
+#define STREAMING_EXECUTOR_HPP
+
+// Out-of-core processing of host data that doesn't fit in device memory.
+//
+// The dataset is processed in windows, each as big as the device allows: the dedicated memory
+// reported by the accelerator, minus a headroom fraction for everything else, divided over
+// num_windows device buffers. Window i goes to view i % num_windows, which copies it in, runs the
+// kernel on it and copies it back, as in chunked_pipeline; with several windows, the upload of the
+// next window overlaps with the kernel on the current one. Host memory may be am_alloc-ed, or
+// anything else, e.g. a std::vector or an mmap-ed file. am_alloc-ed memory is copied straight to and
+// from the window. Anything else goes through a few chunk-sized pinned staging buffers per view,
+// from caching_allocator::pinned_pool(): the host memcpys a chunk in and the view copies it up, and
+// on the way back the view copies chunks down and the host memcpys them out, just before the view's
+// next window (or at the end). Either way, every copy is submitted to the window's view, so the
+// upload, the kernel and the download of a window stay in order. (The global hc::copy_async takes
+// any host memory, but on hcc it isn't ordered with the operations on the view.)
+
+#include <hc.hpp>
+#include <hc_am.hpp>
+#include "caching_allocator.hpp"
+#include "chunked_pipeline.hpp"
+#include "device_buffer.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+namespace av {
+
+template<typename T>
+class streaming_executor {
+public:
+  struct options {
+    double headroom = 0.1;             // share of the dedicated memory left alone
+    std::size_t num_windows = 3;       // device buffers, and views
+    std::size_t max_window_bytes = 0;  // caps the window size if non-zero
+    std::size_t staging_chunk_bytes = 4 * 1024 * 1024;  // for host memory that isn't am_alloc-ed
+    std::size_t staging_buffers = 4;                    // per view, at least 2
+  };
+
+  explicit streaming_executor(hc::accelerator acc) : streaming_executor(acc, options()) {}
+
+  streaming_executor(hc::accelerator acc, const options& opts) : acc_(acc), opts_(opts) {
+    if(opts_.num_windows == 0 || opts_.headroom < 0 || opts_.headroom >= 1 || opts_.staging_chunk_bytes == 0
+       || opts_.staging_buffers < 2){
+      throw std::invalid_argument("streaming_executor: need at least one window, headroom in [0, 1), and at least "
+                                  "two non-empty staging buffers");
+    }
+    window_elements_ = window_elements(acc_, opts_);
+    if(window_elements_ == 0){
+      throw std::invalid_argument("streaming_executor: not enough device memory for a single element per window");
+    }
+    for(std::size_t i = 0; i != opts_.num_windows; ++i){
+      views_.push_back(acc_.create_view());
+      windows_.emplace_back(acc_, window_elements_);
+    }
+  }
+
+  streaming_executor(const streaming_executor&) = delete;
+  streaming_executor& operator=(const streaming_executor&) = delete;
+
+  ~streaming_executor(){
+    for(auto& view: views_) view.wait();
+  }
+
+  // the window size these options give on acc
+  static std::size_t window_elements(hc::accelerator acc, const options& opts){
+    auto budget = static_cast<std::size_t>(acc.get_dedicated_memory() * 1024.0 * (1 - opts.headroom));
+    std::size_t bytes = budget / std::max<std::size_t>(opts.num_windows, 1);
+    if(opts.max_window_bytes) bytes = std::min(bytes, opts.max_window_bytes);
+    return bytes / sizeof(T);
+  }
+
+  std::size_t window_elements() const { return window_elements_; }
+  std::size_t num_windows() const { return views_.size(); }
+
+  // Runs fn(view, window, elements, offset) on every window, where window points to the device
+  // copy of [src + offset, src + offset + elements). fn must submit its work to view and return
+  // the last completion_future. The window is copied back to dst + offset afterwards, unless dst
+  // is null (read-only passes, e.g. reductions into a device-side accumulator). src == dst is fine.
+  // Blocks until all windows are done.
+  template<typename WindowFunction>
+  pipeline_stats for_each_window(const T* src, T* dst, std::size_t count, WindowFunction fn){
+    std::size_t num = (count + window_elements_ - 1) / window_elements_;
+    std::vector<window_ops> ops(num);
+    bool stage_src = !is_am_alloced(src);
+    bool stage_dst = dst && !is_am_alloced(dst);
+    std::vector<staging> stages(views_.size());
+    if(stage_src || stage_dst){
+      for(auto& stage: stages) stage.allocate(opts_.staging_buffers, opts_.staging_chunk_bytes);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for(std::size_t i = 0; i != num; ++i){
+      std::size_t slot = i % views_.size();
+      auto& view = views_[slot];
+      auto& op = ops[i];
+      op.window = windows_[slot].accelerator_pointer();
+      op.offset = i * window_elements_;
+      op.bytes = std::min(window_elements_, count - op.offset) * sizeof(T);
+
+      // the window's previous contents, and the staging buffers, are free again
+      if(stage_dst && i >= views_.size()) drain(view, stages[slot], ops[i - views_.size()], dst);
+      if(stage_src) upload(view, stages[slot], op, src);
+      else op.h2d.push_back(view.copy_async(src + op.offset, op.window, op.bytes));
+      op.kernel = fn(view, op.window, op.bytes / sizeof(T), op.offset);
+      if(dst && !stage_dst) op.d2h.push_back(view.copy_async(op.window, dst + op.offset, op.bytes));
+    }
+    if(stage_dst){
+      for(std::size_t i = num > views_.size() ? num - views_.size() : 0; i < num; ++i){
+        drain(views_[i % views_.size()], stages[i % views_.size()], ops[i], dst);
+      }
+    }
+    for(auto& view: views_) view.create_marker().wait();
+    auto stop = std::chrono::steady_clock::now();
+
+    pipeline_stats stats;
+    stats.chunks = num;
+    stats.bytes = count * sizeof(T);
+    stats.seconds = std::chrono::duration<double>(stop - start).count();
+    for(auto& op: ops){
+      for(auto& f: op.h2d) stats.h2d_seconds += elapsed(f);
+      stats.kernel_seconds += elapsed(op.kernel);
+      for(auto& f: op.d2h) stats.d2h_seconds += elapsed(f);
+    }
+    return stats;
+  }
+
+  // kernel(element, global index) on every element, [[hc]]; results go to dst
+  template<typename Kernel>
+  pipeline_stats for_each(const T* src, T* dst, std::size_t count, Kernel kernel){
+    return for_each_window(src, dst, count, [=](hc::accelerator_view& view, T* window, std::size_t elements,
+                                                std::size_t offset){
+        return hc::parallel_for_each(view, hc::extent<1>(elements), [=](hc::index<1> idx)[[hc]]{
+            kernel(window[idx[0]], offset + idx[0]);
+          });
+      });
+  }
+
+  template<typename Kernel>
+  pipeline_stats for_each(T* data, std::size_t count, Kernel kernel){
+    return for_each(data, data, count, kernel);
+  }
+
+private:
+  struct window_ops {
+    T* window;
+    std::size_t offset;  // elements
+    std::size_t bytes;
+    std::vector<hc::completion_future> h2d, d2h;  // one per staged chunk, or the whole window
+    hc::completion_future kernel;
+  };
+
+  // pinned buffers for one view; last[b] is the last copy submitted that uses buffer b
+  struct staging {
+    std::vector<char*> buffers;
+    std::vector<hc::completion_future> last;
+    std::size_t chunk_bytes = 0;
+
+    staging() = default;
+    staging(const staging&) = delete;
+    staging& operator=(const staging&) = delete;
+
+    void allocate(std::size_t count, std::size_t bytes){
+      auto& pool = caching_allocator::pinned_pool();
+      chunk_bytes = bytes;
+      last.resize(count);
+      for(std::size_t b = 0; b != count; ++b) buffers.push_back(static_cast<char*>(pool.allocate(bytes)));
+    }
+
+    // the host may use buffer b once the copies using it have completed
+    char* host_side(std::size_t b){
+      if(last[b].valid()) last[b].wait();
+      return buffers[b];
+    }
+
+    ~staging(){
+      for(std::size_t b = 0; b != buffers.size(); ++b){
+        host_side(b);
+        caching_allocator::pinned_pool().deallocate(buffers[b]);
+      }
+    }
+  };
+
+  // src + op.offset into op.window, a chunk at a time through the staging buffers
+  static void upload(hc::accelerator_view& view, staging& stage, window_ops& op, const T* src){
+    auto from = reinterpret_cast<const char*>(src + op.offset);
+    auto to = reinterpret_cast<char*>(op.window);
+    std::size_t slots = stage.buffers.size();
+    for(std::size_t k = 0, done = 0; done < op.bytes; ++k, done += stage.chunk_bytes){
+      std::size_t length = std::min(stage.chunk_bytes, op.bytes - done);
+      char* buffer = stage.host_side(k % slots);
+      std::memcpy(buffer, from + done, length);
+      stage.last[k % slots] = view.copy_async(buffer, to + done, length);
+      op.h2d.push_back(stage.last[k % slots]);
+    }
+  }
+
+  // op.window back to dst + op.offset, through the staging buffers; waits for the window's kernel
+  static void drain(hc::accelerator_view& view, staging& stage, window_ops& op, T* dst){
+    auto from = reinterpret_cast<const char*>(op.window);
+    auto to = reinterpret_cast<char*>(dst + op.offset);
+    std::size_t slots = stage.buffers.size();
+    std::size_t chunks = (op.bytes + stage.chunk_bytes - 1) / stage.chunk_bytes;
+    auto fetch = [&](std::size_t k){
+      std::size_t offset = k * stage.chunk_bytes;
+      // copies on the view run in order, so earlier uses of the buffer are done by then
+      stage.last[k % slots] = view.copy_async(from + offset, stage.buffers[k % slots],
+                                              std::min(stage.chunk_bytes, op.bytes - offset));
+      op.d2h.push_back(stage.last[k % slots]);
+    };
+    for(std::size_t k = 0; k != std::min(slots, chunks); ++k) fetch(k);
+    for(std::size_t k = 0; k != chunks; ++k){
+      std::size_t offset = k * stage.chunk_bytes;
+      std::memcpy(to + offset, stage.host_side(k % slots), std::min(stage.chunk_bytes, op.bytes - offset));
+      if(k + slots < chunks) fetch(k + slots);
+    }
+  }
+
+  static double elapsed(hc::completion_future& fut){
+    if(!fut.valid()) return 0;
+    return 1.0 * (fut.get_end_tick() - fut.get_begin_tick()) / fut.get_tick_frequency();
+  }
+
+  bool is_am_alloced(const void* ptr){
+    hc::AmPointerInfo info(NULL, NULL, NULL, 0, acc_, 0, 0);
+    return hc::am_memtracker_getinfo(&info, ptr) == AM_SUCCESS;
+  }
+
+  hc::accelerator acc_;
+  options opts_;
+  std::size_t window_elements_;
+  std::vector<hc::accelerator_view> views_;
+  std::vector<device_buffer<T>> windows_;
+};
+
+} // namespace av
+
+#endif // STREAMING_EXECUTOR_HPP
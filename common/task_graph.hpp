@@ -0,0 +1,253 @@
+#ifndef TASK_GRAPH_HPP
+#define TASK_GRAPH_HPP
+
+// Dependency-graph scheduling of copies and kernels over several accelerator_views and devices.
+//
+// Tasks are declared in program order, with the memory regions they read and write; a task
+// depends on every earlier task it has a read-after-write, write-after-read or write-after-write
+// conflict with. submit() maps the tasks onto views, and enforces dependencies on the device side:
+// within a view, in-order execution takes care of them, and across views, a blocking marker waits
+// for the other view's task. A marker is only inserted when the view doesn't already (transitively)
+// wait for that task, which is tracked with a vector clock per view. Nothing on the host waits,
+// until wait(), which only blocks on the final tasks: the ones nothing else depends on.
+//
+// A task goes to the view of its device that needs the fewest markers, and among those to the
+// least loaded one, so chains stay on one view and independent branches spread out.
+
+#include <hc.hpp>
+#include <hc_am.hpp>
+#include "peer_mapper.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace av {
+
+struct region {
+  const void* ptr;
+  std::size_t bytes;
+
+  bool overlaps(const region& other) const {
+    auto begin = reinterpret_cast<std::uintptr_t>(ptr);
+    auto other_begin = reinterpret_cast<std::uintptr_t>(other.ptr);
+    return begin < other_begin + other.bytes && other_begin < begin + bytes;
+  }
+};
+
+class task_graph {
+public:
+  using task_id = std::size_t;
+  // submits the kernel to the given view, and returns its completion_future
+  using launch_function = std::function<hc::completion_future(hc::accelerator_view&)>;
+
+  explicit task_graph(std::vector<hc::accelerator> accelerators, std::size_t views_per_device = 2)
+    : accelerators_(accelerators)
+  {
+    if(accelerators_.empty() || views_per_device == 0){
+      throw std::invalid_argument("task_graph: need at least one accelerator and one view per device");
+    }
+    for(std::size_t dev = 0; dev != accelerators_.size(); ++dev){
+      for(std::size_t i = 0; i != views_per_device; ++i){
+        views_.push_back(view_state{accelerators_[dev].create_view(), dev, 0, 0, {}});
+      }
+    }
+    for(auto& view: views_) view.clock.assign(views_.size(), 0);
+  }
+
+  // Copies bytes from src to dst; both am_alloc-ed. Runs on the device that owns the source, or
+  // the destination for host-to-device copies. Device-to-device destinations are mapped to the
+  // source device, through peer_mapper.
+  task_id copy(const void* src, void* dst, std::size_t bytes, std::string label = ""){
+    std::size_t src_dev = device_of(src);
+    std::size_t dst_dev = device_of(dst);
+    std::size_t dev = src_dev != no_device ? src_dev : (dst_dev != no_device ? dst_dev : 0);
+    if(src_dev != no_device && dst_dev != no_device && src_dev != dst_dev){
+      if(!peer_mapper::get().ensure(dst, accelerators_[src_dev])){
+        throw std::runtime_error("task_graph: cannot map copy destination to the source device");
+      }
+    }
+    if(label.empty()) label = "copy";
+    return add(dev, {region{src, bytes}}, {region{dst, bytes}},
+               [=](hc::accelerator_view& view){ return view.copy_async(src, dst, bytes); }, label);
+  }
+
+  // A kernel on accelerators[device]; launch must submit it to the view it is given, and must not
+  // touch memory outside of reads and writes. Regions in memory of other devices are mapped to
+  // this one.
+  task_id kernel(std::size_t device, std::vector<region> reads, std::vector<region> writes,
+                 launch_function launch, std::string label = ""){
+    if(device >= accelerators_.size()) throw std::out_of_range("task_graph: no such device");
+    std::vector<const void*> foreign;
+    for(auto regions: {&reads, &writes}){
+      for(auto& r: *regions){
+        if(is_peer_memory(r.ptr, accelerators_[device])) foreign.push_back(r.ptr);
+      }
+    }
+    if(!foreign.empty() && !peer_mapper::get().ensure(foreign, accelerators_[device])){
+      throw std::runtime_error("task_graph: cannot map kernel memory to the kernel's device");
+    }
+    if(label.empty()) label = "kernel";
+    return add(device, std::move(reads), std::move(writes), std::move(launch), label);
+  }
+
+  // Submits all tasks declared since the last submit(). Doesn't block.
+  void submit(){
+    for(; submitted_ != tasks_.size(); ++submitted_){
+      schedule(tasks_[submitted_]);
+    }
+  }
+
+  // Submits what's left, and waits for the tasks no other task depends on, which implies all.
+  void wait(){
+    submit();
+    for(auto& t: tasks_){
+      if(!t.has_dependents) t.done.wait();
+    }
+  }
+
+  void wait(task_id id){
+    submit();
+    tasks_.at(id).done.wait();
+  }
+
+  std::size_t size() const { return tasks_.size(); }
+  std::size_t num_views() const { return views_.size(); }
+  std::size_t markers_inserted() const { return markers_; }
+  const std::vector<task_id>& dependencies(task_id id) const { return tasks_.at(id).deps; }
+
+  // one line per task: label, device, view, dependencies and cross-view markers
+  void dump(std::ostream& out) const {
+    for(std::size_t id = 0; id != tasks_.size(); ++id){
+      auto& t = tasks_[id];
+      out << "task " << id << " (" << t.label << "): device " << t.device;
+      if(id < submitted_) out << ", view " << t.view;
+      out << ", depends on";
+      for(auto dep: t.deps) out << ' ' << dep;
+      if(t.deps.empty()) out << " nothing";
+      if(t.markers) out << ", " << t.markers << " cross-view marker(s)";
+      out << '\n';
+    }
+  }
+
+private:
+  static constexpr std::size_t no_device = static_cast<std::size_t>(-1);
+
+  struct task {
+    std::string label;
+    std::size_t device;
+    std::vector<region> reads;
+    std::vector<region> writes;
+    launch_function launch;
+    std::vector<task_id> deps;
+    bool has_dependents;
+    std::size_t view;
+    std::size_t markers;
+    std::vector<std::uint64_t> clock; // view clock right after submission, including this task
+    hc::completion_future done;
+  };
+
+  struct view_state {
+    hc::accelerator_view view;
+    std::size_t device;
+    std::uint64_t seq;                  // tasks submitted to this view so far
+    std::size_t load;
+    std::vector<std::uint64_t> clock;   // per view: how many of its tasks this view already waits for
+  };
+
+  static bool conflict(const std::vector<region>& a, const std::vector<region>& b){
+    for(auto& x: a){
+      for(auto& y: b){
+        if(x.overlaps(y)) return true;
+      }
+    }
+    return false;
+  }
+
+  std::size_t device_of(const void* ptr){
+    hc::AmPointerInfo info(NULL, NULL, NULL, 0, accelerators_.front(), 0, 0);
+    if(hc::am_memtracker_getinfo(&info, ptr) != AM_SUCCESS){
+      throw std::invalid_argument("task_graph: copy source and destination must be allocated with am_alloc");
+    }
+    if(!info._isInDeviceMem) return no_device;
+    for(std::size_t dev = 0; dev != accelerators_.size(); ++dev){
+      if(accelerators_[dev] == info._acc) return dev;
+    }
+    throw std::invalid_argument("task_graph: memory belongs to an accelerator outside of the graph");
+  }
+
+  // device memory of an accelerator other than acc
+  static bool is_peer_memory(const void* ptr, hc::accelerator& acc){
+    hc::AmPointerInfo info(NULL, NULL, NULL, 0, acc, 0, 0);
+    return hc::am_memtracker_getinfo(&info, ptr) == AM_SUCCESS && info._isInDeviceMem && info._acc != acc;
+  }
+
+  task_id add(std::size_t device, std::vector<region> reads, std::vector<region> writes, launch_function launch,
+              const std::string& label){
+    task t{label, device, std::move(reads), std::move(writes), std::move(launch), {}, false, 0, 0, {}, {}};
+    for(task_id prev = 0; prev != tasks_.size(); ++prev){
+      auto& p = tasks_[prev];
+      if(conflict(t.reads, p.writes) || conflict(t.writes, p.reads) || conflict(t.writes, p.writes)){
+        t.deps.push_back(prev);
+        p.has_dependents = true;
+      }
+    }
+    tasks_.push_back(std::move(t));
+    return tasks_.size() - 1;
+  }
+
+  std::size_t markers_needed(const view_state& view, std::size_t v, const task& t) const {
+    std::size_t count = 0;
+    for(auto dep: t.deps){
+      auto& d = tasks_[dep];
+      if(d.view != v && view.clock[d.view] < d.clock[d.view]) ++count;
+    }
+    return count;
+  }
+
+  void schedule(task& t){
+    std::size_t best = no_device;
+    std::size_t best_markers = 0;
+    for(std::size_t v = 0; v != views_.size(); ++v){
+      if(views_[v].device != t.device) continue;
+      auto markers = markers_needed(views_[v], v, t);
+      if(best == no_device || markers < best_markers
+         || (markers == best_markers && views_[v].load < views_[best].load)){
+        best = v;
+        best_markers = markers;
+      }
+    }
+
+    auto& view = views_[best];
+    for(auto dep: t.deps){
+      auto& d = tasks_[dep];
+      if(d.view == best || view.clock[d.view] >= d.clock[d.view]) continue;
+      auto scope = views_[d.view].device == view.device ? hc::accelerator_scope : hc::system_scope;
+      view.view.create_blocking_marker(d.done, scope);
+      ++t.markers;
+      ++markers_;
+      for(std::size_t w = 0; w != views_.size(); ++w){
+        view.clock[w] = std::max(view.clock[w], d.clock[w]);
+      }
+    }
+    t.view = best;
+    t.done = t.launch(view.view);
+    view.clock[best] = ++view.seq;
+    ++view.load;
+    t.clock = view.clock;
+  }
+
+  std::vector<hc::accelerator> accelerators_;
+  std::vector<view_state> views_;
+  std::vector<task> tasks_;
+  std::size_t submitted_ = 0;
+  std::size_t markers_ = 0;
+};
+
+} // namespace av
+
+#endif // TASK_GRAPH_HPP
@@ -0,0 +1,266 @@
+#ifndef TILED_KERNELS_HPP
+#define TILED_KERNELS_HPP
+
+// Multi-dimensional kernels with data reuse, as realistic workloads next to the 1-D busywork:
+//  - gemm: C = alpha * A * B + beta * C, compute-bound for large matrices,
+//  - transpose: memory-bound, with a strided access pattern on one side,
+//  - stencil_2d / stencil_3d: 5- and 7-point averages, memory-bound with neighbour reuse.
+// All data is row-major device memory (last index fastest); the kernels submit to view and return
+// the completion_future.
+//
+// Each kernel comes in two versions:
+//  - kernels::tiled: tiles of compile-time size, staged through tile_static memory, so every value
+//    read from global memory is used by many work-items (Tile values per load for gemm). For GPUs.
+//  - kernels::blocked: one work-item per cache-sized block of the output, with unit-stride inner
+//    loops that the host compiler vectorizes. For the host backend, where the compute threads are
+//    the "thread tiles" and the caches the "shared memory".
+// kernels::gemm etc. pick blocked when built with the host backend, tiled otherwise. Extents are
+// rounded up to whole tiles, and work-items outside the data do nothing but help with the loads.
+//
+// The *_cost functions give the floating point operations and the compulsory memory traffic
+// (every input read once, every output written once) of each kernel, for roofline plots.
+
+#include <hc.hpp>
+
+#include <algorithm>
+
+namespace av {
+namespace kernels {
+
+struct cost {
+  double flops;
+  double bytes;
+
+  double intensity() const { return bytes > 0 ? flops / bytes : 0; }  // flops per byte
+};
+
+template<typename T>
+cost gemm_cost(int m, int n, int k){
+  return {2.0 * m * n * k + 3.0 * m * n, (1.0 * m * k + 1.0 * k * n + 2.0 * m * n) * sizeof(T)};
+}
+
+template<typename T>
+cost transpose_cost(int rows, int cols){ return {0, 2.0 * rows * cols * sizeof(T)}; }
+
+template<typename T>
+cost stencil_2d_cost(int rows, int cols){ return {5.0 * rows * cols, 2.0 * rows * cols * sizeof(T)}; }
+
+template<typename T>
+cost stencil_3d_cost(int depth, int rows, int cols){
+  return {7.0 * depth * rows * cols, 2.0 * depth * rows * cols * sizeof(T)};
+}
+
+namespace detail {
+
+inline int round_up(int n, int tile){ return (n + tile - 1) / tile * tile; }
+
+} // namespace detail
+
+namespace tiled {
+
+// C (m x n) = alpha * A (m x k) * B (k x n) + beta * C; C isn't read if beta is 0
+template<int Tile = 16, typename T>
+hc::completion_future gemm(hc::accelerator_view& view, int m, int n, int k, T alpha, const T* a, const T* b, T beta,
+                           T* c){
+  hc::extent<2> ext(detail::round_up(m, Tile), detail::round_up(n, Tile));
+  return hc::parallel_for_each(view, ext.tile(Tile, Tile), [=](hc::tiled_index<2> t)[[hc]]{
+      tile_static T a_tile[Tile][Tile];
+      tile_static T b_tile[Tile][Tile];
+      int row = t.global[0], col = t.global[1];
+      int lr = t.local[0], lc = t.local[1];
+      T acc = 0;
+      for(int k0 = 0; k0 < k; k0 += Tile){
+        a_tile[lr][lc] = row < m && k0 + lc < k ? a[row * k + k0 + lc] : T(0);
+        b_tile[lr][lc] = k0 + lr < k && col < n ? b[(k0 + lr) * n + col] : T(0);
+        t.barrier.wait();
+        for(int kk = 0; kk != Tile; ++kk) acc += a_tile[lr][kk] * b_tile[kk][lc];
+        t.barrier.wait();
+      }
+      if(row < m && col < n) c[row * n + col] = beta == T(0) ? alpha * acc : alpha * acc + beta * c[row * n + col];
+    });
+}
+
+// out (cols x rows) = in (rows x cols) transposed; both sides of global memory are accessed along
+// rows, the turn happens in tile_static memory (padded by a column against bank conflicts)
+template<int Tile = 32, typename T>
+hc::completion_future transpose(hc::accelerator_view& view, int rows, int cols, const T* in, T* out){
+  hc::extent<2> ext(detail::round_up(rows, Tile), detail::round_up(cols, Tile));
+  return hc::parallel_for_each(view, ext.tile(Tile, Tile), [=](hc::tiled_index<2> t)[[hc]]{
+      tile_static T buffer[Tile][Tile + 1];
+      int l0 = t.local[0], l1 = t.local[1];
+      if(t.global[0] < rows && t.global[1] < cols) buffer[l0][l1] = in[t.global[0] * cols + t.global[1]];
+      t.barrier.wait();
+      int out_row = t.tile_origin[1] + l0, out_col = t.tile_origin[0] + l1;
+      if(out_row < cols && out_col < rows) out[out_row * rows + out_col] = buffer[l1][l0];
+    });
+}
+
+// out = average of each point of in and its 4 neighbours; the outermost rows and columns are copied
+template<int Tile0 = 16, int Tile1 = 16, typename T>
+hc::completion_future stencil_2d(hc::accelerator_view& view, int rows, int cols, const T* in, T* out){
+  hc::extent<2> ext(detail::round_up(rows, Tile0), detail::round_up(cols, Tile1));
+  return hc::parallel_for_each(view, ext.tile(Tile0, Tile1), [=](hc::tiled_index<2> t)[[hc]]{
+      constexpr int h0 = Tile0 + 2, h1 = Tile1 + 2;  // the tile plus a halo of one
+      tile_static T halo[h0][h1];
+      for(int e = t.local[0] * Tile1 + t.local[1]; e < h0 * h1; e += Tile0 * Tile1){
+        int r = t.tile_origin[0] + e / h1 - 1, c = t.tile_origin[1] + e % h1 - 1;
+        halo[e / h1][e % h1] = r >= 0 && r < rows && c >= 0 && c < cols ? in[r * cols + c] : T(0);
+      }
+      t.barrier.wait();
+      int r = t.global[0], c = t.global[1];
+      if(r >= rows || c >= cols) return;
+      int i = t.local[0] + 1, j = t.local[1] + 1;
+      if(r == 0 || r == rows - 1 || c == 0 || c == cols - 1) out[r * cols + c] = halo[i][j];
+      else out[r * cols + c] = (halo[i - 1][j] + halo[i + 1][j] + halo[i][j - 1] + halo[i][j + 1] + halo[i][j]) * T(0.2);
+    });
+}
+
+// the same with 6 neighbours, on a depth x rows x cols grid
+template<int Tile0 = 4, int Tile1 = 8, int Tile2 = 8, typename T>
+hc::completion_future stencil_3d(hc::accelerator_view& view, int depth, int rows, int cols, const T* in, T* out){
+  hc::extent<3> ext(detail::round_up(depth, Tile0), detail::round_up(rows, Tile1), detail::round_up(cols, Tile2));
+  return hc::parallel_for_each(view, ext.tile(Tile0, Tile1, Tile2), [=](hc::tiled_index<3> t)[[hc]]{
+      constexpr int h0 = Tile0 + 2, h1 = Tile1 + 2, h2 = Tile2 + 2;
+      tile_static T halo[h0][h1][h2];
+      for(int e = (t.local[0] * Tile1 + t.local[1]) * Tile2 + t.local[2]; e < h0 * h1 * h2; e += Tile0 * Tile1 * Tile2){
+        int z = t.tile_origin[0] + e / (h1 * h2) - 1, r = t.tile_origin[1] + e / h2 % h1 - 1, c = t.tile_origin[2] + e % h2 - 1;
+        bool inside = z >= 0 && z < depth && r >= 0 && r < rows && c >= 0 && c < cols;
+        halo[e / (h1 * h2)][e / h2 % h1][e % h2] = inside ? in[(z * rows + r) * cols + c] : T(0);
+      }
+      t.barrier.wait();
+      int z = t.global[0], r = t.global[1], c = t.global[2];
+      if(z >= depth || r >= rows || c >= cols) return;
+      int i = t.local[0] + 1, j = t.local[1] + 1, l = t.local[2] + 1;
+      bool boundary = z == 0 || z == depth - 1 || r == 0 || r == rows - 1 || c == 0 || c == cols - 1;
+      out[(z * rows + r) * cols + c] = boundary ? halo[i][j][l]
+        : (halo[i - 1][j][l] + halo[i + 1][j][l] + halo[i][j - 1][l] + halo[i][j + 1][l] + halo[i][j][l - 1]
+           + halo[i][j][l + 1] + halo[i][j][l]) * T(1.0 / 7);
+    });
+}
+
+} // namespace tiled
+
+namespace blocked {
+
+// Block sizes: a gemm work-item keeps a Block x Block tile of C in registers and L1 while it
+// streams Depth rows of B through L2.
+template<int Block = 64, int Depth = 256, typename T>
+hc::completion_future gemm(hc::accelerator_view& view, int m, int n, int k, T alpha, const T* a, const T* b, T beta,
+                           T* c){
+  hc::extent<2> blocks((m + Block - 1) / Block, (n + Block - 1) / Block);
+  return hc::parallel_for_each(view, blocks, [=](hc::index<2> idx)[[hc]]{
+      int i0 = idx[0] * Block, j0 = idx[1] * Block;
+      int i1 = std::min(i0 + Block, m), width = std::min(j0 + Block, n) - j0;
+      T acc[Block][Block] = {};
+      for(int k0 = 0; k0 < k; k0 += Depth){
+        int k1 = std::min(k0 + Depth, k);
+        for(int i = i0; i < i1; ++i){
+          T* __restrict__ acc_row = acc[i - i0];
+          for(int kk = k0; kk < k1; ++kk){
+            T a_ik = a[i * k + kk];
+            const T* __restrict__ b_row = b + kk * n + j0;
+            for(int j = 0; j < width; ++j) acc_row[j] += a_ik * b_row[j];
+          }
+        }
+      }
+      for(int i = i0; i < i1; ++i){
+        T* c_row = c + i * n + j0;
+        for(int j = 0; j < width; ++j) c_row[j] = beta == T(0) ? alpha * acc[i - i0][j] : alpha * acc[i - i0][j] + beta * c_row[j];
+      }
+    });
+}
+
+template<int Block = 32, typename T>
+hc::completion_future transpose(hc::accelerator_view& view, int rows, int cols, const T* in, T* out){
+  hc::extent<2> blocks((rows + Block - 1) / Block, (cols + Block - 1) / Block);
+  return hc::parallel_for_each(view, blocks, [=](hc::index<2> idx)[[hc]]{
+      int r0 = idx[0] * Block, c0 = idx[1] * Block;
+      int r1 = std::min(r0 + Block, rows), c1 = std::min(c0 + Block, cols);
+      for(int c = c0; c < c1; ++c){
+        for(int r = r0; r < r1; ++r) out[c * rows + r] = in[r * cols + c];
+      }
+    });
+}
+
+// a work-item per band of Rows rows
+template<int Rows = 16, typename T>
+hc::completion_future stencil_2d(hc::accelerator_view& view, int rows, int cols, const T* in, T* out){
+  hc::extent<1> bands((rows + Rows - 1) / Rows);
+  return hc::parallel_for_each(view, bands, [=](hc::index<1> idx)[[hc]]{
+      for(int r = idx[0] * Rows; r < std::min((idx[0] + 1) * Rows, rows); ++r){
+        const T* __restrict__ row = in + r * cols;
+        T* __restrict__ dst = out + r * cols;
+        if(r == 0 || r == rows - 1 || cols < 3){
+          for(int c = 0; c < cols; ++c) dst[c] = row[c];
+          continue;
+        }
+        const T* __restrict__ above = row - cols;
+        const T* __restrict__ below = row + cols;
+        dst[0] = row[0];
+        for(int c = 1; c < cols - 1; ++c) dst[c] = (above[c] + below[c] + row[c - 1] + row[c + 1] + row[c]) * T(0.2);
+        dst[cols - 1] = row[cols - 1];
+      }
+    });
+}
+
+// a work-item per band of Rows rows of one plane
+template<int Rows = 16, typename T>
+hc::completion_future stencil_3d(hc::accelerator_view& view, int depth, int rows, int cols, const T* in, T* out){
+  hc::extent<2> bands(depth, (rows + Rows - 1) / Rows);
+  return hc::parallel_for_each(view, bands, [=](hc::index<2> idx)[[hc]]{
+      int z = idx[0];
+      std::size_t plane = std::size_t(rows) * cols;
+      for(int r = idx[1] * Rows; r < std::min((idx[1] + 1) * Rows, rows); ++r){
+        const T* __restrict__ row = in + z * plane + r * cols;
+        T* __restrict__ dst = out + z * plane + r * cols;
+        if(z == 0 || z == depth - 1 || r == 0 || r == rows - 1 || cols < 3){
+          for(int c = 0; c < cols; ++c) dst[c] = row[c];
+          continue;
+        }
+        const T* __restrict__ above = row - cols;
+        const T* __restrict__ below = row + cols;
+        const T* __restrict__ front = row - plane;
+        const T* __restrict__ back = row + plane;
+        dst[0] = row[0];
+        for(int c = 1; c < cols - 1; ++c){
+          dst[c] = (front[c] + back[c] + above[c] + below[c] + row[c - 1] + row[c + 1] + row[c]) * T(1.0 / 7);
+        }
+        dst[cols - 1] = row[cols - 1];
+      }
+    });
+}
+
+} // namespace blocked
+
+// the version for the backend built for
+#if defined(HC_HOST_BACKEND)
+namespace best = blocked;
+#else
+namespace best = tiled;
+#endif
+
+template<typename T>
+hc::completion_future gemm(hc::accelerator_view& view, int m, int n, int k, T alpha, const T* a, const T* b, T beta,
+                           T* c){
+  return best::gemm(view, m, n, k, alpha, a, b, beta, c);
+}
+
+template<typename T>
+hc::completion_future transpose(hc::accelerator_view& view, int rows, int cols, const T* in, T* out){
+  return best::transpose(view, rows, cols, in, out);
+}
+
+template<typename T>
+hc::completion_future stencil_2d(hc::accelerator_view& view, int rows, int cols, const T* in, T* out){
+  return best::stencil_2d(view, rows, cols, in, out);
+}
+
+template<typename T>
+hc::completion_future stencil_3d(hc::accelerator_view& view, int depth, int rows, int cols, const T* in, T* out){
+  return best::stencil_3d(view, depth, rows, cols, in, out);
+}
+
+} // namespace kernels
+} // namespace av
+
+#endif // TILED_KERNELS_HPP
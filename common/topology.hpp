@@ -0,0 +1,319 @@
+#ifndef TOPOLOGY_HPP
+#define TOPOLOGY_HPP
+
+// Which GPUs are there, how fast can they be reached from the host, from each NUMA node, and from
+// each other; measured once, then cached in a file.
+//
+// topology::get() looks for a cache file whose fingerprint (device paths, descriptions and memory
+// sizes, the NUMA nodes, and the probe settings) matches this machine, and only probes if there is
+// none. Probing measures, for every GPU, H2D and D2H bandwidth (one large copy) and latency (the
+// median of small copies), H2D from pinned memory on every NUMA node (bound to that node with
+// mbind, faulted in, then registered with am_memory_host_lock), and for every ordered pair of
+// GPUs, peer copies after am_map_to_peers, and whether the two share an upstream link: whether
+// concurrent H2D copies to both get noticeably less than the sum of their separate bandwidths.
+//
+// Devices are numbered as in get_devices(): accelerator::get_all() without the cpu accelerator.
+
+#include <hc.hpp>
+#include <hc_am.hpp>
+#include "benchmark.hpp"
+#include "device_buffer.hpp"
+#include "numa.hpp"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace av {
+
+struct link_info {
+  double gib_per_second = 0;  // 0 if the route doesn't work (e.g. peer mapping failed)
+  double latency_us = 0;
+
+  bool usable() const { return gib_per_second > 0; }
+};
+
+class topology {
+public:
+  struct options {
+    std::size_t probe_bytes = 64 * 1024 * 1024;
+    std::size_t latency_bytes = 4096;
+    std::string cache_path = default_cache_path();
+    bool use_cache = true;
+  };
+
+  // $AV_TOPOLOGY_CACHE, or ~/.cache/accelerator_views_topology.txt
+  static std::string default_cache_path(){
+    if(auto path = std::getenv("AV_TOPOLOGY_CACHE")) return path;
+    if(auto home = std::getenv("HOME")) return std::string(home) + "/.cache/accelerator_views_topology.txt";
+    return "accelerator_views_topology.txt";
+  }
+
+  static std::vector<hc::accelerator> gpus(){
+    std::vector<hc::accelerator> devices;
+    for(const auto& acc: hc::accelerator::get_all()){
+      if(acc.get_device_path() != L"cpu") devices.push_back(acc);
+    }
+    return devices;
+  }
+
+  // from the cache if it matches this machine, otherwise probed (and cached)
+  static topology get(){ return get(options()); }
+
+  static topology get(const options& opts){
+    topology t;
+    t.devices_ = gpus();
+    t.nodes_ = numa::online_nodes();
+    t.fingerprint_ = fingerprint(t.devices_, t.nodes_, opts);
+    if(opts.use_cache && t.load(opts.cache_path)){
+      t.from_cache_ = true;
+      return t;
+    }
+    t.probe(opts);
+    if(opts.use_cache) t.save(opts.cache_path);
+    return t;
+  }
+
+  std::size_t num_devices() const { return devices_.size(); }
+  const hc::accelerator& device(std::size_t i) const { return devices_.at(i); }
+  const std::vector<int>& numa_nodes() const { return nodes_; }
+  bool from_cache() const { return from_cache_; }
+
+  const link_info& h2d(std::size_t dev) const { return h2d_.at(dev); }
+  const link_info& d2h(std::size_t dev) const { return d2h_.at(dev); }
+  // src copying to dst, on a view of src
+  const link_info& peer(std::size_t src, std::size_t dst) const { return peer_.at(src).at(dst); }
+  bool can_peer(std::size_t src, std::size_t dst) const { return src == dst || peer(src, dst).usable(); }
+  // H2D from pinned memory on the node_index-th entry of numa_nodes()
+  const link_info& host(std::size_t node_index, std::size_t dev) const { return host_.at(node_index).at(dev); }
+  bool shares_link(std::size_t a, std::size_t b) const { return a != b && shared_.at(a).at(b); }
+
+  // the NUMA node with the fastest H2D to dev
+  int closest_numa_node(std::size_t dev) const {
+    std::size_t best = 0;
+    for(std::size_t n = 1; n != nodes_.size(); ++n){
+      if(host(n, dev).gib_per_second > host(best, dev).gib_per_second) best = n;
+    }
+    return nodes_[best];
+  }
+
+  // the same, by accelerator; node 0 for accelerators that aren't in the topology
+  int closest_numa_node(const hc::accelerator& acc) const {
+    for(std::size_t dev = 0; dev != devices_.size(); ++dev){
+      if(devices_[dev] == acc) return closest_numa_node(dev);
+    }
+    return nodes_.empty() ? 0 : nodes_.front();
+  }
+
+  // the device dev copies to fastest, other than itself; dev if there is none
+  std::size_t best_peer(std::size_t dev) const {
+    std::size_t best = dev;
+    for(std::size_t other = 0; other != devices_.size(); ++other){
+      if(other == dev || !peer(dev, other).usable()) continue;
+      if(best == dev || peer(dev, other).gib_per_second > peer(dev, best).gib_per_second) best = other;
+    }
+    return best;
+  }
+
+  void print(std::ostream& out) const {
+    auto flags = out.flags();
+    out << std::fixed << std::setprecision(2);
+    for(std::size_t i = 0; i != devices_.size(); ++i){
+      auto path = devices_[i].get_device_path();
+      out << "device " << i << " (" << std::string(path.begin(), path.end()) << "): H2D " << h2d_[i].gib_per_second
+          << " GiB/s " << h2d_[i].latency_us << " us, D2H " << d2h_[i].gib_per_second << " GiB/s "
+          << d2h_[i].latency_us << " us, closest NUMA node " << closest_numa_node(i) << '\n';
+    }
+    out << "peer GiB/s (row: source, column: destination; - if not mappable, * if sharing a link):\n";
+    for(std::size_t i = 0; i != devices_.size(); ++i){
+      for(std::size_t j = 0; j != devices_.size(); ++j){
+        if(i == j) out << std::setw(9) << "";
+        else if(!peer_[i][j].usable()) out << std::setw(9) << "-";
+        else out << std::setw(8) << peer_[i][j].gib_per_second << (shared_[i][j] ? '*' : ' ');
+      }
+      out << '\n';
+    }
+    out << "H2D GiB/s from pinned memory per NUMA node (row: node, column: device):\n";
+    for(std::size_t n = 0; n != nodes_.size(); ++n){
+      out << "node " << nodes_[n];
+      for(std::size_t j = 0; j != devices_.size(); ++j) out << std::setw(9) << host_[n][j].gib_per_second;
+      out << '\n';
+    }
+    out.flags(flags);
+  }
+
+private:
+  static std::string fingerprint(const std::vector<hc::accelerator>& devices, const std::vector<int>& nodes,
+                                 const options& opts){
+    std::wstringstream ss;
+    for(auto& acc: devices){
+      ss << acc.get_device_path() << L'|' << acc.get_description() << L'|' << acc.get_dedicated_memory() << L';';
+    }
+    for(int node: nodes) ss << node << L',';
+    ss << opts.probe_bytes << L',' << opts.latency_bytes;
+    std::ostringstream hex;
+    hex << std::hex << std::hash<std::wstring>()(ss.str());
+    return hex.str();
+  }
+
+  static link_info measure(std::size_t bytes, std::size_t latency_bytes, const std::function<void(std::size_t)>& copy){
+    link_info l;
+    l.gib_per_second = bytes / time_repeated(1, 3, [&]{ copy(bytes); }).median_seconds / (1024.0 * 1024 * 1024);
+    l.latency_us = time_repeated(2, 20, [&]{ copy(latency_bytes); }).median_seconds * 1e6;
+    return l;
+  }
+
+  void probe(const options& opts){
+    std::size_t n = devices_.size();
+    std::size_t bytes = opts.probe_bytes;
+    h2d_.assign(n, link_info());
+    d2h_.assign(n, link_info());
+    peer_.assign(n, std::vector<link_info>(n));
+    shared_.assign(n, std::vector<bool>(n, false));
+    host_.assign(nodes_.size(), std::vector<link_info>(n));
+    if(n == 0) return;
+
+    std::vector<device_buffer<char>> buffers;
+    std::vector<hc::accelerator_view> views;
+    for(auto& acc: devices_){
+      buffers.emplace_back(acc, bytes);
+      views.push_back(acc.create_view());
+    }
+    auto pinned = static_cast<char*>(hc::am_alloc(bytes, devices_.front(), amHostPinned));
+    if(!pinned) throw std::bad_alloc();
+
+    for(std::size_t i = 0; i != n; ++i){
+      char* dev = buffers[i].accelerator_pointer();
+      h2d_[i] = measure(bytes, opts.latency_bytes, [&](std::size_t b){ views[i].copy_async(pinned, dev, b).wait(); });
+      d2h_[i] = measure(bytes, opts.latency_bytes, [&](std::size_t b){ views[i].copy_async(dev, pinned, b).wait(); });
+      for(std::size_t j = 0; j != n; ++j){
+        if(i == j || !buffers[j].map_to_peer(devices_[i])) continue;
+        char* dst = buffers[j].accelerator_pointer();
+        peer_[i][j] = measure(bytes, opts.latency_bytes, [&](std::size_t b){ views[i].copy_async(dev, dst, b).wait(); });
+      }
+    }
+
+    for(std::size_t a = 0; a != n; ++a){
+      for(std::size_t b = a + 1; b != n; ++b){
+        auto seconds = time_repeated(1, 3, [&]{
+            auto fa = views[a].copy_async(pinned, buffers[a].accelerator_pointer(), bytes);
+            auto fb = views[b].copy_async(pinned, buffers[b].accelerator_pointer(), bytes);
+            fa.wait();
+            fb.wait();
+          }).median_seconds;
+        double together = 2.0 * bytes / seconds / (1024.0 * 1024 * 1024);
+        shared_[a][b] = shared_[b][a] = together < 0.75 * (h2d_[a].gib_per_second + h2d_[b].gib_per_second);
+      }
+    }
+    hc::am_free(pinned);
+
+    // per node, a buffer bound to it with mbind and faulted in there, then registered with
+    // am_memory_host_lock: driver-pinned memory (am_alloc) is placed when allocated, and a
+    // first touch from a thread on the node would not move it
+    for(std::size_t node = 0; node != nodes_.size(); ++node){
+      void* mapped = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if(mapped == MAP_FAILED) continue;
+      auto local = static_cast<char*>(mapped);
+      bool bound = numa::bind_memory(local, bytes, nodes_[node]) || nodes_.size() == 1;
+      if(bound) std::memset(local, 0, bytes); // faults the pages in, on the node
+      if(bound && hc::am_memory_host_lock(devices_.front(), local, bytes, devices_.data(), devices_.size()) == AM_SUCCESS){
+        for(std::size_t i = 0; i != n; ++i){
+          char* dev = buffers[i].accelerator_pointer();
+          host_[node][i] = measure(bytes, opts.latency_bytes,
+                                   [&](std::size_t b){ views[i].copy_async(local, dev, b).wait(); });
+        }
+        hc::am_memory_host_unlock(devices_.front(), local);
+      }
+      munmap(local, bytes);
+    }
+  }
+
+  // text, one measurement per line
+  void save(const std::string& path) const {
+    auto slash = path.rfind('/');
+    if(slash != std::string::npos && slash != 0) mkdir(path.substr(0, slash).c_str(), 0755);
+    std::ofstream out(path);
+    if(!out) return;
+    out << std::setprecision(17);
+    out << "accelerator_views_topology 1 " << fingerprint_ << ' ' << devices_.size() << ' ' << nodes_.size() << '\n';
+    for(std::size_t i = 0; i != devices_.size(); ++i){
+      out << "h2d " << i << ' ' << h2d_[i].gib_per_second << ' ' << h2d_[i].latency_us << '\n';
+      out << "d2h " << i << ' ' << d2h_[i].gib_per_second << ' ' << d2h_[i].latency_us << '\n';
+      for(std::size_t j = 0; j != devices_.size(); ++j){
+        out << "peer " << i << ' ' << j << ' ' << peer_[i][j].gib_per_second << ' ' << peer_[i][j].latency_us << '\n';
+        out << "shared " << i << ' ' << j << ' ' << shared_[i][j] << '\n';
+      }
+    }
+    for(std::size_t node = 0; node != nodes_.size(); ++node){
+      for(std::size_t i = 0; i != devices_.size(); ++i){
+        out << "host " << node << ' ' << i << ' ' << host_[node][i].gib_per_second << ' '
+            << host_[node][i].latency_us << '\n';
+      }
+    }
+  }
+
+  bool load(const std::string& path){
+    std::ifstream in(path);
+    std::string magic, print;
+    int version = 0;
+    std::size_t n = 0, nodes = 0;
+    if(!(in >> magic >> version >> print >> n >> nodes) || magic != "accelerator_views_topology" || version != 1
+       || print != fingerprint_ || n != devices_.size() || nodes != nodes_.size()){
+      return false;
+    }
+    h2d_.assign(n, link_info());
+    d2h_.assign(n, link_info());
+    peer_.assign(n, std::vector<link_info>(n));
+    shared_.assign(n, std::vector<bool>(n, false));
+    host_.assign(nodes, std::vector<link_info>(n));
+    std::string kind;
+    while(in >> kind){
+      std::size_t a = 0, b = 0;
+      link_info l;
+      if(kind == "shared"){
+        bool value = false;
+        if(!(in >> a >> b >> value) || a >= n || b >= n) return false;
+        shared_[a][b] = value;
+        continue;
+      }
+      if(kind == "h2d" || kind == "d2h"){
+        if(!(in >> a >> l.gib_per_second >> l.latency_us) || a >= n) return false;
+        (kind == "h2d" ? h2d_ : d2h_)[a] = l;
+      }
+      else if(kind == "peer" || kind == "host"){
+        if(!(in >> a >> b >> l.gib_per_second >> l.latency_us) || b >= n) return false;
+        if(kind == "peer" && a < n) peer_[a][b] = l;
+        else if(kind == "host" && a < nodes) host_[a][b] = l;
+        else return false;
+      }
+      else {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  std::vector<hc::accelerator> devices_;
+  std::vector<int> nodes_;
+  std::string fingerprint_;
+  bool from_cache_ = false;
+  std::vector<link_info> h2d_, d2h_;
+  std::vector<std::vector<link_info>> peer_;
+  std::vector<std::vector<bool>> shared_;
+  std::vector<std::vector<link_info>> host_;
+};
+
+} // namespace av
+
+#endif // TOPOLOGY_HPP
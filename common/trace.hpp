@@ -0,0 +1,274 @@
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+// Per-operation event tracing for copies, kernels and markers, exported as a Chrome trace
+// (chrome://tracing, or ui.perfetto.dev), so overlap between views, idle gaps and serialization
+// show up on a timeline.
+//
+// Use av::trace::copy_async, parallel_for_each, create_marker and create_blocking_marker in place
+// of the accelerator_view / hc ones; they take an extra label, which must outlive the export (a
+// string literal, typically). Every operation is recorded with its submit tick, its begin and end
+// ticks from the completion_future, its view and device, and its byte or element count.
+//
+// Tracing is compiled in with -DAV_TRACE. Without it, the wrappers just forward, and nothing is
+// recorded. With it, each submitting thread appends to its own ring buffer of
+// AV_TRACE_EVENTS_PER_THREAD events, without locks; when a ring is full, the oldest events are
+// overwritten. The begin and end ticks are only read when exporting, so write_chrome_trace() and
+// clear() must be called when no thread is submitting traced operations, after waiting for them.
+
+#include <hc.hpp>
+#include "json.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#ifndef AV_TRACE_EVENTS_PER_THREAD
+#define AV_TRACE_EVENTS_PER_THREAD 65536
+#endif
+
+namespace av {
+namespace trace {
+
+#ifdef AV_TRACE
+constexpr bool enabled = true;
+#else
+constexpr bool enabled = false;
+#endif
+
+enum class event_kind { copy, kernel, marker };
+
+inline const char* to_string(event_kind kind){
+  switch(kind){
+  case event_kind::copy: return "copy";
+  case event_kind::kernel: return "kernel";
+  case event_kind::marker: return "marker";
+  }
+  return "?";
+}
+
+namespace detail {
+
+struct event {
+  std::uint64_t submit_tick = 0;
+  event_kind kind = event_kind::marker;
+  std::size_t size = 0;       // bytes for copies, elements for kernels
+  const char* label = "";
+  void* queue = nullptr;
+  hc::accelerator acc;
+  mutable hc::completion_future done;  // hcc's is_ready() and tick getters aren't const
+};
+
+// single writer (the owning thread), read by the exporting thread
+class ring {
+public:
+  explicit ring(std::size_t capacity) : events_(capacity) {}
+
+  void push(event e){
+    auto head = head_.load(std::memory_order_relaxed);
+    events_[head % events_.size()] = std::move(e);
+    head_.store(head + 1, std::memory_order_release);
+  }
+
+  template<typename Function>
+  void for_each(Function f) const {
+    auto head = head_.load(std::memory_order_acquire);
+    auto count = std::min<std::uint64_t>(head, events_.size());
+    for(auto i = head - count; i != head; ++i) f(events_[i % events_.size()]);
+  }
+
+  std::uint64_t dropped() const {
+    auto head = head_.load(std::memory_order_acquire);
+    return head > events_.size() ? head - events_.size() : 0;
+  }
+
+  void clear(){
+    for(auto& e: events_) e = event();
+    head_.store(0, std::memory_order_release);
+  }
+
+private:
+  std::vector<event> events_;
+  std::atomic<std::uint64_t> head_{0};
+};
+
+// All rings ever created; rings outlive their threads, so their events can still be exported.
+struct registry {
+  std::mutex mutex;
+  std::vector<std::shared_ptr<ring>> rings;
+
+  static registry& get(){
+    static auto instance = new registry();
+    return *instance;
+  }
+};
+
+inline ring& this_thread_ring(){
+  thread_local std::shared_ptr<ring> mine = []{
+    auto r = std::make_shared<ring>(AV_TRACE_EVENTS_PER_THREAD);
+    auto& reg = registry::get();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    reg.rings.push_back(r);
+    return r;
+  }();
+  return *mine;
+}
+
+} // namespace detail
+
+// For tracing operations the wrappers below don't cover: take submit_tick() right before
+// submitting, and record() right after.
+inline std::uint64_t submit_tick(){
+#ifdef AV_TRACE
+  return hc::get_system_ticks();
+#else
+  return 0;
+#endif
+}
+
+inline void record(hc::accelerator_view& view, std::uint64_t submit, event_kind kind, std::size_t size,
+                   const char* label, const hc::completion_future& done){
+#ifdef AV_TRACE
+  detail::event e;
+  e.submit_tick = submit;
+  e.kind = kind;
+  e.size = size;
+  e.label = label;
+  e.queue = view.get_hsa_queue();
+  e.acc = view.get_accelerator();
+  e.done = done;
+  detail::this_thread_ring().push(std::move(e));
+#else
+  (void)view; (void)submit; (void)kind; (void)size; (void)label; (void)done;
+#endif
+}
+
+inline hc::completion_future copy_async(hc::accelerator_view& view, const void* src, void* dst,
+                                        std::size_t size_bytes, const char* label = "copy"){
+  auto submit = submit_tick();
+  auto done = view.copy_async(src, dst, size_bytes);
+  record(view, submit, event_kind::copy, size_bytes, label, done);
+  return done;
+}
+
+template<int N, typename Kernel>
+hc::completion_future parallel_for_each(hc::accelerator_view& view, const hc::extent<N>& ext, const Kernel& kernel,
+                                        const char* label = "kernel"){
+  auto submit = submit_tick();
+  auto done = hc::parallel_for_each(view, ext, kernel);
+  record(view, submit, event_kind::kernel, ext.size(), label, done);
+  return done;
+}
+
+inline hc::completion_future create_marker(hc::accelerator_view& view, const char* label = "marker"){
+  auto submit = submit_tick();
+  auto done = view.create_marker();
+  record(view, submit, event_kind::marker, 0, label, done);
+  return done;
+}
+
+inline hc::completion_future create_blocking_marker(hc::accelerator_view& view, hc::completion_future& dependency,
+                                                    const char* label = "blocking marker"){
+  auto submit = submit_tick();
+  auto done = view.create_blocking_marker(dependency);
+  record(view, submit, event_kind::marker, 0, label, done);
+  return done;
+}
+
+// events overwritten because a ring was full
+inline std::uint64_t dropped_events(){
+  auto& reg = detail::registry::get();
+  std::lock_guard<std::mutex> lock(reg.mutex);
+  std::uint64_t dropped = 0;
+  for(auto& r: reg.rings) dropped += r->dropped();
+  return dropped;
+}
+
+inline void clear(){
+  auto& reg = detail::registry::get();
+  std::lock_guard<std::mutex> lock(reg.mutex);
+  for(auto& r: reg.rings) r->clear();
+}
+
+// Chrome trace event format: one process for the submitting host threads, one per device with a
+// thread per view. Every operation is a complete event on its view, with a flow arrow from its
+// submission on the host thread. Operations that haven't completed yet are left out.
+inline void write_chrome_trace(std::ostream& out){
+  struct completed {
+    const detail::event* e;
+    std::size_t thread;
+  };
+  std::vector<completed> events;
+  auto& reg = detail::registry::get();
+  std::lock_guard<std::mutex> lock(reg.mutex);
+  for(std::size_t t = 0; t != reg.rings.size(); ++t){
+    reg.rings[t]->for_each([&](const detail::event& e){
+        if(e.done.valid() && e.done.is_ready()) events.push_back(completed{&e, t});
+      });
+  }
+
+  std::uint64_t origin = 0;
+  double ticks_per_us = 1e3;
+  if(!events.empty()){
+    origin = events.front().e->submit_tick;
+    for(auto& c: events) origin = std::min(origin, c.e->submit_tick);
+    ticks_per_us = events.front().e->done.get_tick_frequency() / 1e6;
+  }
+  auto us = [&](std::uint64_t tick){ return tick >= origin ? (tick - origin) / ticks_per_us : 0.0; };
+
+  // pids: 0 for the host, then devices in order of appearance; tids: views in order of appearance
+  std::map<std::wstring, std::size_t> pids;
+  std::map<void*, std::pair<std::size_t, std::size_t>> tids;
+  auto flags = out.flags();
+  auto precision = out.precision();
+  out << std::fixed << std::setprecision(3) << "{\"traceEvents\": [\n";
+  out << "  {\"ph\": \"M\", \"name\": \"process_name\", \"pid\": 0, \"args\": {\"name\": \"host\"}}";
+  for(std::size_t t = 0; t != reg.rings.size(); ++t){
+    out << ",\n  {\"ph\": \"M\", \"name\": \"thread_name\", \"pid\": 0, \"tid\": " << t
+        << ", \"args\": {\"name\": \"submitting thread " << t << "\"}}";
+  }
+  for(auto& c: events){
+    auto path = c.e->acc.get_device_path();
+    auto pid = pids.emplace(path, pids.size() + 1);
+    if(pid.second){
+      out << ",\n  {\"ph\": \"M\", \"name\": \"process_name\", \"pid\": " << pid.first->second
+          << ", \"args\": {\"name\": \"" << json_escape(std::string(path.begin(), path.end())) << "\"}}";
+    }
+    auto tid = tids.emplace(c.e->queue, std::make_pair(pid.first->second, tids.size()));
+    if(tid.second){
+      out << ",\n  {\"ph\": \"M\", \"name\": \"thread_name\", \"pid\": " << pid.first->second
+          << ", \"tid\": " << tid.first->second.second << ", \"args\": {\"name\": \"view "
+          << tid.first->second.second << "\"}}";
+    }
+  }
+  for(std::size_t id = 0; id != events.size(); ++id){
+    auto& e = *events[id].e;
+    auto where = tids[e.queue];
+    auto begin = e.done.get_begin_tick();
+    auto end = std::max(begin, e.done.get_end_tick());
+    out << ",\n  {\"ph\": \"X\", \"name\": \"" << json_escape(e.label) << "\", \"cat\": \"" << to_string(e.kind)
+        << "\", \"pid\": " << where.first << ", \"tid\": " << where.second << ", \"ts\": " << us(begin)
+        << ", \"dur\": " << us(end) - us(begin) << ", \"args\": {\""
+        << (e.kind == event_kind::kernel ? "elements" : "bytes") << "\": " << e.size
+        << ", \"submit_us\": " << us(e.submit_tick) << ", \"queued_us\": " << us(begin) - us(e.submit_tick) << "}}";
+    out << ",\n  {\"ph\": \"s\", \"name\": \"submit\", \"cat\": \"submit\", \"id\": " << id
+        << ", \"pid\": 0, \"tid\": " << events[id].thread << ", \"ts\": " << us(e.submit_tick) << '}';
+    out << ",\n  {\"ph\": \"f\", \"bp\": \"e\", \"name\": \"submit\", \"cat\": \"submit\", \"id\": " << id
+        << ", \"pid\": " << where.first << ", \"tid\": " << where.second << ", \"ts\": " << us(begin) << '}';
+  }
+  out << "\n]}\n";
+  out.flags(flags);
+  out.precision(precision);
+}
+
+} // namespace trace
+} // namespace av
+
+#endif // TRACE_HPP
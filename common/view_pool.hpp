@@ -0,0 +1,247 @@
+#ifndef VIEW_POOL_HPP
+#define VIEW_POOL_HPP
+
+// A pool of accelerator_views on one accelerator that picks its own size.
+//
+// Operations on one view serialize, operations on different views may overlap, and how many views
+// it takes to keep copies and kernels overlapping depends on the mix of work and on the hardware.
+// view_pool hands out its active views round-robin or least-loaded, and measures, per epoch of
+// epoch_ops submissions:
+//  - throughput: operations completed per second,
+//  - occupancy: operations pending per active view, sampled at every submission,
+//  - overlap: views with pending operations, at the same samples.
+// After every epoch, it hill-climbs: it keeps adding (or removing) views as long as throughput
+// improves by more than the tolerance, and goes back to the best count once it doesn't. When
+// neither direction helps, it stays at the best count for settle_epochs, then measures that count
+// again and explores anew, so a changing workload is followed. Low occupancy (views idle at
+// submission) makes it try fewer views first.
+//
+// Views beyond the active count are kept, not destroyed, so growing again is free, and work still
+// queued on them completes as usual.
+
+#include <hc.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+namespace av {
+
+struct view_pool_stats {
+  std::size_t views = 0;            // active now
+  std::size_t epochs = 0;
+  std::size_t resizes = 0;
+  double ops_per_second = 0;        // last epoch
+  double occupancy = 0;             // last epoch, pending operations per active view
+  double overlap = 0;               // last epoch, views busy at the same time
+  std::size_t best_views = 0;
+  double best_ops_per_second = 0;
+};
+
+class view_pool {
+public:
+  enum class policy { round_robin, least_loaded };
+
+  struct options {
+    std::size_t min_views = 1;
+    std::size_t max_views = 8;
+    std::size_t initial_views = 2;
+    policy pick = policy::least_loaded;
+    std::size_t epoch_ops = 64;       // submissions per measurement
+    double tolerance = 0.05;          // relative throughput gain that counts as better
+    std::size_t settle_epochs = 16;   // epochs at the best count before exploring again
+    bool adaptive = true;             // false: stay at initial_views
+  };
+
+  explicit view_pool(hc::accelerator acc) : view_pool(acc, options()) {}
+
+  view_pool(hc::accelerator acc, const options& opts)
+    : acc_(acc), opts_(opts)
+  {
+    if(opts_.min_views == 0 || opts_.min_views > opts_.max_views || opts_.epoch_ops == 0){
+      throw std::invalid_argument("view_pool: need 0 < min_views <= max_views and a non-zero epoch");
+    }
+    active_ = std::min(std::max(opts_.initial_views, opts_.min_views), opts_.max_views);
+    for(std::size_t i = 0; i != active_; ++i) views_.push_back(acc_.create_view());
+    epoch_start_ = std::chrono::steady_clock::now();
+  }
+
+  view_pool(const view_pool&) = delete;
+  view_pool& operator=(const view_pool&) = delete;
+
+  ~view_pool(){ wait(); }
+
+  // Submits fn(view) to one of the active views; fn returns the completion_future of the last
+  // operation it submitted, which is what counts as completed for throughput.
+  template<typename Submit>
+  hc::completion_future submit(Submit fn){
+    hc::accelerator_view view = acquire();
+    hc::completion_future done = fn(view);
+    std::lock_guard<std::mutex> lock(mutex_);
+    in_flight_.push_back(done);
+    return done;
+  }
+
+  // A view to submit to, counted as one submission of the current epoch. Operations submitted to
+  // it directly aren't counted as completed; use submit() for that.
+  hc::accelerator_view acquire(){
+    std::lock_guard<std::mutex> lock(mutex_);
+    sample();
+    if(++submitted_ == opts_.epoch_ops) end_epoch();
+    return views_[pick()];
+  }
+
+  // waits for everything submitted to any view, active or not
+  void wait(){
+    std::vector<hc::accelerator_view> views;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      views = views_;
+    }
+    for(auto& view: views) view.wait();
+  }
+
+  std::size_t size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return active_;
+  }
+
+  view_pool_stats stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto s = stats_;
+    s.views = active_;
+    s.best_views = best_views_;
+    s.best_ops_per_second = best_rate_;
+    return s;
+  }
+
+  hc::accelerator get_accelerator() const { return acc_; }
+
+private:
+  std::size_t pick(){
+    if(opts_.pick == policy::round_robin) return next_++ % active_;
+    std::size_t best = 0;
+    int best_pending = views_[0].get_pending_async_ops();
+    for(std::size_t i = 1; i != active_ && best_pending > 0; ++i){
+      int pending = views_[i].get_pending_async_ops();
+      if(pending < best_pending){
+        best = i;
+        best_pending = pending;
+      }
+    }
+    return best;
+  }
+
+  void sample(){
+    for(std::size_t i = 0; i != active_; ++i){
+      int pending = views_[i].get_pending_async_ops();
+      pending_sum_ += pending;
+      busy_sum_ += pending > 0;
+    }
+    ++samples_;
+  }
+
+  void end_epoch(){
+    auto now = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(now - epoch_start_).count();
+    std::size_t completed = collect_completed();
+    stats_.epochs++;
+    stats_.ops_per_second = seconds > 0 ? completed / seconds : 0;
+    stats_.occupancy = samples_ ? 1.0 * pending_sum_ / (samples_ * active_) : 0;
+    stats_.overlap = samples_ ? 1.0 * busy_sum_ / samples_ : 0;
+    submitted_ = 0;
+    samples_ = 0;
+    pending_sum_ = 0;
+    busy_sum_ = 0;
+    epoch_start_ = now;
+    if(opts_.adaptive) resize(next_size(stats_.ops_per_second, stats_.occupancy));
+  }
+
+  // Drops the submitted operations that have completed, and returns how many. Completions are
+  // counted here, at the end of the epoch, rather than with completion_future::then, which on hcc
+  // makes dropping the future wait for the operation.
+  std::size_t collect_completed(){
+    auto still_running = std::partition(in_flight_.begin(), in_flight_.end(),
+                                        [](hc::completion_future& f){ return !f.is_ready(); });
+    std::size_t completed = in_flight_.end() - still_running;
+    in_flight_.erase(still_running, in_flight_.end());
+    return completed;
+  }
+
+  // the active count for the next epoch, given what this one achieved
+  std::size_t next_size(double rate, double occupancy){
+    if(settling_ > 0){
+      if(--settling_ == 0) best_rate_ = 0; // measure the best count afresh, then explore again
+      return active_;
+    }
+    if(best_rate_ == 0){
+      best_rate_ = rate;
+      best_views_ = active_;
+      failed_directions_ = 0;
+      direction_ = occupancy < 1 ? -1 : 1;
+      return step(true);
+    }
+    if(rate > best_rate_ * (1 + opts_.tolerance)){
+      best_rate_ = rate;
+      best_views_ = active_;
+      failed_directions_ = 1; // the count we came from is worse
+      return step(false);
+    }
+    // no better: try the other side of the best count, unless that has been tried
+    direction_ = -direction_;
+    if(++failed_directions_ < 2 && can_move(best_views_)) return neighbour(best_views_);
+    failed_directions_ = 0;
+    settling_ = opts_.settle_epochs;
+    return best_views_;
+  }
+
+  bool can_move(std::size_t from) const {
+    return direction_ > 0 ? from < opts_.max_views : from > opts_.min_views;
+  }
+
+  std::size_t neighbour(std::size_t from) const { return direction_ > 0 ? from + 1 : from - 1; }
+
+  // one view more or less in the current direction; at a bound, turn around if allowed, or settle
+  std::size_t step(bool may_turn){
+    if(!can_move(active_) && may_turn) direction_ = -direction_;
+    if(can_move(active_)) return neighbour(active_);
+    settling_ = opts_.settle_epochs;
+    return active_;
+  }
+
+  void resize(std::size_t views){
+    if(views == active_) return;
+    while(views_.size() < views) views_.push_back(acc_.create_view());
+    active_ = views;
+    stats_.resizes++;
+  }
+
+  hc::accelerator acc_;
+  options opts_;
+  mutable std::mutex mutex_;
+  std::vector<hc::accelerator_view> views_;  // the first active_ are handed out
+  std::size_t active_;
+  std::size_t next_ = 0;
+
+  // current epoch
+  std::chrono::steady_clock::time_point epoch_start_;
+  std::size_t submitted_ = 0;
+  std::size_t samples_ = 0;
+  std::size_t pending_sum_ = 0;
+  std::size_t busy_sum_ = 0;
+  std::vector<hc::completion_future> in_flight_;  // from submit(), not yet counted as completed
+
+  // hill climbing
+  int direction_ = 1;
+  double best_rate_ = 0;
+  std::size_t best_views_ = 0;
+  std::size_t failed_directions_ = 0;
+  std::size_t settling_ = 0;
+  view_pool_stats stats_;
+};
+
+} // namespace av
+
+#endif // VIEW_POOL_HPP
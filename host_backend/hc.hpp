@@ -0,0 +1,601 @@
+#ifndef HC_HOST_HPP
+#define HC_HOST_HPP
+
+// Host backend for the subset of the hc API used in these examples. Build with BACKEND=host to
+// run the examples on machines without ROCm/hcc or a GPU.
+//
+// Mapping onto the host:
+// * every accelerator other than "cpu" is a simulated device: a NUMA node's memory (device memory
+//   is bound to that node) plus a pool of compute threads;
+// * every accelerator_view is an in-order queue drained by its own worker thread, so submission is
+//   asynchronous and execution is sequential per view, just like on HSA queues;
+// * copy_async is a memcpy on the view's worker thread, parallel_for_each runs the kernel on the
+//   device's compute threads;
+// * a tile of a tiled parallel_for_each runs on one compute thread, its work-items as fibers, and
+//   tile_static variables are static thread_local, so they are shared by the work-items of a tile;
+// * accelerator_view::copy_async insists on am_alloc-ed memory, and on device memory of another
+//   device being mapped with am_map_to_peers, and throws a Kalmar::runtime_exception where hcc
+//   would crash.
+//
+// [[hc]] attributes are ignored by the host compiler; build with -Wno-attributes. Code that needs to
+// know which backend it is built for can test HC_HOST_BACKEND.
+
+#include "hc_host_detail.hpp"
+
+#define HC_HOST_BACKEND 1
+
+// Shared by the work-items of a tile, which all run on the same thread. As with hcc, no
+// initializers, and only inside tiled kernels.
+#define tile_static static thread_local
+
+#include <initializer_list>
+#include <iterator>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace Kalmar {
+
+class runtime_exception : public std::exception {
+public:
+  runtime_exception(const char* message, int error_code)
+    : message_(message), error_code_(error_code)
+  {}
+  const char* what() const noexcept override { return message_.c_str(); }
+  int get_error_code() const { return error_code_; }
+private:
+  std::string message_;
+  int error_code_;
+};
+
+} // namespace Kalmar
+
+namespace hc {
+
+using runtime_exception = Kalmar::runtime_exception;
+
+enum hcWaitMode {
+  hcWaitModeBlocked = 0,
+  hcWaitModeActive = 1
+};
+
+// Only meaningful for cache coherence on real hardware; the host backend accepts and ignores it.
+enum memory_scope {
+  no_scope = 0,
+  accelerator_scope = 1,
+  system_scope = 2
+};
+
+class accelerator;
+class accelerator_view;
+class completion_future;
+template<int N> class tiled_extent;
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// index and extent
+
+template<int N>
+class index {
+public:
+  static const int rank = N;
+
+  index() : v_{} {}
+  explicit index(int i0) : v_{i0} { static_assert(N == 1, "index<N>: wrong number of components"); }
+  index(int i0, int i1) : v_{i0, i1} { static_assert(N == 2, "index<N>: wrong number of components"); }
+  index(int i0, int i1, int i2) : v_{i0, i1, i2} { static_assert(N == 3, "index<N>: wrong number of components"); }
+
+  int operator[](unsigned i) const { return v_[i]; }
+  int& operator[](unsigned i) { return v_[i]; }
+
+  bool operator==(const index& other) const { return std::equal(v_, v_ + N, other.v_); }
+  bool operator!=(const index& other) const { return !(*this == other); }
+
+private:
+  int v_[N];
+};
+
+template<int N>
+class extent {
+public:
+  static const int rank = N;
+
+  extent() : v_{} {}
+  explicit extent(int e0) : v_{e0} { static_assert(N == 1, "extent<N>: wrong number of components"); }
+  extent(int e0, int e1) : v_{e0, e1} { static_assert(N == 2, "extent<N>: wrong number of components"); }
+  extent(int e0, int e1, int e2) : v_{e0, e1, e2} { static_assert(N == 3, "extent<N>: wrong number of components"); }
+
+  int operator[](unsigned i) const { return v_[i]; }
+  int& operator[](unsigned i) { return v_[i]; }
+
+  unsigned int size() const {
+    unsigned int result = 1;
+    for(int i = 0; i != N; ++i) result *= v_[i];
+    return result;
+  }
+
+  bool contains(const index<N>& idx) const {
+    for(int i = 0; i != N; ++i){
+      if(idx[i] < 0 || idx[i] >= v_[i]) return false;
+    }
+    return true;
+  }
+
+  bool operator==(const extent& other) const { return std::equal(v_, v_ + N, other.v_); }
+  bool operator!=(const extent& other) const { return !(*this == other); }
+
+  tiled_extent<1> tile(int t0) const;
+  tiled_extent<2> tile(int t0, int t1) const;
+  tiled_extent<3> tile(int t0, int t1, int t2) const;
+
+private:
+  int v_[N];
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// tiles
+
+// An extent split into tiles of tile_dim work-items. The extent need not be a multiple of the
+// tile: as with hcc, the last tile in a dimension then has fewer work-items.
+template<int N>
+class tiled_extent : public extent<N> {
+public:
+  tiled_extent() : tile_dim{} {}
+  tiled_extent(const extent<N>& ext, int t0) : extent<N>(ext), tile_dim{t0} {
+    static_assert(N == 1, "tiled_extent<N>: wrong number of tile components");
+  }
+  tiled_extent(const extent<N>& ext, int t0, int t1) : extent<N>(ext), tile_dim{t0, t1} {
+    static_assert(N == 2, "tiled_extent<N>: wrong number of tile components");
+  }
+  tiled_extent(const extent<N>& ext, int t0, int t1, int t2) : extent<N>(ext), tile_dim{t0, t1, t2} {
+    static_assert(N == 3, "tiled_extent<N>: wrong number of tile components");
+  }
+
+  int tile_dim[N];
+};
+
+template<int N>
+tiled_extent<1> extent<N>::tile(int t0) const { return tiled_extent<1>(*this, t0); }
+template<int N>
+tiled_extent<2> extent<N>::tile(int t0, int t1) const { return tiled_extent<2>(*this, t0, t1); }
+template<int N>
+tiled_extent<3> extent<N>::tile(int t0, int t1, int t2) const { return tiled_extent<3>(*this, t0, t1, t2); }
+
+class tile_barrier {
+public:
+  tile_barrier() {}
+  void wait() const { detail::tile_runner::current().barrier(); }
+  // all memory is coherent on the host
+  void wait_with_all_memory_fence() const { wait(); }
+  void wait_with_global_memory_fence() const { wait(); }
+  void wait_with_tile_static_memory_fence() const { wait(); }
+};
+
+template<int N>
+class tiled_index {
+public:
+  tiled_index(const index<N>& global, const index<N>& local, const index<N>& tile, const index<N>& tile_origin,
+              const extent<N>& tile_dim)
+    : global(global), local(local), tile(tile), tile_origin(tile_origin), tile_dim(tile_dim)
+  {}
+
+  const index<N> global;
+  const index<N> local;
+  const index<N> tile;
+  const index<N> tile_origin;
+  const tile_barrier barrier;
+  const extent<N> tile_dim;
+
+  operator const index<N>() const { return global; }
+};
+
+namespace detail {
+
+// row-major, last component varies fastest
+template<int N>
+index<N> delinearize(const extent<N>& ext, std::size_t linear){
+  index<N> idx;
+  for(int i = N - 1; i >= 0; --i){
+    idx[i] = linear % ext[i];
+    linear /= ext[i];
+  }
+  return idx;
+}
+
+template<int N>
+std::size_t linearize(const extent<N>& ext, const index<N>& idx){
+  std::size_t linear = 0;
+  for(int i = 0; i != N; ++i) linear = linear * ext[i] + idx[i];
+  return linear;
+}
+
+} // namespace detail
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// completion_future
+
+class completion_future {
+public:
+  completion_future() = default;
+
+  // backend-internal
+  explicit completion_future(std::shared_ptr<detail::signal> sig) : signal_(std::move(sig)) {}
+
+  bool valid() const { return static_cast<bool>(signal_); }
+
+  void wait(hcWaitMode mode = hcWaitModeBlocked) const {
+    if(!signal_) return;
+    if(mode == hcWaitModeActive){
+      while(!signal_->is_ready()) std::this_thread::yield();
+    }
+    else {
+      signal_->wait();
+    }
+  }
+
+  // waits, and rethrows whatever the operation threw
+  void get() const {
+    if(!signal_) return;
+    signal_->wait();
+    if(auto error = signal_->error()) std::rethrow_exception(error);
+  }
+
+  // not const, nor are the tick getters, as in hcc, so that code hcc rejects doesn't build here
+  bool is_ready(){ return !signal_ || signal_->is_ready(); }
+
+  // func runs on the view's worker thread when the operation completes, or right away if it has
+  template<typename Functor>
+  void then(const Functor& func){
+    if(signal_) signal_->on_complete(func);
+    else func();
+  }
+
+  bool is_marker() const { return signal_ && signal_->kind() == hcCommandMarker; }
+
+  std::uint64_t get_begin_tick() { return signal_ ? signal_->begin_tick() : 0; }
+  std::uint64_t get_end_tick() { return signal_ ? signal_->end_tick() : 0; }
+  std::uint64_t get_tick_frequency() { return detail::tick_frequency; }
+
+  // backend-internal
+  const std::shared_ptr<detail::signal>& get_signal() const { return signal_; }
+
+private:
+  std::shared_ptr<detail::signal> signal_;
+};
+
+// same clock as the completion_future ticks
+inline std::uint64_t get_system_ticks(){ return detail::now_ticks(); }
+inline std::uint64_t get_system_ticks_frequency(){ return detail::tick_frequency; }
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// accelerator_view
+
+class accelerator_view {
+public:
+  // backend-internal
+  explicit accelerator_view(std::shared_ptr<detail::queue> q) : queue_(std::move(q)) {}
+
+  accelerator get_accelerator() const;
+
+  void wait(hcWaitMode mode = hcWaitModeBlocked){
+    if(mode == hcWaitModeActive) create_marker().wait(mode);
+    else queue_->wait();
+  }
+
+  // completes once everything submitted before it has completed
+  completion_future create_marker(){
+    return completion_future(queue_->enqueue(hcCommandMarker, nullptr));
+  }
+
+  // completes once everything submitted before it has completed, and dependent_future has
+  // completed; operations submitted after it don't start before that. dependent_future may come
+  // from any view, on any accelerator.
+  completion_future create_blocking_marker(completion_future& dependent_future, memory_scope scope = system_scope){
+    return create_blocking_marker(std::initializer_list<completion_future>{dependent_future}, scope);
+  }
+
+  completion_future create_blocking_marker(std::initializer_list<completion_future> dependent_future_list,
+                                           memory_scope = system_scope){
+    std::vector<std::shared_ptr<detail::signal>> dependencies;
+    for(auto& fut: dependent_future_list){
+      if(fut.valid()) dependencies.push_back(fut.get_signal());
+    }
+    return completion_future(queue_->enqueue(hcCommandMarker, [dependencies]{
+          for(auto& dependency: dependencies) dependency->wait();
+        }));
+  }
+
+  // Both pointers must be am_alloc-ed (host-pinned or device memory), and device memory of another
+  // accelerator must have been mapped to this view's accelerator with am_map_to_peers.
+  completion_future copy_async(const void* src, void* dst, std::size_t size_bytes);
+
+  void copy(const void* src, void* dst, std::size_t size_bytes){
+    copy_async(src, dst, size_bytes).get();
+  }
+
+  bool operator==(const accelerator_view& other) const { return queue_ == other.queue_; }
+  bool operator!=(const accelerator_view& other) const { return !(*this == other); }
+
+  // operations submitted to the view that haven't completed yet
+  int get_pending_async_ops() const { return static_cast<int>(queue_->pending()); }
+
+  // identifies the underlying queue; views created with create_view() each have their own
+  void* get_hsa_queue() const { return queue_.get(); }
+
+  // backend-internal
+  detail::queue& get_queue() const { return *queue_; }
+
+private:
+  std::shared_ptr<detail::queue> queue_;
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// accelerator
+
+class accelerator {
+public:
+  accelerator() : device_(&detail::runtime::get().default_device()) {}
+
+  explicit accelerator(const std::wstring& path) : device_(nullptr) {
+    for(auto& dev: detail::runtime::get().devices()){
+      if(dev->path() == path) device_ = dev.get();
+    }
+    if(!device_) throw runtime_exception("accelerator: no such device path", -1);
+  }
+
+  // backend-internal
+  explicit accelerator(detail::device* dev) : device_(dev) {}
+
+  static std::vector<accelerator> get_all(){
+    std::vector<accelerator> result;
+    for(auto& dev: detail::runtime::get().devices()) result.emplace_back(dev.get());
+    return result;
+  }
+
+  accelerator_view get_default_view() const { return accelerator_view(device_->default_queue()); }
+
+  accelerator_view create_view(){ return accelerator_view(std::make_shared<detail::queue>(*device_)); }
+
+  std::wstring get_device_path() const { return device_->path(); }
+  std::wstring get_description() const { return device_->description(); }
+  // in KB, as in C++ AMP
+  std::size_t get_dedicated_memory() const { return device_->memory_bytes() / 1024; }
+  bool get_has_display() const { return false; }
+  bool get_is_emulated() const { return device_->is_cpu(); }
+
+  bool operator==(const accelerator& other) const { return device_ == other.device_; }
+  bool operator!=(const accelerator& other) const { return !(*this == other); }
+
+  // backend-internal
+  detail::device& get_device() const { return *device_; }
+
+private:
+  detail::device* device_;
+};
+
+inline accelerator accelerator_view::get_accelerator() const {
+  return accelerator(&queue_->get_device());
+}
+
+inline completion_future accelerator_view::copy_async(const void* src, void* dst, std::size_t size_bytes){
+  auto& tracker = detail::runtime::get().tracker();
+  detail::allocation src_info, dst_info;
+  if(!tracker.find(src, &src_info) || !tracker.find(dst, &dst_info)){
+    throw runtime_exception("accelerator_view::copy_async: pointer not allocated with am_alloc", -1);
+  }
+  if(!src_info.contains(src, size_bytes) || !dst_info.contains(dst, size_bytes)){
+    throw runtime_exception("accelerator_view::copy_async: copy exceeds allocation", -1);
+  }
+  auto& dev = queue_->get_device();
+  if(!src_info.accessible_from(dev) || !dst_info.accessible_from(dev)){
+    throw runtime_exception("accelerator_view::copy_async: device memory not mapped to this accelerator"
+                            " (missing am_map_to_peers?)", -1);
+  }
+  hcCommandKind kind = src_info.is_device_memory
+    ? (dst_info.is_device_memory ? hcMemcpyDeviceToDevice : hcMemcpyDeviceToHost)
+    : (dst_info.is_device_memory ? hcMemcpyHostToDevice : hcMemcpyHostToHost);
+  return completion_future(queue_->enqueue(kind, [=]{ std::memcpy(dst, src, size_bytes); }));
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// array
+
+template<typename T, int N = 1>
+class array {
+public:
+  explicit array(const extent<N>& ext)
+    : array(ext, accelerator().get_default_view())
+  {}
+
+  array(const extent<N>& ext, accelerator_view av)
+    : ext_(ext), view_(av), owns_(true)
+  {
+    ptr_ = static_cast<T*>(detail::allocate(view_.get_queue().get_device(), ext_.size() * sizeof(T), 0));
+    if(!ptr_ && ext_.size() != 0) throw runtime_exception("array: out of device memory", -1);
+  }
+
+  // non-owning: wraps memory am_alloc-ed by the caller, who remains responsible for am_free
+  array(const extent<N>& ext, accelerator_view av, void* accelerator_pointer)
+    : ext_(ext), view_(av), ptr_(static_cast<T*>(accelerator_pointer)), owns_(false)
+  {}
+
+  explicit array(int e0) : array(extent<N>(e0)) {}
+
+  array(const array& other)
+    : array(other.ext_, other.view_)
+  {
+    view_.copy(other.ptr_, ptr_, ext_.size() * sizeof(T));
+  }
+
+  array(array&& other) noexcept
+    : ext_(other.ext_), view_(other.view_), ptr_(other.ptr_), owns_(other.owns_)
+  {
+    other.ptr_ = nullptr;
+    other.owns_ = false;
+  }
+
+  array& operator=(const array&) = delete;
+
+  ~array(){
+    if(owns_ && ptr_){
+      view_.wait(); // don't pull the memory from under queued operations
+      detail::deallocate(ptr_);
+    }
+  }
+
+  extent<N> get_extent() const { return ext_; }
+  accelerator_view get_accelerator_view() const { return view_; }
+
+  T* accelerator_pointer() const { return ptr_; }
+  T* data() const { return ptr_; }
+
+  T& operator[](const index<N>& idx) const { return ptr_[detail::linearize(ext_, idx)]; }
+  T& operator[](int i0) const {
+    static_assert(N == 1, "array<T,N>::operator[](int) requires N == 1");
+    return ptr_[i0];
+  }
+  T& operator()(const index<N>& idx) const { return (*this)[idx]; }
+  T& operator()(int i0, int i1) const { return (*this)[index<2>(i0, i1)]; }
+  T& operator()(int i0, int i1, int i2) const { return (*this)[index<3>(i0, i1, i2)]; }
+
+private:
+  extent<N> ext_;
+  accelerator_view view_;
+  T* ptr_;
+  bool owns_;
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// parallel_for_each
+
+template<int N, typename Kernel>
+completion_future parallel_for_each(const accelerator_view& av, const extent<N>& ext, const Kernel& kernel){
+  auto& q = av.get_queue();
+  auto& dev = q.get_device();
+  return completion_future(q.enqueue(hcCommandKernel, [ext, kernel, &dev]{
+        dev.pool().parallel_for(ext.size(), [&](std::size_t begin, std::size_t end){
+            for(std::size_t i = begin; i != end; ++i){
+              kernel(detail::delinearize(ext, i));
+            }
+          });
+      }));
+}
+
+template<int N, typename Kernel>
+completion_future parallel_for_each(const extent<N>& ext, const Kernel& kernel){
+  return parallel_for_each(accelerator().get_default_view(), ext, kernel);
+}
+
+// Tiles are distributed over the compute threads; each runs on one thread, its work-items as fibers
+// (see detail::tile_runner).
+template<int N, typename Kernel>
+completion_future parallel_for_each(const accelerator_view& av, const tiled_extent<N>& ext, const Kernel& kernel){
+  extent<N> tiles, tile_dim;
+  for(int i = 0; i != N; ++i){
+    if(ext.tile_dim[i] <= 0) throw runtime_exception("parallel_for_each: tile sizes must be positive", -1);
+    tile_dim[i] = ext.tile_dim[i];
+    tiles[i] = (ext[i] + tile_dim[i] - 1) / tile_dim[i];
+  }
+  auto& q = av.get_queue();
+  auto& dev = q.get_device();
+  return completion_future(q.enqueue(hcCommandKernel, [ext, tiles, tile_dim, kernel, &dev]{
+        dev.pool().parallel_for(tiles.size(), [&](std::size_t begin, std::size_t end){
+            for(std::size_t t = begin; t != end; ++t){
+              index<N> tile = detail::delinearize(tiles, t), origin;
+              extent<N> items;  // tile_dim, or less in the last tile of a dimension
+              for(int i = 0; i != N; ++i){
+                origin[i] = tile[i] * tile_dim[i];
+                items[i] = std::min(tile_dim[i], ext[i] - origin[i]);
+              }
+              detail::tile_runner::current().run(items.size(), [&](std::size_t item){
+                  index<N> local = detail::delinearize(items, item), global;
+                  for(int i = 0; i != N; ++i) global[i] = origin[i] + local[i];
+                  kernel(tiled_index<N>(global, local, tile, origin, tile_dim));
+                });
+            }
+          });
+      }));
+}
+
+template<int N, typename Kernel>
+completion_future parallel_for_each(const tiled_extent<N>& ext, const Kernel& kernel){
+  return parallel_for_each(accelerator().get_default_view(), ext, kernel);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// Global copy functions. Submitted to the array's view. Unlike accelerator_view::copy_async, these
+// accept any host memory. The iterator overloads gather/scatter through a temporary host buffer,
+// which is what makes copying from begin() slower than from data().
+
+namespace detail {
+
+template<typename T>
+using enable_if_iterator = typename std::enable_if<!std::is_pointer<T>::value
+                                                   && !std::is_integral<T>::value>::type;
+
+} // namespace detail
+
+template<typename T, int N>
+completion_future copy_async(const T* src, array<T, N>& dst){
+  T* dst_ptr = dst.accelerator_pointer();
+  std::size_t bytes = dst.get_extent().size() * sizeof(T);
+  return completion_future(dst.get_accelerator_view().get_queue().enqueue(
+      hcMemcpyHostToDevice, [=]{ std::memcpy(dst_ptr, src, bytes); }));
+}
+
+template<typename T, int N>
+completion_future copy_async(const array<T, N>& src, T* dst){
+  const T* src_ptr = src.accelerator_pointer();
+  std::size_t bytes = src.get_extent().size() * sizeof(T);
+  return completion_future(src.get_accelerator_view().get_queue().enqueue(
+      hcMemcpyDeviceToHost, [=]{ std::memcpy(dst, src_ptr, bytes); }));
+}
+
+template<typename InputIter, typename T, int N, typename = detail::enable_if_iterator<InputIter>>
+completion_future copy_async(InputIter src_begin, InputIter src_end, array<T, N>& dst){
+  auto staging = std::make_shared<std::vector<T>>();
+  for(; src_begin != src_end; ++src_begin) staging->push_back(*src_begin);
+  if(staging->size() > dst.get_extent().size()){
+    throw runtime_exception("copy_async: source range larger than destination array", -1);
+  }
+  T* dst_ptr = dst.accelerator_pointer();
+  return completion_future(dst.get_accelerator_view().get_queue().enqueue(
+      hcMemcpyHostToDevice, [=]{ std::memcpy(dst_ptr, staging->data(), staging->size() * sizeof(T)); }));
+}
+
+template<typename InputIter, typename T, int N, typename = detail::enable_if_iterator<InputIter>>
+completion_future copy_async(InputIter src_begin, array<T, N>& dst){
+  InputIter src_end = src_begin;
+  std::advance(src_end, dst.get_extent().size());
+  return copy_async(src_begin, src_end, dst);
+}
+
+template<typename OutputIter, typename T, int N, typename = detail::enable_if_iterator<OutputIter>>
+completion_future copy_async(const array<T, N>& src, OutputIter dst_begin){
+  const T* src_ptr = src.accelerator_pointer();
+  std::size_t count = src.get_extent().size();
+  return completion_future(src.get_accelerator_view().get_queue().enqueue(
+      hcMemcpyDeviceToHost, [=]{
+        std::vector<T> staging(src_ptr, src_ptr + count);
+        std::copy(staging.begin(), staging.end(), dst_begin);
+      }));
+}
+
+template<typename T, int N>
+void copy(const T* src, array<T, N>& dst){ copy_async(src, dst).get(); }
+
+template<typename T, int N>
+void copy(const array<T, N>& src, T* dst){ copy_async(src, dst).get(); }
+
+template<typename InputIter, typename T, int N, typename = detail::enable_if_iterator<InputIter>>
+void copy(InputIter src_begin, InputIter src_end, array<T, N>& dst){ copy_async(src_begin, src_end, dst).get(); }
+
+template<typename InputIter, typename T, int N, typename = detail::enable_if_iterator<InputIter>>
+void copy(InputIter src_begin, array<T, N>& dst){ copy_async(src_begin, dst).get(); }
+
+template<typename OutputIter, typename T, int N, typename = detail::enable_if_iterator<OutputIter>>
+void copy(const array<T, N>& src, OutputIter dst_begin){ copy_async(src, dst_begin).get(); }
+
+} // namespace hc
+
+#endif // HC_HOST_HPP
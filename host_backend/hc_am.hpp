@@ -0,0 +1,171 @@
+#ifndef HC_AM_HOST_HPP
+#define HC_AM_HOST_HPP
+
+// Host backend for the hc_am memory management API: am_alloc/am_free, the memory tracker, peer
+// mappings, and sharing allocations with other processes (am_ipc_memory_*, host backend only). See
+// hc.hpp for how the host backend maps devices onto NUMA nodes.
+
+#include "hc.hpp"
+
+#define AM_SUCCESS 0
+#define AM_ERROR_MISC -1
+
+#define amHostPinned 0x1
+#define amHostNonCoherent 0x1
+#define amHostCoherent 0x2
+
+namespace hc {
+
+typedef void* auto_voidp;
+typedef int am_status_t;
+
+class AmPointerInfo {
+public:
+  void* _hostPointer;
+  void* _devicePointer;
+  void* _unalignedDevicePointer;
+  std::size_t _sizeBytes;
+  hc::accelerator _acc;
+  bool _isInDeviceMem;
+  bool _isAmManaged;
+  std::uint64_t _allocSeqNum;
+  int _appId;
+  unsigned _appAllocationFlags;
+  void* _appPtr;
+
+  AmPointerInfo(void* hostPointer, void* devicePointer, void* unalignedDevicePointer, std::size_t sizeBytes,
+                hc::accelerator& acc, bool isInDeviceMem = false, bool isAmManaged = false)
+    : _hostPointer(hostPointer), _devicePointer(devicePointer), _unalignedDevicePointer(unalignedDevicePointer),
+      _sizeBytes(sizeBytes), _acc(acc), _isInDeviceMem(isInDeviceMem), _isAmManaged(isAmManaged),
+      _allocSeqNum(0), _appId(-1), _appAllocationFlags(0), _appPtr(nullptr)
+  {}
+};
+
+// Returns nullptr if size is 0 or if the accelerator is out of (simulated) dedicated memory.
+inline auto_voidp am_alloc(std::size_t size, hc::accelerator& acc, unsigned flags){
+  return detail::allocate(acc.get_device(), size, flags);
+}
+
+inline am_status_t am_free(void* ptr){
+  if(!ptr) return AM_SUCCESS;
+  return detail::deallocate(ptr) ? AM_SUCCESS : AM_ERROR_MISC;
+}
+
+inline am_status_t am_copy(void* dst, const void* src, std::size_t sizeBytes){
+  std::memcpy(dst, src, sizeBytes);
+  return AM_SUCCESS;
+}
+
+inline am_status_t am_memtracker_getinfo(AmPointerInfo* info, const void* ptr){
+  detail::allocation alloc;
+  if(!detail::runtime::get().tracker().find(ptr, &alloc)) return AM_ERROR_MISC;
+  void* base = reinterpret_cast<void*>(alloc.base);
+  info->_hostPointer = alloc.is_device_memory ? nullptr : base;
+  info->_devicePointer = base;
+  info->_unalignedDevicePointer = base;
+  info->_sizeBytes = alloc.size;
+  info->_acc = accelerator(alloc.owner);
+  info->_isInDeviceMem = alloc.is_device_memory;
+  info->_isAmManaged = !alloc.is_locked;
+  info->_allocSeqNum = alloc.seq;
+  info->_appAllocationFlags = alloc.flags;
+  return AM_SUCCESS;
+}
+
+// Gives the listed accelerators access to the allocation containing ptr. Mapping an allocation
+// again, or to its own accelerator, is harmless.
+inline am_status_t am_map_to_peers(void* ptr, std::size_t num_peer, const hc::accelerator* peers){
+  auto& tracker = detail::runtime::get().tracker();
+  detail::allocation alloc;
+  if(!tracker.find(ptr, &alloc)) return AM_ERROR_MISC;
+  for(std::size_t i = 0; i != num_peer; ++i){
+    tracker.map_to(ptr, peers[i].get_device().id());
+  }
+  return AM_SUCCESS;
+}
+
+// Registers existing host memory, e.g. from mmap, so that it can be used like am_alloc-ed pinned
+// memory, by acc and the visible accelerators. am_free refuses it; unlock it instead.
+inline am_status_t am_memory_host_lock(hc::accelerator& acc, void* hostPtr, std::size_t size,
+                                       hc::accelerator* visibleAc, std::size_t numVisibleAc){
+  auto& tracker = detail::runtime::get().tracker();
+  detail::allocation alloc;
+  if(!hostPtr || size == 0 || tracker.find(hostPtr, &alloc)) return AM_ERROR_MISC;
+  alloc.base = reinterpret_cast<std::uintptr_t>(hostPtr);
+  alloc.size = size;
+  alloc.owner = &acc.get_device();
+  alloc.flags = amHostPinned;
+  alloc.is_locked = true;
+  tracker.add(std::move(alloc));
+  for(std::size_t i = 0; i != numVisibleAc; ++i){
+    tracker.map_to(hostPtr, visibleAc[i].get_device().id());
+  }
+  return AM_SUCCESS;
+}
+
+inline am_status_t am_memory_host_unlock(hc::accelerator&, void* hostPtr){
+  auto& tracker = detail::runtime::get().tracker();
+  detail::allocation alloc;
+  if(!tracker.find(hostPtr, &alloc) || !alloc.is_locked
+     || alloc.base != reinterpret_cast<std::uintptr_t>(hostPtr)){
+    return AM_ERROR_MISC;
+  }
+  tracker.remove(hostPtr, &alloc);
+  return AM_SUCCESS;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// Host backend only: sharing am_alloc-ed memory with other processes. On ROCm, this is
+// hsa_amd_ipc_memory_create/attach/detach; common/ipc.hpp wraps both. The handle is plain bytes,
+// to be passed to the other process through shared memory, a pipe or a socket.
+
+struct am_ipc_memory_handle {
+  char name[64];                   // of the POSIX shared memory object
+  std::uint64_t size;
+  std::uint32_t device;            // id of the owning device in the exporting process
+  std::uint32_t flags;             // of the am_alloc call
+  std::uint32_t is_device_memory;
+};
+
+// Exports the allocation ptr is the base of, device memory or pinned host memory, but not memory
+// registered with am_memory_host_lock. size may be less than the allocation. The allocation must
+// not be written to while it is being exported (the first export of an allocation moves it into
+// shared memory). It stays valid in other processes after am_free here, but can't be attached to
+// any more.
+inline am_status_t am_ipc_memory_create(void* ptr, std::size_t size, am_ipc_memory_handle* handle){
+  detail::allocation alloc;
+  if(!handle || !detail::share(ptr, &alloc) || size > alloc.size
+     || alloc.shared_name.size() >= sizeof(handle->name)){
+    return AM_ERROR_MISC;
+  }
+  std::memset(handle, 0, sizeof(*handle));
+  std::memcpy(handle->name, alloc.shared_name.c_str(), alloc.shared_name.size());
+  handle->size = size;
+  handle->device = alloc.owner->id();
+  handle->flags = alloc.flags;
+  handle->is_device_memory = alloc.is_device_memory;
+  return AM_SUCCESS;
+}
+
+// Maps an exported allocation into this process, accessible from acc. Device memory belongs to the
+// device with the exporter's device id here (acc's, if there is none), so it needs am_map_to_peers
+// for other accelerators, as in the exporting process. am_free refuses it; detach it instead.
+inline am_status_t am_ipc_memory_attach(const am_ipc_memory_handle* handle, hc::accelerator& acc, void** mapped){
+  if(!handle || !mapped) return AM_ERROR_MISC;
+  auto& devices = detail::runtime::get().devices();
+  auto& owner = handle->device < devices.size() && !devices[handle->device]->is_cpu() == bool(handle->is_device_memory)
+    ? *devices[handle->device] : acc.get_device();
+  std::string name(handle->name, strnlen(handle->name, sizeof(handle->name)));
+  *mapped = detail::attach_shared(name, handle->size, owner, handle->is_device_memory, handle->flags);
+  if(!*mapped) return AM_ERROR_MISC;
+  detail::runtime::get().tracker().map_to(*mapped, acc.get_device().id());
+  return AM_SUCCESS;
+}
+
+inline am_status_t am_ipc_memory_detach(void* mapped){
+  return detail::detach_shared(mapped) ? AM_SUCCESS : AM_ERROR_MISC;
+}
+
+} // namespace hc
+
+#endif // HC_AM_HOST_HPP
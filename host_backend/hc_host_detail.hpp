@@ -0,0 +1,852 @@
+#ifndef HC_HOST_DETAIL_HPP
+#define HC_HOST_DETAIL_HPP
+
+// Internals of the host backend: NUMA helpers, the compute thread pool behind each simulated
+// device, the fibers that run the work-items of a tile, completion signals, the in-order command
+// queue behind each accelerator_view, the allocation tracker used by am_alloc/am_free/
+// am_memtracker_getinfo/am_map_to_peers, and the shared-memory export of allocations to other
+// processes behind am_ipc_memory_*.
+//
+// Nothing in here is part of the hc API; the examples should only ever see hc.hpp, hc_am.hpp and
+// pinned_vector.hpp.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sched.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+namespace hc {
+
+enum hcCommandKind {
+  hcCommandInvalid = -1,
+  hcMemcpyHostToHost = 0,
+  hcMemcpyHostToDevice = 1,
+  hcMemcpyDeviceToHost = 2,
+  hcMemcpyDeviceToDevice = 3,
+  hcCommandKernel = 4,
+  hcCommandMarker = 5,
+};
+
+namespace detail {
+
+// same value as amHostPinned in hc_am.hpp
+constexpr unsigned host_pinned_flag = 0x1;
+
+#ifdef MADV_POPULATE_WRITE
+constexpr int madv_populate_write = MADV_POPULATE_WRITE;
+#else
+constexpr int madv_populate_write = 23; // Linux >= 5.14; older kernels reject it, which is harmless
+#endif
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// NUMA topology, read straight from sysfs so we don't need libnuma at build time.
+
+inline std::string read_file(const std::string& path){
+  std::ifstream in(path);
+  std::stringstream contents;
+  contents << in.rdbuf();
+  return contents.str();
+}
+
+// parses lists like "0-3,8-11"
+inline std::vector<int> parse_cpulist(const std::string& list){
+  std::vector<int> result;
+  std::stringstream ss(list);
+  std::string range;
+  while(std::getline(ss, range, ',')){
+    if(range.empty() || range[0] == '\n') continue;
+    auto dash = range.find('-');
+    int first = std::atoi(range.c_str());
+    int last = dash == std::string::npos ? first : std::atoi(range.c_str() + dash + 1);
+    for(int i = first; i <= last; ++i) result.push_back(i);
+  }
+  return result;
+}
+
+inline std::vector<int> numa_online_nodes(){
+  auto nodes = parse_cpulist(read_file("/sys/devices/system/node/online"));
+  if(nodes.empty()) nodes.push_back(0);
+  return nodes;
+}
+
+inline std::vector<int> numa_node_cpus(int node){
+  return parse_cpulist(read_file("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist"));
+}
+
+// total memory of a NUMA node in bytes, falls back to total physical memory
+inline std::size_t numa_node_memory(int node){
+  std::stringstream meminfo(read_file("/sys/devices/system/node/node" + std::to_string(node) + "/meminfo"));
+  std::string line;
+  while(std::getline(meminfo, line)){
+    auto pos = line.find("MemTotal:");
+    if(pos != std::string::npos){
+      return std::strtoull(line.c_str() + pos + 9, nullptr, 10) * 1024;
+    }
+  }
+  return static_cast<std::size_t>(sysconf(_SC_PHYS_PAGES)) * sysconf(_SC_PAGESIZE);
+}
+
+// MPOL_BIND the pages in [addr, addr+bytes) to one node. Fails silently (returns false) where
+// mbind is unavailable, e.g. in containers without CAP_SYS_NICE or on single-node kernels.
+inline bool numa_bind_memory(void* addr, std::size_t bytes, int node){
+#ifdef SYS_mbind
+  constexpr int mpol_bind = 2;
+  constexpr std::size_t bits = sizeof(unsigned long) * CHAR_BIT;
+  std::vector<unsigned long> mask(node / bits + 1, 0);
+  mask[node / bits] |= 1UL << (node % bits);
+  return syscall(SYS_mbind, addr, bytes, mpol_bind, mask.data(), mask.size() * bits + 1, 0) == 0;
+#else
+  (void)addr; (void)bytes; (void)node;
+  return false;
+#endif
+}
+
+inline bool bind_current_thread_to_node(int node){
+  auto cpus = numa_node_cpus(node);
+  if(cpus.empty()) return false;
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for(auto cpu: cpus) CPU_SET(cpu, &set);
+  return sched_setaffinity(0, sizeof(set), &set) == 0;
+}
+
+inline std::size_t env_or(const char* name, std::size_t fallback){
+  const char* value = std::getenv(name);
+  return value && *value ? std::strtoull(value, nullptr, 10) : fallback;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// Timestamps, in nanoseconds of the steady clock.
+
+constexpr std::uint64_t tick_frequency = 1000000000;
+
+inline std::uint64_t now_ticks(){
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+           std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// Completion signal shared by a queued command and all completion_futures referring to it.
+
+class signal {
+public:
+  explicit signal(hcCommandKind kind) : kind_(kind) {}
+
+  void start(){
+    std::lock_guard<std::mutex> lock(mutex_);
+    begin_tick_ = now_ticks();
+  }
+
+  void complete(std::exception_ptr error = nullptr){
+    std::vector<std::function<void()>> callbacks;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      end_tick_ = now_ticks();
+      if(begin_tick_ == 0) begin_tick_ = end_tick_;
+      error_ = error;
+      ready_ = true;
+      callbacks.swap(callbacks_);
+    }
+    ready_cv_.notify_all();
+    for(auto& callback: callbacks) callback();
+  }
+
+  void wait() const {
+    std::unique_lock<std::mutex> lock(mutex_);
+    ready_cv_.wait(lock, [this]{ return ready_; });
+  }
+
+  bool is_ready() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return ready_;
+  }
+
+  std::exception_ptr error() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return error_;
+  }
+
+  // runs callback on the completing thread, or right away if already complete
+  void on_complete(std::function<void()> callback){
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if(!ready_){
+        callbacks_.push_back(std::move(callback));
+        return;
+      }
+    }
+    callback();
+  }
+
+  hcCommandKind kind() const { return kind_; }
+
+  std::uint64_t begin_tick() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return begin_tick_;
+  }
+
+  std::uint64_t end_tick() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return end_tick_;
+  }
+
+private:
+  hcCommandKind kind_;
+  mutable std::mutex mutex_;
+  mutable std::condition_variable ready_cv_;
+  bool ready_ = false;
+  std::exception_ptr error_;
+  std::uint64_t begin_tick_ = 0;
+  std::uint64_t end_tick_ = 0;
+  std::vector<std::function<void()>> callbacks_;
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// Compute threads of one simulated device. All views on the device share the pool, the same way
+// all queues on a GPU share its compute units. Several parallel_for calls may be in flight at once.
+
+class thread_pool {
+public:
+  using body_type = std::function<void(std::size_t, std::size_t)>;
+
+  thread_pool(unsigned workers, int numa_node){
+    for(unsigned i = 0; i != workers; ++i){
+      threads_.emplace_back([this, numa_node]{
+          bind_current_thread_to_node(numa_node);
+          worker_loop();
+        });
+    }
+  }
+
+  ~thread_pool(){
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    work_cv_.notify_all();
+    for(auto& thread: threads_) thread.join();
+  }
+
+  unsigned concurrency() const { return threads_.size() + 1; }
+
+  // Calls body(begin, end) on disjoint chunks covering [0, n); the calling thread helps out.
+  // Returns when all chunks are done, rethrowing the first exception thrown by body.
+  void parallel_for(std::size_t n, const body_type& body){
+    if(n == 0) return;
+    std::size_t grain = std::max<std::size_t>(1, n / (concurrency() * 8));
+    if(threads_.empty() || n <= grain){
+      body(0, n);
+      return;
+    }
+    auto work = std::make_shared<job>(body, n, grain);
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      jobs_.push_back(work);
+    }
+    work_cv_.notify_all();
+    while(run_chunk(*work)){}
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      retire(work);
+      done_cv_.wait(lock, [&]{ return work->done == n; });
+    }
+    if(work->error) std::rethrow_exception(work->error);
+  }
+
+private:
+  struct job {
+    job(const body_type& body, std::size_t n, std::size_t grain) : body(body), n(n), grain(grain) {}
+    const body_type& body;
+    const std::size_t n;
+    const std::size_t grain;
+    std::atomic<std::size_t> next{0};
+    std::atomic<std::size_t> done{0};
+    std::mutex error_mutex;
+    std::exception_ptr error;
+  };
+
+  // returns false when there are no chunks left to claim
+  bool run_chunk(job& work){
+    std::size_t begin = work.next.fetch_add(work.grain);
+    if(begin >= work.n) return false;
+    std::size_t end = std::min(begin + work.grain, work.n);
+    try {
+      work.body(begin, end);
+    }
+    catch(...){
+      std::lock_guard<std::mutex> lock(work.error_mutex);
+      if(!work.error) work.error = std::current_exception();
+    }
+    if(work.done.fetch_add(end - begin) + (end - begin) == work.n){
+      std::lock_guard<std::mutex> lock(mutex_);
+      done_cv_.notify_all();
+    }
+    return true;
+  }
+
+  // caller holds mutex_
+  void retire(const std::shared_ptr<job>& work){
+    auto it = std::find(jobs_.begin(), jobs_.end(), work);
+    if(it != jobs_.end()) jobs_.erase(it);
+  }
+
+  void worker_loop(){
+    for(;;){
+      std::shared_ptr<job> work;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        work_cv_.wait(lock, [this]{ return stop_ || !jobs_.empty(); });
+        if(stop_ && jobs_.empty()) return;
+        work = jobs_.front();
+      }
+      while(run_chunk(*work)){}
+      std::lock_guard<std::mutex> lock(mutex_);
+      retire(work);
+    }
+  }
+
+  std::vector<std::thread> threads_;
+  std::mutex mutex_;
+  std::condition_variable work_cv_;
+  std::condition_variable done_cv_;
+  std::deque<std::shared_ptr<job>> jobs_;
+  bool stop_ = false;
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// Work-items of one tile. They run as fibers on the thread that runs the tile, so that a
+// tile_static variable (a static thread_local, see hc.hpp) is shared by exactly the work-items of
+// the tile, and tile_barrier::wait switches to the next fiber until all have arrived. Work-item 0
+// runs first; if it finishes without reaching a barrier, the kernel has none (all work-items of a
+// tile must reach the same barriers), and the others run as plain calls, without fibers.
+
+class tile_runner {
+public:
+  // one per thread; fibers and their stacks are reused from tile to tile
+  static tile_runner& current(){
+    thread_local tile_runner runner;
+    return runner;
+  }
+
+  // item(i) for i in [0, n), with barriers across all of them
+  void run(std::size_t n, const std::function<void(std::size_t)>& item){
+    if(n == 0) return;
+    item_ = &item;
+    error_ = nullptr;
+    barrier_seen_ = false;
+    while(fibers_.size() < n) fibers_.emplace_back(new fiber());
+    start(0);
+    if(!barrier_seen_){
+      for(std::size_t i = 1; i != n && !error_; ++i){
+        try {
+          item(i);
+        }
+        catch(...){
+          error_ = std::current_exception();
+        }
+      }
+    }
+    else {
+      for(std::size_t i = 1; i != n; ++i) start(i);
+      // every round takes each work-item to its next barrier, or to its end
+      for(bool waiting = true; waiting;){
+        waiting = false;
+        for(std::size_t i = 0; i != n; ++i){
+          if(fibers_[i]->done) continue;
+          resume(i);
+          waiting = true;
+        }
+      }
+    }
+    item_ = nullptr;
+    if(error_) std::rethrow_exception(error_);
+  }
+
+  // from a work-item: waits until all work-items of the tile have called it
+  void barrier(){
+    if(!in_fiber_){
+      throw std::logic_error("tile_barrier::wait: not in a tiled parallel_for_each, or not reached by all work-items"
+                             " of the tile");
+    }
+    barrier_seen_ = true;
+    in_fiber_ = false;
+    swapcontext(&fibers_[current_]->context, &main_);
+  }
+
+private:
+  static constexpr std::size_t stack_bytes = 64 * 1024;
+
+  struct fiber {
+    ucontext_t context;
+    std::unique_ptr<char[]> stack{new char[stack_bytes]};
+    bool done = false;
+  };
+
+  tile_runner() = default;
+
+  static void entry(){
+    auto& self = current();
+    try {
+      (*self.item_)(self.current_);
+    }
+    catch(...){
+      if(!self.error_) self.error_ = std::current_exception();
+    }
+    self.fibers_[self.current_]->done = true;
+    self.in_fiber_ = false;
+    // returning switches to uc_link, main_
+  }
+
+  void start(std::size_t i){
+    auto& f = *fibers_[i];
+    getcontext(&f.context);
+    f.context.uc_stack.ss_sp = f.stack.get();
+    f.context.uc_stack.ss_size = stack_bytes;
+    f.context.uc_link = &main_;
+    f.done = false;
+    makecontext(&f.context, &tile_runner::entry, 0);
+    resume(i);
+  }
+
+  void resume(std::size_t i){
+    current_ = i;
+    in_fiber_ = true;
+    swapcontext(&main_, &fibers_[i]->context);
+  }
+
+  ucontext_t main_;
+  std::vector<std::unique_ptr<fiber>> fibers_;
+  const std::function<void(std::size_t)>* item_ = nullptr;
+  std::size_t current_ = 0;
+  bool in_fiber_ = false;
+  bool barrier_seen_ = false;
+  std::exception_ptr error_;
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// In-order command queue with one worker thread; this is what an accelerator_view refers to.
+// Submission returns immediately, execution is strictly sequential, as on a real HSA queue.
+
+class device;
+
+class queue {
+public:
+  explicit queue(device& dev);
+  ~queue();
+  queue(const queue&) = delete;
+  queue& operator=(const queue&) = delete;
+
+  std::shared_ptr<signal> enqueue(hcCommandKind kind, std::function<void()> work){
+    auto sig = std::make_shared<signal>(kind);
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      pending_.push_back(command{sig, std::move(work)});
+      last_ = sig;
+    }
+    pending_cv_.notify_one();
+    return sig;
+  }
+
+  // blocks until everything submitted so far has completed
+  void wait(){
+    std::shared_ptr<signal> last;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      last = last_;
+    }
+    if(last) last->wait();
+  }
+
+  // submitted and not completed yet, including the one executing
+  std::size_t pending(){
+    std::lock_guard<std::mutex> lock(mutex_);
+    return pending_.size() + (running_ ? 1 : 0);
+  }
+
+  device& get_device() const { return device_; }
+
+private:
+  struct command {
+    std::shared_ptr<signal> sig;
+    std::function<void()> work;
+  };
+
+  void worker_loop();
+
+  device& device_;
+  std::mutex mutex_;
+  std::condition_variable pending_cv_;
+  std::deque<command> pending_;
+  std::shared_ptr<signal> last_;
+  bool running_ = false;
+  bool stop_ = false;
+  std::thread worker_;
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// A simulated accelerator: a NUMA node's worth of memory budget plus a share of its cores.
+
+class device {
+public:
+  device(unsigned id, bool is_cpu, int numa_node, std::size_t memory_bytes, unsigned compute_threads)
+    : id_(id), is_cpu_(is_cpu), numa_node_(numa_node), memory_bytes_(memory_bytes),
+      pool_(compute_threads > 0 ? compute_threads - 1 : 0, numa_node)
+  {
+    if(is_cpu){
+      path_ = L"cpu";
+      description_ = L"CPU Device";
+    }
+    else {
+      path_ = L"host" + std::to_wstring(id);
+      description_ = L"Host backend device " + std::to_wstring(id) + L" (NUMA node "
+        + std::to_wstring(numa_node) + L", " + std::to_wstring(pool_.concurrency()) + L" threads)";
+    }
+  }
+
+  unsigned id() const { return id_; }
+  bool is_cpu() const { return is_cpu_; }
+  int numa_node() const { return numa_node_; }
+  std::size_t memory_bytes() const { return memory_bytes_; }
+  const std::wstring& path() const { return path_; }
+  const std::wstring& description() const { return description_; }
+  thread_pool& pool() { return pool_; }
+
+  std::shared_ptr<queue> default_queue(){
+    std::lock_guard<std::mutex> lock(mutex_);
+    if(!default_queue_) default_queue_ = std::make_shared<queue>(*this);
+    return default_queue_;
+  }
+
+  // dedicated memory accounting, so oversized allocations fail like they would on a GPU
+  bool reserve(std::size_t bytes){
+    std::lock_guard<std::mutex> lock(mutex_);
+    if(is_cpu_) return true;
+    if(bytes > memory_bytes_ - allocated_bytes_) return false;
+    allocated_bytes_ += bytes;
+    return true;
+  }
+
+  void release(std::size_t bytes){
+    std::lock_guard<std::mutex> lock(mutex_);
+    if(!is_cpu_) allocated_bytes_ -= bytes;
+  }
+
+private:
+  unsigned id_;
+  bool is_cpu_;
+  int numa_node_;
+  std::size_t memory_bytes_;
+  std::size_t allocated_bytes_ = 0;
+  std::wstring path_;
+  std::wstring description_;
+  thread_pool pool_;
+  std::mutex mutex_;
+  std::shared_ptr<queue> default_queue_;
+};
+
+inline queue::queue(device& dev)
+  : device_(dev), worker_([this]{ worker_loop(); })
+{}
+
+inline queue::~queue(){
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  pending_cv_.notify_one();
+  worker_.join();
+}
+
+inline void queue::worker_loop(){
+  bind_current_thread_to_node(device_.numa_node());
+  for(;;){
+    command cmd;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      pending_cv_.wait(lock, [this]{ return stop_ || !pending_.empty(); });
+      if(pending_.empty()) return; // stop_ is set, and everything has been drained
+      cmd = std::move(pending_.front());
+      pending_.pop_front();
+      running_ = true;
+    }
+    cmd.sig->start();
+    std::exception_ptr error;
+    try {
+      if(cmd.work) cmd.work();
+    }
+    catch(...){
+      error = std::current_exception();
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      running_ = false;
+    }
+    cmd.sig->complete(error);
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// Allocation tracker.
+
+struct allocation {
+  std::uintptr_t base = 0;
+  std::size_t size = 0;
+  device* owner = nullptr;
+  bool is_device_memory = false;
+  unsigned flags = 0;
+  std::uint64_t seq = 0;
+  bool is_locked = false;  // host memory registered with am_memory_host_lock, not ours to unmap
+  bool is_imported = false;  // attached from another process, see attach_shared
+  std::string shared_name;   // the shared memory object backing it, once exported
+  std::vector<bool> peers; // indexed by device id; devices other than owner that may access it
+
+  bool contains(const void* ptr, std::size_t bytes = 0) const {
+    auto p = reinterpret_cast<std::uintptr_t>(ptr);
+    return p >= base && p - base <= size && bytes <= size - (p - base);
+  }
+
+  bool accessible_from(const device& dev) const {
+    return !is_device_memory || owner == &dev || (dev.id() < peers.size() && peers[dev.id()]);
+  }
+};
+
+class memory_tracker {
+public:
+  void add(allocation info){
+    std::lock_guard<std::mutex> lock(mutex_);
+    info.seq = ++seq_;
+    allocations_[info.base] = std::move(info);
+  }
+
+  bool remove(const void* base, allocation* info){
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = allocations_.find(reinterpret_cast<std::uintptr_t>(base));
+    if(it == allocations_.end()) return false;
+    *info = std::move(it->second);
+    allocations_.erase(it);
+    return true;
+  }
+
+  // finds the allocation containing ptr, which need not be the base pointer
+  bool find(const void* ptr, allocation* info) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = lookup(ptr);
+    if(it == allocations_.end()) return false;
+    *info = it->second;
+    return true;
+  }
+
+  bool set_shared_name(const void* base, const std::string& name){
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = allocations_.find(reinterpret_cast<std::uintptr_t>(base));
+    if(it == allocations_.end()) return false;
+    it->second.shared_name = name;
+    return true;
+  }
+
+  bool map_to(const void* ptr, unsigned device_id){
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = lookup(ptr);
+    if(it == allocations_.end()) return false;
+    auto& peers = it->second.peers;
+    if(peers.size() <= device_id) peers.resize(device_id + 1, false);
+    peers[device_id] = true;
+    return true;
+  }
+
+private:
+  std::map<std::uintptr_t, allocation>::const_iterator lookup(const void* ptr) const {
+    auto p = reinterpret_cast<std::uintptr_t>(ptr);
+    auto it = allocations_.upper_bound(p);
+    if(it == allocations_.begin()) return allocations_.end();
+    --it;
+    return p < it->second.base + it->second.size ? it : allocations_.end();
+  }
+
+  std::map<std::uintptr_t, allocation>::iterator lookup(const void* ptr){
+    auto it = static_cast<const memory_tracker*>(this)->lookup(ptr);
+    return allocations_.erase(it, it); // const_iterator -> iterator
+  }
+
+  mutable std::mutex mutex_;
+  std::map<std::uintptr_t, allocation> allocations_;
+  std::uint64_t seq_ = 0;
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// Process-wide state. Deliberately leaked, so that worker threads never outlive the objects they
+// use during static destruction.
+//
+// Configuration through the environment:
+//   HC_HOST_DEVICES        number of simulated GPUs (default: number of NUMA nodes)
+//   HC_HOST_DEVICE_MEMORY  dedicated memory per simulated GPU, in MiB
+//                          (default: the node's memory divided by the devices on that node)
+//   HC_HOST_DEVICE_THREADS compute threads per simulated GPU
+//                          (default: the node's cores divided by the devices on that node)
+
+class runtime {
+public:
+  static runtime& get(){
+    static runtime* instance = new runtime();
+    return *instance;
+  }
+
+  const std::vector<std::unique_ptr<device>>& devices() const { return devices_; }
+
+  device& default_device() const { return *devices_[1]; }
+
+  memory_tracker& tracker() { return tracker_; }
+
+private:
+  runtime(){
+    auto nodes = numa_online_nodes();
+    unsigned count = std::max<std::size_t>(1, env_or("HC_HOST_DEVICES", nodes.size()));
+    devices_.emplace_back(new device(0, true, nodes.front(), numa_node_memory(nodes.front()), 1));
+    for(unsigned i = 0; i != count; ++i){
+      int node = nodes[i % nodes.size()];
+      unsigned sharing = count / nodes.size() + (i % nodes.size() < count % nodes.size() ? 1 : 0);
+      std::size_t cpus = numa_node_cpus(node).size();
+      if(cpus == 0) cpus = std::max(1u, std::thread::hardware_concurrency());
+      std::size_t memory = env_or("HC_HOST_DEVICE_MEMORY", 0) * 1024 * 1024;
+      if(memory == 0) memory = numa_node_memory(node) / sharing;
+      unsigned threads = env_or("HC_HOST_DEVICE_THREADS", std::max<std::size_t>(1, cpus / sharing));
+      devices_.emplace_back(new device(i + 1, false, node, memory, threads));
+    }
+  }
+
+  std::vector<std::unique_ptr<device>> devices_;
+  memory_tracker tracker_;
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// Raw allocation. Device memory is mmap-ed and bound to the device's NUMA node; host-pinned memory
+// is left to first touch (nothing is actually page-locked, there is no DMA engine to feed).
+
+inline void* allocate(device& dev, std::size_t bytes, unsigned flags){
+  if(bytes == 0) return nullptr;
+  bool device_memory = !(flags & host_pinned_flag) && !dev.is_cpu();
+  if(device_memory && !dev.reserve(bytes)) return nullptr;
+  void* ptr = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if(ptr == MAP_FAILED){
+    if(device_memory) dev.release(bytes);
+    return nullptr;
+  }
+  if(device_memory) numa_bind_memory(ptr, bytes, dev.numa_node());
+  // GPU memory and pinned memory are resident once allocated; fault the pages in up front, so
+  // that the first copy into a buffer doesn't pay for it
+  madvise(ptr, bytes, madv_populate_write);
+
+  allocation info;
+  info.base = reinterpret_cast<std::uintptr_t>(ptr);
+  info.size = bytes;
+  info.owner = &dev;
+  info.is_device_memory = device_memory;
+  info.flags = flags;
+  runtime::get().tracker().add(std::move(info));
+  return ptr;
+}
+
+inline bool deallocate(void* ptr){
+  allocation info;
+  auto& tracker = runtime::get().tracker();
+  if(!ptr || !tracker.find(ptr, &info) || info.is_locked || info.is_imported || !tracker.remove(ptr, &info)) return false;
+  munmap(ptr, info.size);
+  // processes that have attached keep their mappings; no new ones can attach
+  if(!info.shared_name.empty()) shm_unlink(info.shared_name.c_str());
+  if(info.is_device_memory) info.owner->release(info.size);
+  return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// Sharing allocations between processes. Exporting moves an allocation, in place, from anonymous
+// memory to a POSIX shared memory object: its contents are copied into the object, which is then
+// mapped over the same addresses, so pointers stay valid. Other processes attach by name. Nothing
+// may be writing to the allocation while it is being exported.
+
+// the name of the shared memory object behind the allocation at base, exporting it first if needed
+inline bool share(void* base, allocation* info){
+  auto& tracker = runtime::get().tracker();
+  if(!tracker.find(base, info) || info->base != reinterpret_cast<std::uintptr_t>(base) || info->is_locked){
+    return false;
+  }
+  if(!info->shared_name.empty()) return true;
+  std::string name = "/hc_host_ipc." + std::to_string(getpid()) + "." + std::to_string(info->seq);
+  int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+  if(fd < 0) return false;
+  bool ok = ftruncate(fd, info->size) == 0;
+  void* staging = ok ? mmap(nullptr, info->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+  if(staging != MAP_FAILED){
+    std::memcpy(staging, base, info->size);
+    munmap(staging, info->size);
+    ok = mmap(base, info->size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) != MAP_FAILED;
+  }
+  else ok = false;
+  close(fd);
+  if(!ok){
+    shm_unlink(name.c_str());
+    return false;
+  }
+  if(info->is_device_memory) numa_bind_memory(base, info->size, info->owner->numa_node());
+  tracker.set_shared_name(base, name);
+  info->shared_name = name;
+  return true;
+}
+
+// maps the shared memory object name into this process, as memory of owner; null on failure
+inline void* attach_shared(const std::string& name, std::size_t bytes, device& owner, bool is_device_memory,
+                           unsigned flags){
+  int fd = shm_open(name.c_str(), O_RDWR, 0);
+  if(fd < 0) return nullptr;
+  void* ptr = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if(ptr == MAP_FAILED) return nullptr;
+  allocation info;
+  info.base = reinterpret_cast<std::uintptr_t>(ptr);
+  info.size = bytes;
+  info.owner = &owner;
+  info.is_device_memory = is_device_memory;
+  info.flags = flags;
+  info.is_imported = true;
+  runtime::get().tracker().add(std::move(info));
+  return ptr;
+}
+
+inline bool detach_shared(void* ptr){
+  allocation info;
+  auto& tracker = runtime::get().tracker();
+  if(!ptr || !tracker.find(ptr, &info) || !info.is_imported || info.base != reinterpret_cast<std::uintptr_t>(ptr)){
+    return false;
+  }
+  tracker.remove(ptr, &info);
+  munmap(ptr, info.size);
+  return true;
+}
+
+} // namespace detail
+} // namespace hc
+
+#endif // HC_HOST_DETAIL_HPP
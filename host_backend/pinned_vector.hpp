@@ -0,0 +1,51 @@
+#ifndef PINNED_VECTOR_HOST_HPP
+#define PINNED_VECTOR_HOST_HPP
+
+// Host backend for hc::pinned_vector: a std::vector whose storage is am_alloc-ed host-pinned
+// memory, so that it can be used with accelerator_view::copy_async.
+
+#include "hc_am.hpp"
+
+#include <new>
+#include <vector>
+
+namespace hc {
+
+template<typename T>
+class am_allocator {
+public:
+  using value_type = T;
+
+  am_allocator() = default;
+
+  explicit am_allocator(const hc::accelerator& acc) : acc_(acc) {}
+
+  template<typename U>
+  am_allocator(const am_allocator<U>& other) : acc_(other.get_accelerator()) {}
+
+  T* allocate(std::size_t n){
+    if(n == 0) return nullptr;
+    void* ptr = am_alloc(n * sizeof(T), acc_, amHostPinned);
+    if(!ptr) throw std::bad_alloc();
+    return static_cast<T*>(ptr);
+  }
+
+  void deallocate(T* ptr, std::size_t){ am_free(ptr); }
+
+  const hc::accelerator& get_accelerator() const { return acc_; }
+
+  template<typename U>
+  bool operator==(const am_allocator<U>&) const { return true; }
+  template<typename U>
+  bool operator!=(const am_allocator<U>&) const { return false; }
+
+private:
+  hc::accelerator acc_;
+};
+
+template<typename T>
+using pinned_vector = std::vector<T, am_allocator<T>>;
+
+} // namespace hc
+
+#endif // PINNED_VECTOR_HOST_HPP